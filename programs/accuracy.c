@@ -0,0 +1,188 @@
+/** Measures the speed and accuracy of the current build of the engine on all
+  headless scenes (see scenes.h), to find out what the speed affecting
+  compile options (TPE_APPROXIMATE_LENGTH, TPE_RESHAPE_ITERATIONS, ...) cost
+  in stability. Run by accuracy.sh for a matrix of options. Per scene it
+  measures:
+
+  - step time (ns per step, only the world steps)
+  - penetration: average depth of joints in the environment (in TPE units,
+    averaged over all joints and steps)
+  - shape deviation: average relative difference of connection lengths from
+    their rest lengths in hard bodies (in per mille)
+  - energy: average total kinetic energy of joints (in TPE_F^2 units)
+
+  usage:
+    accuracy > file   prints the metrics of each scene (of the reference build)
+    accuracy file     prints one line summarizing all scenes compared to the
+                      reference: total ns/step, average difference of
+                      penetration and of shape deviation from the reference
+                      (negative = more accurate than the reference) and
+                      average relative energy difference from the reference
+                      (%) */
+
+#define _POSIX_C_SOURCE 199309L // for clock_gettime
+
+#include <stdint.h>
+#include <time.h>
+
+uint64_t nanoTime(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec * ((uint64_t) 1000000000) + t.tv_nsec;
+}
+
+uint64_t stepStart, stepTime;
+
+#define SCENE_WORLD_STEP_BEGIN stepStart = nanoTime();
+#define SCENE_WORLD_STEP_END stepTime = nanoTime() - stepStart;
+
+#include "scenes.h"
+#include <stdio.h>
+
+#define STEPS 600
+
+typedef struct
+{
+  double nsPerStep;
+  double penetration;
+  double shape;
+  double energy;
+} Metrics;
+
+void measure(int scene, Metrics *m)
+{
+  double penetration = 0, shape = 0, energy = 0;
+  uint64_t time = 0, joints = 0, connections = 0;
+
+  scene_init(scene);
+
+  for (int i = 0; i < STEPS; ++i)
+  {
+    scene_step(scene);
+    time += stepTime;
+
+    for (uint16_t j = 0; j < scene_world.bodyCount; ++j)
+    {
+      const TPE_Body *b = &scene_world.bodies[j];
+
+      for (uint8_t k = 0; k < b->jointCount; ++k)
+      {
+        const TPE_Joint *joint = b->joints + k;
+        TPE_Unit size = TPE_JOINT_SIZE(*joint);
+
+        TPE_Vec3 p =
+          scene_world.environmentFunction(joint->position,size);
+
+        TPE_Unit d = TPE_dist(p,joint->position);
+
+        if (p.x == joint->position.x && p.y == joint->position.y &&
+          p.z == joint->position.z)
+          d = 0; // center inside the environment, count as whole size
+
+        if (d < size)
+          penetration += size - d;
+
+        double v = 0;
+
+        for (int l = 0; l < 3; ++l)
+          v += ((double) joint->velocity[l]) * joint->velocity[l];
+
+        energy += (((double) b->jointMass) / TPE_F) * v / (2.0 * TPE_F);
+        joints++;
+      }
+
+      if (b->flags & TPE_BODY_FLAG_SOFT)
+        continue;
+
+      for (uint8_t k = 0; k < b->connectionCount; ++k)
+      {
+        const TPE_Connection *c = b->connections + k;
+
+        TPE_Unit l = TPE_dist(b->joints[c->joint1].position,
+          b->joints[c->joint2].position);
+
+        if (c->length > 0)
+          shape += (1000.0 * (l > c->length ? l - c->length : c->length - l))
+            / c->length;
+
+        connections++;
+      }
+    }
+  }
+
+  m->nsPerStep = ((double) time) / STEPS;
+  m->penetration = joints ? penetration / joints : 0;
+  m->shape = connections ? shape / connections : 0;
+  m->energy = energy / STEPS;
+}
+
+int main(int argc, char **argv)
+{
+  Metrics m;
+
+  if (argc < 2)
+  {
+    printf("# scene\tns/step\tpenetration\tshape\tenergy\n");
+
+    for (int s = 0; s < SCENE_COUNT; ++s)
+    {
+      measure(s,&m);
+      printf("%s\t%.1f\t%.3f\t%.3f\t%.3f\n",scenes[s].name,m.nsPerStep,
+        m.penetration,m.shape,m.energy);
+    }
+
+    return 0;
+  }
+
+  FILE *f = fopen(argv[1],"r");
+
+  if (!f)
+  {
+    printf("ERROR: couldn't open %s\n",argv[1]);
+    return 1;
+  }
+
+  char line[512];
+  double time = 0, penetration = 0, shape = 0, energy = 0;
+
+  for (int s = 0; s < SCENE_COUNT; ++s)
+  {
+    char name[64];
+    Metrics ref;
+
+    do
+      if (!fgets(line,sizeof(line),f))
+      {
+        printf("ERROR: reference doesn't match the scenes\n");
+        fclose(f);
+        return 1;
+      }
+    while (line[0] == '#');
+
+    if (sscanf(line,"%63s %lf %lf %lf %lf",name,&ref.nsPerStep,
+      &ref.penetration,&ref.shape,&ref.energy) != 5 ||
+      strcmp(name,scenes[s].name) != 0)
+    {
+      printf("ERROR: reference doesn't match the scenes\n");
+      fclose(f);
+      return 1;
+    }
+
+    measure(s,&m);
+
+    time += m.nsPerStep;
+    penetration += (m.penetration - ref.penetration) / SCENE_COUNT;
+    shape += (m.shape - ref.shape) / SCENE_COUNT;
+
+    if (ref.energy > 0)
+      energy += (100.0 * (m.energy > ref.energy ? m.energy - ref.energy :
+        ref.energy - m.energy)) / ref.energy / SCENE_COUNT;
+  }
+
+  fclose(f);
+
+  printf("%.0f\t%.3f\t%.3f\t%.2f\n",time,penetration,shape,energy);
+
+  return 0;
+}
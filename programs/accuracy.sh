@@ -0,0 +1,76 @@
+#!/bin/bash
+# Accuracy versus speed report: builds accuracy.c with a matrix of speed
+# affecting compile options, measures each build against a reference build
+# (the most accurate settings) and prints a table of step time and drift
+# metrics (differences from the reference, shape in per mille). Builds that no
+# other build beats in all of the columns (time, penetration, shape, energy)
+# are marked as Pareto optimal.
+#
+# usage: ./accuracy.sh [extra compiler flags]
+
+cd "$(dirname "$0")"
+
+BIN=/tmp/tpe_accuracy
+REF=/tmp/tpe_accuracy_reference
+FLAGS="-std=c99 -O3 -Wno-unused-parameter $*"
+
+REFERENCE="-DTPE_APPROXIMATE_LENGTH=0 -DTPE_APPROXIMATE_NET_SPEED=0 \
+-DTPE_RESHAPE_ITERATIONS=8 -DTPE_COLLISION_RESOLUTION_ITERATIONS=32 \
+-DTPE_RESHAPE_TENSION_LIMIT=5"
+
+CONFIGS=(
+  "reference|$REFERENCE"
+  "default|"
+  "approx length|-DTPE_APPROXIMATE_LENGTH=1"
+  "exact net speed|-DTPE_APPROXIMATE_NET_SPEED=0"
+  "reshape iter 0|-DTPE_RESHAPE_ITERATIONS=0"
+  "reshape iter 1|-DTPE_RESHAPE_ITERATIONS=1"
+  "reshape iter 6|-DTPE_RESHAPE_ITERATIONS=6"
+  "reshape limit 10|-DTPE_RESHAPE_TENSION_LIMIT=10"
+  "reshape limit 40|-DTPE_RESHAPE_TENSION_LIMIT=40"
+  "collision iter 4|-DTPE_COLLISION_RESOLUTION_ITERATIONS=4"
+  "collision iter 8|-DTPE_COLLISION_RESOLUTION_ITERATIONS=8"
+  "fast|-DTPE_APPROXIMATE_LENGTH=1 -DTPE_RESHAPE_ITERATIONS=1 \
+-DTPE_COLLISION_RESOLUTION_ITERATIONS=8"
+)
+
+gcc $FLAGS $REFERENCE -o $BIN accuracy.c -lm && $BIN > $REF || exit 1
+
+RESULTS=""
+
+for CONFIG in "${CONFIGS[@]}"; do
+  NAME=${CONFIG%%|*}
+  DEFINES=${CONFIG#*|}
+
+  if ! gcc $FLAGS $DEFINES -o $BIN accuracy.c -lm; then
+    echo "$NAME: can't build"
+    continue
+  fi
+
+  RESULTS="$RESULTS$NAME	$($BIN $REF)
+"
+done
+
+printf "%s" "$RESULTS" | awk -F '\t' '
+  {
+    name[NR] = $1; t[NR] = $2; p[NR] = $3; s[NR] = $4; e[NR] = $5;
+  }
+
+  END {
+    printf("%-20s %12s %12s %12s %12s  %s\n","build","ns/step","penetr. diff",
+      "shape diff","energy diff %","pareto");
+
+    for (i = 1; i <= NR; ++i)
+    {
+      dominated = 0;
+
+      for (j = 1; j <= NR; ++j)
+        if (j != i && t[j] <= t[i] && p[j] <= p[i] && s[j] <= s[i] &&
+          e[j] <= e[i] && (t[j] < t[i] || p[j] < p[i] || s[j] < s[i] ||
+          e[j] < e[i]))
+          dominated = 1;
+
+      printf("%-20s %12d %12.3f %12.3f %12.2f  %s\n",name[i],t[i],p[i],s[i],
+        e[i],dominated ? "" : "*");
+    }
+  }'
@@ -0,0 +1,451 @@
+/** Headless benchmark of all demo scenes: runs each scene (see scenes.h) for
+  a fixed number of steps, measures every TPE_worldStep call and prints one
+  line per scene in a machine readable (tab separated) format: mean ns per
+  step, steps per second and percentiles of the step time (ns). The output can
+  be saved and later passed as a baseline to compare against, e.g. before and
+  after a change or between build configurations.
+
+  usage:
+    bench [steps [repeats]] > file          runs the benchmark
+    bench --compare file [steps [repeats]]  runs and compares to a baseline,
+                                            exits with 1 if any scene got
+                                            slower by more than THRESHOLD %
+
+  Each scene is run repeats times (from the start). The mean is computed from
+  the fastest run of each step to reduce noise, the percentiles from all
+  measured steps of all runs so that they show the real spread. Inputs are
+  scripted so that each run performs exactly the same work, the final world
+  hash is printed to check that. A baseline can only be compared against if it
+  was measured with the same number of steps.
+
+  Optionally (Linux only, compile with -DBENCH_COUNTERS=1) hardware
+  performance counters can be measured per step phase:
+
+    bench --counters [steps]                prints cycles, instructions, IPC,
+                                            cache and branch misses per phase
+
+  This uses the engine's step statistics with the phase "time" being a counter
+  (see TPE_STATS_TIME), each scene is run once per counter. The counters only
+  count user space. On x86 they are read in user space with rdpmc (through the
+  counter's mmap'd page, tens of cycles per read), elsewhere or if the kernel
+  doesn't allow rdpmc with a read() syscall, which costs much more. The
+  measured cost of one read is printed, it's included in each phase about
+  once per body. */
+
+#ifndef BENCH_COUNTERS
+  #define BENCH_COUNTERS 0
+#endif
+
+#if BENCH_COUNTERS
+  #ifndef _GNU_SOURCE
+    #define _GNU_SOURCE // for syscall
+  #endif
+#else
+  #define _POSIX_C_SOURCE 199309L // for clock_gettime
+#endif
+
+#include <stdint.h>
+#include <time.h>
+
+#if BENCH_COUNTERS
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+int counterFd = -1;
+volatile struct perf_event_mmap_page *counterPage = 0; // 0 = use read()
+
+uint64_t readCounter(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if (counterPage)
+  {
+    uint32_t seq, index;
+    uint64_t value;
+
+    do // the kernel may update the page meanwhile, then try again
+    {
+      seq = counterPage->lock;
+      __asm__ volatile("" ::: "memory");
+
+      index = counterPage->index;
+      value = counterPage->offset;
+
+      if (index != 0) // 0 = counter not active now
+      {
+        uint32_t lo, hi;
+
+        __asm__ volatile("rdpmc" : "=a" (lo), "=d" (hi) : "c" (index - 1));
+
+        int64_t pmc = (int64_t) ((((uint64_t) hi) << 32) | lo);
+        int shift = 64 - counterPage->pmc_width;
+
+        value += (uint64_t) ((int64_t) (((uint64_t) pmc) << shift) >> shift);
+      }
+
+      __asm__ volatile("" ::: "memory");
+    } while (counterPage->lock != seq);
+
+    return value;
+  }
+#endif
+
+  uint64_t value;
+
+  return read(counterFd,&value,sizeof(value)) == sizeof(value) ? value : 0;
+}
+
+#define TPE_STATS 1
+#define TPE_STATS_TIME() readCounter()
+#endif
+
+uint64_t nanoTime(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec * ((uint64_t) 1000000000) + t.tv_nsec;
+}
+
+uint64_t stepStart, stepTime;
+
+// the time of only the world step is measured, not of applying the inputs
+
+#define SCENE_WORLD_STEP_BEGIN stepStart = nanoTime();
+#define SCENE_WORLD_STEP_END stepTime = nanoTime() - stepStart;
+
+#include "scenes.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_STEPS 1000
+#define DEFAULT_REPEATS 5
+#define MAX_STEPS 100000
+#define THRESHOLD 5.0
+
+uint64_t times[MAX_STEPS];
+uint64_t *samples; // all steps of all repeats
+
+int compareTimes(const void *a, const void *b)
+{
+  uint64_t x = *((const uint64_t *) a), y = *((const uint64_t *) b);
+  return (x > y) - (x < y);
+}
+
+typedef struct
+{
+  char name[64];
+  int steps;
+  double nsPerStep;
+} Baseline;
+
+Baseline baseline[SCENE_COUNT];
+int baselineCount = 0;
+
+int loadBaseline(const char *fileName)
+{
+  FILE *f = fopen(fileName,"r");
+
+  if (!f)
+    return 0;
+
+  char line[512];
+
+  while (fgets(line,sizeof(line),f) && baselineCount < SCENE_COUNT)
+  {
+    Baseline *b = baseline + baselineCount;
+
+    if (line[0] == '#' ||
+      sscanf(line,"%63s %d %lf",b->name,&b->steps,&b->nsPerStep) != 3)
+      continue;
+
+    baselineCount++;
+  }
+
+  fclose(f);
+  return 1;
+}
+
+#if BENCH_COUNTERS
+#define COUNTERS 4
+
+const uint64_t counterConfigs[COUNTERS] =
+  {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+   PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+// reported phases, the solver is tension + reshape + cancel
+
+#define PHASES 5
+
+const char *phaseNames[PHASES] =
+  {"integrate","environment","solver","bodies","deactivation"};
+
+int phaseOf(int statsPhase)
+{
+  switch (statsPhase)
+  {
+    case TPE_STATS_PHASE_INTEGRATE: return 0;
+    case TPE_STATS_PHASE_ENVIRONMENT: return 1;
+    case TPE_STATS_PHASE_BODIES: return 3;
+    case TPE_STATS_PHASE_DEACTIVATION: return 4;
+    default: return 2;
+  }
+}
+
+void closeCounterPage(void)
+{
+  if (counterPage)
+    munmap((void *) counterPage,sysconf(_SC_PAGESIZE));
+
+  counterPage = 0;
+}
+
+int openCounter(uint64_t config)
+{
+  struct perf_event_attr attr;
+
+  memset(&attr,0,sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  counterFd = syscall(SYS_perf_event_open,&attr,0,-1,-1,0);
+
+  if (counterFd < 0)
+    return 0;
+
+  counterPage = 0;
+
+#if defined(__x86_64__) || defined(__i386__)
+  void *page =
+    mmap(0,sysconf(_SC_PAGESIZE),PROT_READ,MAP_SHARED,counterFd,0);
+
+  if (page != MAP_FAILED)
+  {
+    counterPage = (volatile struct perf_event_mmap_page *) page;
+
+    if (!counterPage->cap_user_rdpmc)
+      closeCounterPage();
+  }
+#endif
+
+  return 1;
+}
+
+void closeCounter(void)
+{
+  closeCounterPage();
+  close(counterFd);
+}
+
+/* Measures the cost of one counter read in cycles, with the cycle counter
+  opened. */
+double counterReadCost(void)
+{
+  uint64_t t = readCounter();
+
+  for (int i = 0; i < 1000; ++i)
+    readCounter();
+
+  return (readCounter() - t) / 1001.0;
+}
+
+int counters(int steps)
+{
+  TPE_WorldStats stats;
+  double values[PHASES][COUNTERS];
+
+  if (steps < 1)
+  {
+    printf("ERROR: bad arguments\n");
+    return 1;
+  }
+
+  printf("# scene\tphase\tcycles/step\tinstructions/step\tIPC\t"
+    "cache misses/joint\tbranch misses/joint\n");
+
+  for (int s = 0; s < SCENE_COUNT; ++s)
+  {
+    uint32_t joints = 0;
+
+    for (int i = 0; i < PHASES; ++i)
+      for (int j = 0; j < COUNTERS; ++j)
+        values[i][j] = 0;
+
+    for (int c = 0; c < COUNTERS; ++c)
+    {
+      if (!openCounter(counterConfigs[c]))
+      {
+        printf("ERROR: couldn't open a hardware counter (no PMU or "
+          "perf_event_paranoid too high?)\n");
+        return 1;
+      }
+
+      scene_init(s);
+      TPE_worldStatsInit(&stats,0);
+      scene_world.stats = &stats;
+
+      if (s == 0 && c == 0)
+        printf("# reading a counter costs about %.0f cycles (%s)\n",
+          counterReadCost(),counterPage ? "rdpmc" : "read()");
+
+      for (int i = 0; i < steps; ++i)
+        scene_step(s);
+
+      closeCounter();
+
+      for (int i = 0; i < TPE_STATS_PHASES; ++i)
+        values[phaseOf(i)][c] += ((double) stats.phaseTimes[i]) / steps;
+    }
+
+    for (int i = 0; i < scene_world.bodyCount; ++i)
+      joints += scene_world.bodies[i].jointCount;
+
+    for (int i = 0; i < PHASES; ++i)
+      printf("%s\t%s\t%.0f\t%.0f\t%.2f\t%.3f\t%.3f\n",scenes[s].name,
+        phaseNames[i],values[i][0],values[i][1],
+        values[i][0] > 0 ? values[i][1] / values[i][0] : 0,
+        values[i][2] / joints,values[i][3] / joints);
+  }
+
+  return 0;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+  const char *compareFile = 0;
+  int steps = DEFAULT_STEPS, repeats = DEFAULT_REPEATS, slower = 0;
+
+#if BENCH_COUNTERS
+  if (argc > 1 && strcmp(argv[1],"--counters") == 0)
+    return counters(argc > 2 ? atoi(argv[2]) : DEFAULT_STEPS);
+#endif
+
+  if (argc > 2 && strcmp(argv[1],"--compare") == 0)
+  {
+    compareFile = argv[2];
+    argc -= 2;
+    argv += 2;
+  }
+
+  if (argc > 1)
+    steps = atoi(argv[1]);
+
+  if (argc > 2)
+    repeats = atoi(argv[2]);
+
+  if (steps < 1 || steps > MAX_STEPS || repeats < 1)
+  {
+    printf("ERROR: bad arguments\n");
+    return 1;
+  }
+
+  if (compareFile && !loadBaseline(compareFile))
+  {
+    printf("ERROR: couldn't open %s\n",compareFile);
+    return 1;
+  }
+
+  for (int i = 0; i < baselineCount; ++i)
+    if (baseline[i].steps != steps)
+    {
+      printf("ERROR: baseline measured with %d steps, not %d\n",
+        baseline[i].steps,steps);
+      return 1;
+    }
+
+  samples = (uint64_t *) malloc(((size_t) steps) * repeats * sizeof(uint64_t));
+
+  if (!samples)
+  {
+    printf("ERROR: couldn't allocate memory\n");
+    return 1;
+  }
+
+  printf("# scene\tsteps\tns/step\tsteps/s\tp50\tp90\tp99\tmax\thash");
+
+  if (compareFile)
+    printf("\tbaseline\tchange");
+
+  putchar('\n');
+
+  for (int s = 0; s < SCENE_COUNT; ++s)
+  {
+    uint32_t hash = 0;
+
+    for (int r = 0; r < repeats; ++r)
+    {
+      scene_init(s);
+
+      for (int i = 0; i < steps; ++i)
+      {
+        scene_step(s);
+
+        samples[r * steps + i] = stepTime;
+
+        if (r == 0 || stepTime < times[i])
+          times[i] = stepTime;
+      }
+
+      if (r != 0 && TPE_worldHash(&scene_world) != hash)
+      {
+        printf("ERROR: scene %s isn't deterministic\n",scenes[s].name);
+        return 1;
+      }
+
+      hash = TPE_worldHash(&scene_world);
+    }
+
+    uint64_t total = 0;
+    size_t sampleCount = ((size_t) steps) * repeats;
+
+    for (int i = 0; i < steps; ++i)
+      total += times[i];
+
+    qsort(samples,sampleCount,sizeof(uint64_t),compareTimes);
+
+    double nsPerStep = ((double) total) / steps;
+
+    printf("%s\t%d\t%.1f\t%.0f\t%lu\t%lu\t%lu\t%lu\t%08x",scenes[s].name,steps,
+      nsPerStep,nsPerStep > 0 ? 1000000000.0 / nsPerStep : 0,
+      (unsigned long) samples[sampleCount / 2],
+      (unsigned long) samples[(sampleCount * 9) / 10],
+      (unsigned long) samples[(sampleCount * 99) / 100],
+      (unsigned long) samples[sampleCount - 1],hash);
+
+    if (compareFile)
+    {
+      int found = 0;
+
+      for (int i = 0; i < baselineCount; ++i)
+        if (strcmp(baseline[i].name,scenes[s].name) == 0)
+        {
+          double change =
+            100.0 * (nsPerStep - baseline[i].nsPerStep) / baseline[i].nsPerStep;
+
+          printf("\t%.1f\t%+.1f%%",baseline[i].nsPerStep,change);
+
+          if (change > THRESHOLD)
+          {
+            printf("\tSLOWER");
+            slower = 1;
+          }
+
+          found = 1;
+          break;
+        }
+
+      if (!found)
+        printf("\t-\t-");
+    }
+
+    putchar('\n');
+  }
+
+  free(samples);
+
+  return slower;
+}
@@ -0,0 +1,116 @@
+/** Headless benchmark of the snapshot delta encoder/decoder: runs the demo
+  scenes, delta encodes every frame with a keyframe interval, checks the
+  decoded state and reports the compression ratio and encoding/decoding
+  throughput. Try also compiling with e.g. -DTPE_DELTA_QUANTIZATION=2 to see
+  lossy compression. */
+
+#define _POSIX_C_SOURCE 199309L // for clock_gettime
+
+#include "scenes.h"
+#include <stdio.h>
+#include <time.h>
+
+#define FRAMES 1000
+#define KEYFRAME_INTERVAL 30
+
+#define SNAPSHOT_SIZE TPE_SNAPSHOT_SIZE(SCENE_MAX_JOINTS,SCENE_MAX_BODIES)
+
+TPE_Joint snapshot[SNAPSHOT_SIZE / sizeof(TPE_Joint) + 1],
+          decoded[SNAPSHOT_SIZE / sizeof(TPE_Joint) + 1],
+          encoderPrevious[SNAPSHOT_SIZE / sizeof(TPE_Joint) + 1],
+          decoderPrevious[SNAPSHOT_SIZE / sizeof(TPE_Joint) + 1];
+
+uint8_t data[TPE_DELTA_MAX_SIZE(SCENE_MAX_JOINTS,SCENE_MAX_BODIES)];
+
+double getTime(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+/** Checks if decoded snapshot matches the original one (with respect to
+  quantization, positions are rounded to the nearest quantization step). */
+int snapshotsMatch(uint32_t jointCount, uint32_t bodyCount)
+{
+  for (uint32_t i = 0; i < jointCount; ++i)
+  {
+#define check(c) \
+  if (TPE_abs(snapshot[i].position.c - decoded[i].position.c) > \
+    (1 << TPE_DELTA_QUANTIZATION) / 2) return 0;
+
+    check(x) check(y) check(z)
+
+#undef check
+
+    for (int j = 0; j < 3; ++j)
+      if (snapshot[i].velocity[j] != decoded[i].velocity[j])
+        return 0;
+  }
+
+  uint8_t *b1 = (uint8_t *) (snapshot + jointCount),
+          *b2 = (uint8_t *) (decoded + jointCount);
+
+  for (uint32_t i = 0; i < bodyCount * 2; ++i)
+    if (b1[i] != b2[i])
+      return 0;
+
+  return 1;
+}
+
+int main(void)
+{
+  TPE_DeltaStream encoder, decoder;
+
+  printf("keyframe interval: %d, quantization: %d bits\n\n",KEYFRAME_INTERVAL,
+    TPE_DELTA_QUANTIZATION);
+
+  printf("%-8s %10s %10s %8s %12s %12s\n","scene","raw B/f","delta B/f",
+    "ratio","enc MB/s","dec MB/s");
+
+  for (int s = 0; s < SCENE_COUNT; ++s)
+  {
+    scene_init(s);
+
+    TPE_deltaStreamInit(&encoder,encoderPrevious,KEYFRAME_INTERVAL);
+    TPE_deltaStreamInit(&decoder,decoderPrevious,KEYFRAME_INTERVAL);
+
+    uint32_t jointCount = scene_jointsUsed;
+    uint32_t rawSize = TPE_worldSnapshotSize(&scene_world);
+    unsigned long rawTotal = 0, encodedTotal = 0;
+    double encodeTime = 0, decodeTime = 0;
+
+    for (int f = 0; f < FRAMES; ++f)
+    {
+      scene_step(s);
+
+      TPE_worldSnapshot(&scene_world,snapshot);
+
+      double t = getTime();
+      uint32_t size =
+        TPE_deltaStreamEncode(&encoder,&scene_world,snapshot,data);
+      encodeTime += getTime() - t;
+
+      t = getTime();
+      uint32_t size2 =
+        TPE_deltaStreamDecode(&decoder,&scene_world,data,size,decoded);
+      decodeTime += getTime() - t;
+
+      if (size != size2 || !snapshotsMatch(jointCount,scene_world.bodyCount))
+      {
+        printf("ERROR: decoded state differs (scene %s, frame %d)\n",
+          scenes[s].name,f);
+        return 1;
+      }
+
+      rawTotal += rawSize;
+      encodedTotal += size;
+    }
+
+    printf("%-8s %10u %10.1f %8.2f %12.1f %12.1f\n",scenes[s].name,rawSize,
+      ((double) encodedTotal) / FRAMES,((double) rawTotal) / encodedTotal,
+      rawTotal / encodeTime / 1000000.0,rawTotal / decodeTime / 1000000.0);
+  }
+
+  return 0;
+}
@@ -0,0 +1,158 @@
+/** Tool demonstrating desync localization with world hash trees: simulates a
+  scene on two "peers", one of which gets a tiny perturbation (one velocity
+  unit of one joint) at some frame, then finds the diverging body by
+  exchanging the hash trees level by level like peers would over network,
+  then the diverging joints by comparing joint hashes and finally prints the
+  fields that differ.
+
+  usage: desync [scene [perturbFrame [frames [body]]]] */
+
+#include "scenes.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SNAPSHOT_SIZE TPE_SNAPSHOT_SIZE(SCENE_MAX_JOINTS,SCENE_MAX_BODIES)
+
+TPE_Joint snapshot[SNAPSHOT_SIZE / sizeof(TPE_Joint) + 1];
+
+uint32_t treeA[TPE_HASH_TREE_SIZE(SCENE_MAX_BODIES)],
+         treeB[TPE_HASH_TREE_SIZE(SCENE_MAX_BODIES)];
+
+TPE_Body bodiesA[SCENE_MAX_BODIES];
+TPE_Joint jointsA[SCENE_MAX_JOINTS];
+
+void simulate(int scene, unsigned int from, unsigned int to)
+{
+  scene_frame = from;
+
+  while (scene_frame < to)
+    scene_step(scene);
+}
+
+int main(int argc, char **argv)
+{
+  int scene = scene_find(argc > 1 ? argv[1] : "stack");
+  unsigned int perturbFrame = argc > 2 ? atoi(argv[2]) : 20;
+  unsigned int frames = argc > 3 ? atoi(argv[3]) : 22;
+  int perturbBody = argc > 4 ? atoi(argv[4]) : -1;
+
+  if (scene < 0)
+  {
+    printf("ERROR: unknown scene\n");
+    return 1;
+  }
+
+  scene_init(scene);
+
+  if (perturbBody < 0 || perturbBody >= scene_world.bodyCount)
+    perturbBody = scene_world.bodyCount / 2;
+
+  if (perturbFrame > frames)
+    perturbFrame = frames;
+
+  simulate(scene,0,perturbFrame);
+  TPE_worldSnapshot(&scene_world,snapshot);
+
+  // peer A:
+
+  simulate(scene,perturbFrame,frames);
+  uint32_t leafCount = TPE_worldHashTree(&scene_world,treeA);
+
+  for (uint16_t i = 0; i < scene_world.bodyCount; ++i)
+    bodiesA[i] = scene_world.bodies[i];
+
+  for (unsigned int i = 0; i < scene_jointsUsed; ++i)
+    jointsA[i] = scene_joints[i];
+
+  // peer B:
+
+  TPE_worldRestore(&scene_world,snapshot);
+  scene_world.bodies[perturbBody].joints[0].velocity[0]++;
+  TPE_bodyActivate(scene_world.bodies + perturbBody);
+  simulate(scene,perturbFrame,frames);
+  TPE_worldHashTree(&scene_world,treeB);
+
+  printf("scene %s, %d bodies, perturbed body %d at frame %u, compared at "
+    "frame %u\n",scenes[scene].name,scene_world.bodyCount,perturbBody,
+    perturbFrame,frames);
+
+  printf("root hashes: %08x %08x\n",treeA[1],treeB[1]);
+
+  if (treeA[1] == treeB[1])
+  {
+    printf("no desync\n");
+    return 0;
+  }
+
+  // descend the tree, B sends A the children of the node A asks for
+
+  uint32_t node = 1;
+  int roundTrips = 0;
+
+  while (node < leafCount)
+  {
+    node = TPE_hashTreeDescend(treeA,node,treeB[2 * node],treeB[2 * node + 1]);
+    roundTrips++;
+
+    printf("round trip %d: differing node %u\n",roundTrips,node);
+
+    if (node == 0)
+    {
+      printf("ERROR: inconsistent tree\n");
+      return 1;
+    }
+  }
+
+  uint16_t bodyIndex = node - leafCount;
+
+  printf("first differing body: %d (found in %d round trips, whole tree would "
+    "be %d hashes)\n",bodyIndex,roundTrips,(int) (2 * leafCount - 1));
+
+  if (bodyIndex != TPE_hashTreeFirstDifference(treeA,treeB,leafCount))
+  {
+    printf("ERROR: TPE_hashTreeFirstDifference disagrees\n");
+    return 1;
+  }
+
+  const TPE_Body *a = bodiesA + bodyIndex,
+    *b = scene_world.bodies + bodyIndex;
+
+  if (a->flags != b->flags)
+    printf("  flags: %d %d\n",a->flags,b->flags);
+
+  if (a->deactivateCount != b->deactivateCount)
+    printf("  deactivateCount: %d %d\n",a->deactivateCount,b->deactivateCount);
+
+  for (uint8_t i = 0; i < b->jointCount; ++i)
+  {
+    const TPE_Joint *ja = jointsA + (b->joints - scene_joints) + i,
+      *jb = b->joints + i;
+
+    if (TPE_jointHash(ja) == TPE_jointHash(jb))
+      continue;
+
+    printf("  joint %d:\n",i);
+
+    const TPE_Unit *pa = &ja->position.x, *pb = &jb->position.x;
+
+    for (int j = 0; j < 3; ++j)
+      if (pa[j] != pb[j])
+        printf("    position.%c: %d %d\n",'x' + j,pa[j],pb[j]);
+
+    for (int j = 0; j < 3; ++j)
+      if (ja->velocity[j] != jb->velocity[j])
+        printf("    velocity[%d]: %d %d\n",j,ja->velocity[j],jb->velocity[j]);
+
+    if (ja->sizeDivided != jb->sizeDivided)
+      printf("    sizeDivided: %d %d\n",ja->sizeDivided,jb->sizeDivided);
+  }
+
+  int differing = 0;
+
+  for (uint16_t i = 0; i < scene_world.bodyCount; ++i)
+    differing += treeA[leafCount + i] != treeB[leafCount + i];
+
+  printf("bodies differing in total: %d\n",differing);
+
+  return 0;
+}
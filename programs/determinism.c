@@ -0,0 +1,82 @@
+/** Headless determinism test: runs every scene for a number of steps and
+  prints the world hash after each step, or compares the hashes against a
+  golden file produced earlier. Run by determinism.sh with different compilers,
+  optimization levels and word sizes, all of which must produce the same
+  hashes.
+
+  usage:
+    determinism > file    prints the hashes (to create the golden file)
+    determinism file      checks against the golden file */
+
+#include "scenes.h"
+#include <stdio.h>
+
+#define STEPS 300
+
+int main(int argc, char **argv)
+{
+  FILE *golden = 0;
+  int errors = 0;
+
+  if (argc > 1)
+  {
+    golden = fopen(argv[1],"r");
+
+    if (!golden)
+    {
+      printf("ERROR: couldn't open %s\n",argv[1]);
+      return 1;
+    }
+  }
+
+  for (int s = 0; s < SCENE_COUNT; ++s)
+  {
+    scene_init(s);
+
+    int mismatch = -1;
+
+    for (int i = 0; i < STEPS; ++i)
+    {
+      scene_step(s);
+
+      unsigned long hash = TPE_worldHash(&scene_world);
+
+      if (!golden)
+      {
+        printf("%s %d %08lx\n",scenes[s].name,i,hash);
+        continue;
+      }
+
+      char name[64];
+      int step;
+      unsigned long expected;
+
+      if (fscanf(golden,"%63s %d %lx",name,&step,&expected) != 3 ||
+        strcmp(name,scenes[s].name) != 0 || step != i)
+      {
+        printf("ERROR: golden file doesn't match the scenes\n");
+        fclose(golden);
+        return 1;
+      }
+
+      if (hash != expected && mismatch < 0)
+        mismatch = i;
+    }
+
+    if (golden)
+    {
+      if (mismatch < 0)
+        printf("%-8s OK\n",scenes[s].name);
+      else
+      {
+        printf("%-8s MISMATCH at step %d\n",scenes[s].name,mismatch);
+        errors++;
+      }
+    }
+  }
+
+  if (golden)
+    fclose(golden);
+
+  return errors != 0;
+}
@@ -0,0 +1,75 @@
+#!/bin/bash
+# Determinism test matrix: builds determinism.c with every available compiler,
+# optimization level and word size and checks all produce the golden per step
+# world hashes. Configurations whose compiler or target (word size) is
+# unavailable are reported as skipped. Exits with non-zero status if any
+# configuration fails to build or mismatches.
+#
+# usage: ./determinism.sh           check against determinism.golden
+#        ./determinism.sh --update  regenerate the golden file (gcc -O0)
+
+cd "$(dirname "$0")"
+
+GOLDEN=determinism.golden
+BIN=/tmp/tpe_determinism
+PROBE=/tmp/tpe_determinism_probe
+FLAGS="-std=c99 -Wno-unused-parameter"
+
+if [ "$1" = "--update" ]; then
+  gcc $FLAGS -O0 -o $BIN determinism.c -lm && $BIN > $GOLDEN && \
+    echo "golden file updated"
+  exit $?
+fi
+
+FAILED=0
+
+for CC in gcc clang "g++ -x c++" "clang++ -x c++"; do
+  for OPT in -O0 -O3 "-O3 -ffast-math -march=native"; do
+    for BITS in -m64 -m32; do
+      NAME="$CC $OPT $BITS"
+      COMPILER=${CC%% *}
+      EXTRA=${CC#$COMPILER}
+
+      if ! command -v $COMPILER > /dev/null; then
+        printf "%-45s SKIPPED (no compiler)\n" "$NAME"
+        continue
+      fi
+
+      STD=$FLAGS
+
+      if [ -n "$EXTRA" ]; then
+        STD="-Wno-unused-parameter -Wno-missing-field-initializers"
+      fi
+
+      # probe for the target (e.g. no 32 bit libraries installed):
+
+      if ! echo "int main(void) { return 0; }" | $COMPILER $EXTRA $BITS \
+        -o $PROBE -x c - -lm 2> /dev/null; then
+        printf "%-45s SKIPPED (no target)\n" "$NAME"
+        continue
+      fi
+
+      if ! ERRORS=$($COMPILER $EXTRA $STD $OPT $BITS -o $BIN determinism.c \
+        -lm 2>&1); then
+        printf "%-45s FAILED (can't build)\n" "$NAME"
+        echo "$ERRORS" | sed 's/^/  /'
+        FAILED=1
+        continue
+      fi
+
+      if OUTPUT=$($BIN $GOLDEN); then
+        printf "%-45s OK\n" "$NAME"
+      else
+        printf "%-45s FAILED\n" "$NAME"
+        echo "$OUTPUT" | grep -v " OK$" | sed 's/^/  /'
+        FAILED=1
+      fi
+    done
+  done
+done
+
+# The D version (../tinyphysicsengine.d) is an unfinished automatic
+# translation that still contains C preprocessor directives, so it can't be
+# compiled and isn't part of the matrix yet.
+
+exit $FAILED
@@ -0,0 +1,343 @@
+/** Differential testing of engine configurations: the same program is built
+  twice, as a reference (e.g. the default settings) and an optimized
+  configuration (other compile options or a modified engine), and the two are
+  run side by side on generated scenes (see stress.h) with their results
+  compared after every step, either exactly (world hashes) or with a
+  tolerance on joint positions for inexact modes. A failing scene is then
+  minimized (fewer steps and bodies) and printed so that it can be
+  reproduced. See difftest.sh for building the pair.
+
+  usage:
+    difftest check ref opt [scenes [bodies [steps [tolerance]]]]
+      runs binaries ref and opt (builds of this program) on generated scenes,
+      tolerance 0 compares hashes (defaults: 20 scenes, 30 bodies, 200 steps)
+
+    difftest sim bodies arrangement environment seed steps keep positions
+      (used by check) simulates a generated scene and prints one line per
+      step: world hash and if positions is 1 all joint positions; keep is a
+      hex mask of the generated bodies to keep or - for all */
+
+#define _POSIX_C_SOURCE 200809L // for popen, getline
+
+#include "stress.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef struct
+{
+  unsigned int bodies, arrangement, environment, seed, steps;
+  uint8_t *keep; // 1 for each generated body that's kept
+} TestScene;
+
+int sim(TestScene *t, int positions)
+{
+  StressScene scene;
+
+  if (!stress_generate(&scene,t->bodies,t->arrangement,t->environment,
+    t->seed))
+    return 1;
+
+  // remove the bodies that aren't kept:
+
+  uint16_t count = 0;
+
+  for (uint16_t i = 0; i < scene.world.bodyCount; ++i)
+    if (t->keep[i])
+    {
+      scene.world.bodies[count] = scene.world.bodies[i];
+      count++;
+    }
+
+  scene.world.bodyCount = count;
+
+  for (unsigned int s = 0; s < t->steps; ++s)
+  {
+    stress_step(&scene);
+
+    printf("%08x",TPE_worldHash(&scene.world));
+
+    if (positions)
+      for (uint16_t i = 0; i < scene.world.bodyCount; ++i)
+        for (uint8_t j = 0; j < scene.world.bodies[i].jointCount; ++j)
+        {
+          TPE_Vec3 p = scene.world.bodies[i].joints[j].position;
+          printf(" %d %d %d",p.x,p.y,p.z);
+        }
+
+    putchar('\n');
+  }
+
+  stress_free(&scene);
+
+  return 0;
+}
+
+char *keepToHex(const TestScene *t, char *s)
+{
+  for (unsigned int i = 0; i < (t->bodies + 3) / 4; ++i)
+  {
+    int v = 0;
+
+    for (unsigned int j = 0; j < 4 && i * 4 + j < t->bodies; ++j)
+      v |= t->keep[i * 4 + j] << j;
+
+    s[i] = "0123456789abcdef"[v];
+  }
+
+  s[(t->bodies + 3) / 4] = 0;
+
+  return s;
+}
+
+void hexToKeep(TestScene *t, const char *s)
+{
+  for (unsigned int i = 0; i < t->bodies; ++i)
+  {
+    char c = s[0] == '-' ? 'f' : s[i / 4];
+    int v = c >= 'a' ? c - 'a' + 10 : c - '0';
+
+    t->keep[i] = (v >> (i % 4)) & 1;
+  }
+}
+
+FILE *startSim(const char *binary, const TestScene *t, int positions)
+{
+  char *command = malloc(strlen(binary) + t->bodies / 4 + 128);
+
+  if (!command)
+    return 0;
+
+  char *hex = command + strlen(binary) + 96;
+
+  keepToHex(t,hex);
+
+  char *c = command + sprintf(command,"%s sim %u %u %u %u %u ",binary,
+    t->bodies,t->arrangement,t->environment,t->seed,t->steps);
+
+  memmove(c,hex,strlen(hex) + 1);
+  sprintf(c + strlen(c)," %d",positions);
+
+  FILE *f = popen(command,"r");
+
+  free(command);
+
+  return f;
+}
+
+/** Compares the runs of both binaries, returns the first step at which they
+  differ, -1 if they don't or -2 on error. */
+int compare(const char *ref, const char *opt, const TestScene *t,
+  int tolerance)
+{
+  FILE *f1 = startSim(ref,t,tolerance != 0),
+    *f2 = startSim(opt,t,tolerance != 0);
+
+  char *line1 = 0, *line2 = 0;
+  size_t size1 = 0, size2 = 0;
+  int result = -1;
+
+  if (!f1 || !f2)
+    result = -2;
+
+  for (unsigned int s = 0; result == -1 && s < t->steps; ++s)
+  {
+    if (getline(&line1,&size1,f1) < 0 || getline(&line2,&size2,f2) < 0)
+    {
+      result = -2;
+      break;
+    }
+
+    if (tolerance == 0)
+    {
+      if (strncmp(line1,line2,8) != 0)
+        result = s;
+
+      continue;
+    }
+
+    char *p1 = line1 + 8, *p2 = line2 + 8;
+
+    while (1)
+    {
+      char *e1, *e2;
+      long v1 = strtol(p1,&e1,10), v2 = strtol(p2,&e2,10);
+
+      if ((e1 == p1) != (e2 == p2))
+      {
+        result = s; // different numbers of joints
+        break;
+      }
+
+      if (e1 == p1)
+        break;
+
+      if (v1 - v2 > tolerance || v2 - v1 > tolerance)
+      {
+        result = s;
+        break;
+      }
+
+      p1 = e1;
+      p2 = e2;
+    }
+  }
+
+  free(line1);
+  free(line2);
+
+  if (f1)
+    pclose(f1);
+
+  if (f2)
+    pclose(f2);
+
+  return result;
+}
+
+/** Makes a failing scene smaller while it still fails: cuts the steps after
+  the first difference and removes chunks of bodies (halves, quarters, ...
+  down to single bodies). */
+void minimize(const char *ref, const char *opt, TestScene *t, int tolerance,
+  int failStep)
+{
+  t->steps = failStep + 1;
+
+  for (unsigned int chunk = t->bodies / 2; chunk >= 1; chunk /= 2)
+  {
+    for (unsigned int start = 0; start < t->bodies; start += chunk)
+    {
+      uint8_t backup[chunk];
+      int removed = 0;
+
+      for (unsigned int i = 0; i < chunk && start + i < t->bodies; ++i)
+      {
+        backup[i] = t->keep[start + i];
+        removed |= backup[i];
+        t->keep[start + i] = 0;
+      }
+
+      int r = removed ? compare(ref,opt,t,tolerance) : -1;
+
+      if (r >= 0)
+        t->steps = r + 1; // still fails, keep it removed
+      else
+        for (unsigned int i = 0; i < chunk && start + i < t->bodies; ++i)
+          t->keep[start + i] = backup[i];
+    }
+  }
+}
+
+int check(const char *ref, const char *opt, int sceneCount, int bodies,
+  int steps, int tolerance)
+{
+  int failures = 0;
+  TestScene t;
+
+  t.keep = malloc(bodies);
+
+  if (!t.keep)
+    return 1;
+
+  for (int i = 0; i < sceneCount; ++i)
+  {
+    t.bodies = bodies;
+    t.arrangement = i % STRESS_ARRANGEMENTS;
+    t.environment = (i / STRESS_ARRANGEMENTS) % STRESS_ENVIRONMENTS;
+    t.seed = i + 1;
+    t.steps = steps;
+
+    for (int j = 0; j < bodies; ++j)
+      t.keep[j] = 1;
+
+    printf("scene %d (%s, %s, seed %u): ",i,
+      stress_arrangementNames[t.arrangement],
+      stress_environmentNames[t.environment],t.seed);
+
+    fflush(stdout);
+
+    int r = compare(ref,opt,&t,tolerance);
+
+    if (r == -2)
+    {
+      printf("ERROR: couldn't run the binaries\n");
+      free(t.keep);
+      return 1;
+    }
+
+    if (r < 0)
+    {
+      printf("OK\n");
+      continue;
+    }
+
+    failures++;
+
+    printf("differs at step %d, minimizing...\n",r);
+    minimize(ref,opt,&t,tolerance,r);
+
+    int kept = 0;
+
+    for (int j = 0; j < bodies; ++j)
+      kept += t.keep[j];
+
+    char *hex = malloc(bodies / 4 + 2);
+
+    if (hex)
+    {
+      keepToHex(&t,hex);
+
+      printf("  minimal: %d bodies, differs at step %u, compare outputs of:\n",
+        kept,t.steps - 1);
+
+      for (int j = 0; j < 2; ++j)
+        printf("  %s sim %u %u %u %u %u %s %d\n",j ? opt : ref,t.bodies,
+          t.arrangement,t.environment,t.seed,t.steps,hex,tolerance != 0);
+
+      free(hex);
+    }
+  }
+
+  free(t.keep);
+
+  printf("%d of %d scenes differ\n",failures,sceneCount);
+
+  return failures != 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc == 9 && strcmp(argv[1],"sim") == 0)
+  {
+    TestScene t;
+
+    t.bodies = atoi(argv[2]);
+    t.arrangement = atoi(argv[3]);
+    t.environment = atoi(argv[4]);
+    t.seed = atoi(argv[5]);
+    t.steps = atoi(argv[6]);
+    t.keep = malloc(t.bodies + 1);
+
+    if (!t.keep || t.bodies > 65535 || t.arrangement >= STRESS_ARRANGEMENTS ||
+      t.environment >= STRESS_ENVIRONMENTS)
+      return 1;
+
+    hexToKeep(&t,argv[7]);
+
+    int r = sim(&t,atoi(argv[8]));
+
+    free(t.keep);
+
+    return r;
+  }
+
+  if (argc >= 4 && strcmp(argv[1],"check") == 0)
+    return check(argv[2],argv[3],argc > 4 ? atoi(argv[4]) : 20,
+      argc > 5 ? atoi(argv[5]) : 30,argc > 6 ? atoi(argv[6]) : 200,
+      argc > 7 ? atoi(argv[7]) : 0);
+
+  printf("usage:\n  difftest check ref opt [scenes [bodies [steps "
+    "[tolerance]]]]\n  difftest sim bodies arrangement environment seed "
+    "steps keep positions\n");
+
+  return 1;
+}
@@ -0,0 +1,20 @@
+#!/bin/bash
+# Builds difftest.c as the reference (default settings) and as an optimized
+# configuration given by compiler flags, then runs the differential test of
+# the two (see difftest.c). Exits with non-zero status if any scene differs.
+#
+# usage: ./difftest.sh "optimized flags" [scenes [bodies [steps [tolerance]]]]
+# e.g.:  ./difftest.sh "-DTPE_APPROXIMATE_LENGTH=1" 20 30 200 50
+
+cd "$(dirname "$0")"
+
+REF=/tmp/tpe_difftest_ref
+OPT=/tmp/tpe_difftest_opt
+FLAGS="-std=c99 -O3 -Wno-unused-parameter"
+
+gcc $FLAGS -o $REF difftest.c -lm && gcc $FLAGS $1 -o $OPT difftest.c -lm ||
+  exit 1
+
+shift
+
+$REF check $REF $OPT "$@"
@@ -565,6 +565,11 @@ void tpe_debugDrawPixel(uint16_t x, uint16_t y, uint8_t color)
   }
 }
 
+/* Environment samples of the debug view are cached, demos with a changing
+   environment have to invalidate the cache (TPE_debugDrawCacheInvalidate). */
+TPE_Vec3 helper_debugDrawSamples[16 * 16 * 16];
+TPE_DebugDrawCache helper_debugDrawCache;
+
 void helper_debugDraw(int drawEnv)
 {
   TPE_Vec3 camPos = 
@@ -579,9 +584,15 @@ void helper_debugDraw(int drawEnv)
       s3l_scene.camera.transform.rotation.y,
       s3l_scene.camera.transform.rotation.z);
 
-  TPE_worldDebugDraw(&tpe_world,tpe_debugDrawPixel,camPos,camRot,
-    TPE_vec3(S3L_RESOLUTION_X * DEBUG_DRAW_DIVIDE,S3L_RESOLUTION_Y * DEBUG_DRAW_DIVIDE,s3l_scene.camera.focalLength),
-    drawEnv ? 16 : 0,drawEnv ? 256 : 0);
+  TPE_Vec3 camView = TPE_vec3(S3L_RESOLUTION_X * DEBUG_DRAW_DIVIDE,
+    S3L_RESOLUTION_Y * DEBUG_DRAW_DIVIDE,s3l_scene.camera.focalLength);
+
+  if (drawEnv)
+    TPE_worldDebugDrawCached(&tpe_world,tpe_debugDrawPixel,camPos,camRot,
+      camView,&helper_debugDrawCache);
+  else
+    TPE_worldDebugDraw(&tpe_world,tpe_debugDrawPixel,camPos,camRot,camView,
+      0,0);
 }
 
 uint8_t s3l_r = 0, s3l_g = 255, s3l_b = 0;
@@ -764,6 +775,8 @@ void helper_init(void)
 {
   helper_lightDir = TPE_vec3Normalized(TPE_vec3(300,200,100));
 
+  TPE_debugDrawCacheInit(&helper_debugDrawCache,helper_debugDrawSamples,16,256);
+
   sdl_window = SDL_CreateWindow("program",SDL_WINDOWPOS_UNDEFINED,SDL_WINDOWPOS_UNDEFINED,S3L_RESOLUTION_X,S3L_RESOLUTION_Y,SDL_WINDOW_SHOWN); 
   sdl_renderer = SDL_CreateRenderer(sdl_window,-1,0);
   sdl_texture = SDL_CreateTexture(sdl_renderer,SDL_PIXELFORMAT_RGBX8888,SDL_TEXTUREACCESS_STATIC,S3L_RESOLUTION_X,S3L_RESOLUTION_Y);
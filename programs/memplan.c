@@ -0,0 +1,279 @@
+/** Memory planner: computes how many bytes a world made of given bodies needs
+  (the body, joint and connection arrays, the world struct and optional
+  buffers such as snapshots for rollback, a hash tree, delta encoding buffer,
+  static body index and statistics) for the current build (word size, compile options), prints
+  a sizeof/padding breakdown of the engine's structs and checks the total
+  against a budget. For checking a budget at compile time use
+  TPE_WORLD_MEMORY_SIZE with TPE_BUDGET_CHECK.
+
+  usage: memplan [options] body:count ...
+    body is a template: box, centerBox, rect, centerRect, centerRectFull,
+    triangle, 2line, ball, or custom joints/connections (e.g. 12/20)
+    options:
+      --budget bytes    exits with 1 if the total exceeds it (e.g. 32768)
+      --snapshots n     n snapshot buffers (TPE_worldSnapshot)
+      --delta           a delta encoding buffer (TPE_snapshotEncodeDelta)
+      --hash-tree       a hash tree (TPE_worldHashTree)
+      --statics n       static index for n bodies (TPE_worldSetStaticBuffer)
+      --stats           statistics (TPE_WorldStats, only with TPE_STATS)
+
+  e.g.: memplan --budget 32768 --snapshots 8 box:10 ball:20 */
+
+#include "../tinyphysicsengine.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+  const char *name;
+  unsigned int joints;
+  unsigned int connections;
+} Template;
+
+const Template templates[] =
+{
+  {"box",            8,  16}, // see TPE_makeBox etc.
+  {"centerBox",      9,  18},
+  {"rect",           4,  6},
+  {"centerRect",     5,  8},
+  {"centerRectFull", 5,  10},
+  {"triangle",       3,  3},
+  {"2line",          2,  1},
+  {"ball",           1,  0}
+};
+
+#define TEMPLATE_COUNT ((int) (sizeof(templates) / sizeof(Template)))
+
+typedef struct
+{
+  const char *name;
+  size_t offset;
+  size_t size;
+} Field;
+
+#define FIELD(type,field) \
+  {#field, offsetof(type,field), sizeof(((type *) 0)->field)}
+
+void printStruct(const char *name, size_t size, const Field *fields,
+  int fieldCount)
+{
+  size_t used = 0;
+
+  printf("%s: %u B\n",name,(unsigned int) size);
+
+  for (int i = 0; i < fieldCount; ++i)
+  {
+    size_t end = i < fieldCount - 1 ? fields[i + 1].offset : size;
+
+    printf("  %-20s offset %3u, size %2u",fields[i].name,
+      (unsigned int) fields[i].offset,(unsigned int) fields[i].size);
+
+    if (end > fields[i].offset + fields[i].size)
+      printf(", then %u B padding",
+        (unsigned int) (end - fields[i].offset - fields[i].size));
+
+    putchar('\n');
+    used += fields[i].size;
+  }
+
+  printf("  (%u B of data, %u B of padding)\n",(unsigned int) used,
+    (unsigned int) (size - used));
+}
+
+void printStructs(void)
+{
+  const Field joint[] =
+  {
+    FIELD(TPE_Joint,position),
+    FIELD(TPE_Joint,velocity),
+    FIELD(TPE_Joint,sizeDivided)
+  };
+
+  const Field connection[] =
+  {
+    FIELD(TPE_Connection,joint1),
+    FIELD(TPE_Connection,joint2),
+    FIELD(TPE_Connection,length)
+  };
+
+  const Field body[] =
+  {
+    FIELD(TPE_Body,joints),
+    FIELD(TPE_Body,jointCount),
+    FIELD(TPE_Body,connections),
+    FIELD(TPE_Body,connectionCount),
+    FIELD(TPE_Body,jointMass),
+    FIELD(TPE_Body,friction),
+    FIELD(TPE_Body,elasticity),
+    FIELD(TPE_Body,flags),
+    FIELD(TPE_Body,deactivateCount)
+  };
+
+  const Field world[] =
+  {
+    FIELD(TPE_World,bodies),
+    FIELD(TPE_World,bodyCount),
+    FIELD(TPE_World,environmentFunction),
+    FIELD(TPE_World,collisionCallback),
+    FIELD(TPE_World,forceFields),
+    FIELD(TPE_World,forceFieldCount),
+    FIELD(TPE_World,statics),
+    FIELD(TPE_World,staticCount),
+    FIELD(TPE_World,staticCapacity),
+    FIELD(TPE_World,staticMaxWidth),
+#if TPE_STATS
+    FIELD(TPE_World,stats)
+#endif
+  };
+
+#define PRINT(type,fields) \
+  printStruct(#type,sizeof(type),fields,sizeof(fields) / sizeof(Field));
+
+  PRINT(TPE_Joint,joint)
+  PRINT(TPE_Connection,connection)
+  PRINT(TPE_Body,body)
+  PRINT(TPE_World,world)
+
+#undef PRINT
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long budget = 0, snapshots = 0, statics = 0, bodies = 0,
+    joints = 0, connections = 0;
+  int delta = 0, hashTree = 0, stats = 0;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i],"--budget") == 0 && i < argc - 1)
+      budget = strtoul(argv[++i],0,10);
+    else if (strcmp(argv[i],"--snapshots") == 0 && i < argc - 1)
+      snapshots = strtoul(argv[++i],0,10);
+    else if (strcmp(argv[i],"--statics") == 0 && i < argc - 1)
+      statics = strtoul(argv[++i],0,10);
+    else if (strcmp(argv[i],"--delta") == 0)
+      delta = 1;
+    else if (strcmp(argv[i],"--hash-tree") == 0)
+      hashTree = 1;
+    else if (strcmp(argv[i],"--stats") == 0)
+      stats = 1;
+    else
+    {
+      char *colon = strchr(argv[i],':');
+      unsigned int j = 0, c = 0;
+      int found = 0;
+
+      if (colon)
+      {
+        *colon = 0;
+
+        for (int t = 0; t < TEMPLATE_COUNT; ++t)
+          if (strcmp(argv[i],templates[t].name) == 0)
+          {
+            j = templates[t].joints;
+            c = templates[t].connections;
+            found = 1;
+          }
+
+        if (!found)
+          found = sscanf(argv[i],"%u/%u",&j,&c) == 2;
+      }
+
+      if (!found || j > 255 || c > 255)
+      {
+        printf("ERROR: bad argument %s\n",argv[i]);
+        return 1;
+      }
+
+      unsigned long count = strtoul(colon + 1,0,10);
+
+      bodies += count;
+      joints += count * j;
+      connections += count * c;
+    }
+  }
+
+  if (bodies > 65535)
+  {
+    printf("ERROR: too many bodies\n");
+    return 1;
+  }
+
+  printf("build: %u bit pointers, TPE_Unit %u B, TPE_STATS %d\n\n",
+    (unsigned int) sizeof(void *) * 8,(unsigned int) sizeof(TPE_Unit),
+    TPE_STATS);
+
+  printStructs();
+
+  unsigned long total = TPE_WORLD_MEMORY_SIZE(bodies,joints,connections);
+
+  printf("\n%-32s %8s %10s\n","item","count","bytes");
+
+  printf("%-32s %8u %10u\n","world (TPE_World)",1,
+    (unsigned int) sizeof(TPE_World));
+
+  printf("%-32s %8lu %10lu\n","bodies (TPE_Body)",bodies,
+    bodies * sizeof(TPE_Body));
+
+  printf("%-32s %8lu %10lu\n","joints (TPE_Joint)",joints,
+    joints * sizeof(TPE_Joint));
+
+  printf("%-32s %8lu %10lu\n","connections (TPE_Connection)",connections,
+    connections * sizeof(TPE_Connection));
+
+  if (snapshots)
+  {
+    unsigned long s = snapshots * TPE_SNAPSHOT_SIZE(joints,bodies);
+    printf("%-32s %8lu %10lu\n","snapshots",snapshots,s);
+    total += s;
+  }
+
+  if (delta)
+  {
+    unsigned long s = TPE_DELTA_MAX_SIZE(joints,bodies);
+    printf("%-32s %8u %10lu\n","delta buffer",1,s);
+    total += s;
+  }
+
+  if (hashTree)
+  {
+    unsigned long s = TPE_HASH_TREE_SIZE(bodies) * sizeof(uint32_t);
+    printf("%-32s %8u %10lu\n","hash tree",1,s);
+    total += s;
+  }
+
+  if (statics)
+  {
+    unsigned long s = statics * sizeof(TPE_StaticEntry);
+    printf("%-32s %8lu %10lu\n","static index",statics,s);
+    total += s;
+  }
+
+  if (stats)
+  {
+#if TPE_STATS
+    unsigned long s = sizeof(TPE_WorldStats) + bodies * sizeof(uint64_t);
+    printf("%-32s %8u %10lu\n","stats (with body times)",1,s);
+    total += s;
+#else
+    printf("WARNING: statistics not compiled in (TPE_STATS is 0)\n");
+#endif
+  }
+
+  printf("%-32s %8s %10lu\n","total","",total);
+
+  if (budget != 0)
+  {
+    if (total > budget)
+    {
+      printf("\nbudget %lu B EXCEEDED by %lu B\n",budget,total - budget);
+      return 1;
+    }
+
+    printf("\nbudget %lu B OK, %lu B left\n",budget,budget - total);
+  }
+
+  return 0;
+}
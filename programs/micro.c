@@ -0,0 +1,300 @@
+/** Microbenchmark of the engine's primitives (math functions, environment
+  functions, collision resolution and a character tick), to see which of them
+  are worth optimizing. Inputs are generated from a fixed seed before
+  measuring, so the numbers only include the primitives themselves (plus loop
+  overhead, which is shown in the first row). For each primitive two numbers
+  are printed:
+
+  - throughput: ns per call with independent inputs, i.e. calls can overlap in
+    the CPU pipeline
+  - latency: ns per call when each input depends on the previous result, i.e.
+    the full duration of one call
+
+  usage: micro [rounds] */
+
+#define _POSIX_C_SOURCE 199309L // for clock_gettime
+
+#include "../tinyphysicsengine.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define INPUTS 4096 // power of two
+#define DEFAULT_ROUNDS 200
+#define SEED 123
+
+TPE_Unit units[INPUTS];
+TPE_Unit positiveUnits[INPUTS];
+TPE_Unit angles[INPUTS];
+TPE_Vec3 points[INPUTS];
+TPE_Vec3 directions[INPUTS];
+TPE_Joint jointPairs[INPUTS][2];
+TPE_Joint jointsNearGround[INPUTS];
+
+TPE_Joint joint1, joint2;
+
+/* a character controller and, for comparison, a dynamic non-rotating body
+   controlled the way player.c does it */
+
+TPE_World characterWorld, dynamicWorld;
+TPE_Body characterBody, dynamicBody;
+TPE_Joint characterJoints[2], dynamicJoints[2];
+TPE_Connection characterConnection, dynamicConnection;
+TPE_Character character;
+
+TPE_Unit prismSides[6] = { 0,0, -2400,1400, -2400,0 };
+
+uint32_t randomState = SEED;
+
+uint32_t randomNumber(void)
+{
+  randomState ^= randomState << 13; // xorshift32
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+TPE_Unit randomRange(TPE_Unit from, TPE_Unit to)
+{
+  return from + (TPE_Unit) (randomNumber() % ((uint32_t) (to - from)));
+}
+
+TPE_Vec3 randomVec3(TPE_Unit range)
+{
+  return TPE_vec3(randomRange(-1 * range,range),randomRange(-1 * range,range),
+    randomRange(-1 * range,range));
+}
+
+uint64_t nanoTime(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec * ((uint64_t) 1000000000) + t.tv_nsec;
+}
+
+TPE_Unit heightFunction(int32_t x, int32_t y)
+{
+  return ((x * 37 + y * 91) % 17) * (TPE_F / 8);
+}
+
+TPE_Vec3 groundEnvironment(TPE_Vec3 p, TPE_Unit maxD)
+{
+  return TPE_envGround(p,0);
+}
+
+static inline uint32_t sum3(TPE_Vec3 v)
+{
+  return (uint32_t) (v.x + v.y + v.z);
+}
+
+void prepareCharacters(void)
+{
+  TPE_make2Line(characterJoints,&characterConnection,400,300);
+  TPE_bodyInit(&characterBody,characterJoints,2,&characterConnection,1,TPE_F);
+  TPE_bodyRotateByAxis(&characterBody,TPE_vec3(0,0,TPE_F / 4));
+  TPE_bodyMoveBy(&characterBody,TPE_vec3(0,500,0));
+  TPE_worldInit(&characterWorld,&characterBody,1,groundEnvironment);
+  TPE_characterInit(&character,&characterBody);
+
+  TPE_make2Line(dynamicJoints,&dynamicConnection,400,300);
+  TPE_bodyInit(&dynamicBody,dynamicJoints,2,&dynamicConnection,1,TPE_F);
+  TPE_bodyRotateByAxis(&dynamicBody,TPE_vec3(0,0,TPE_F / 4));
+  TPE_bodyMoveBy(&dynamicBody,TPE_vec3(0,500,0));
+  dynamicBody.elasticity = 0;
+  dynamicBody.friction = 0;
+  dynamicBody.flags |= TPE_BODY_FLAG_NONROTATING | TPE_BODY_FLAG_ALWAYS_ACTIVE;
+  TPE_worldInit(&dynamicWorld,&dynamicBody,1,groundEnvironment);
+}
+
+// one tick of each: the controlling, the world step, the ground test
+
+uint32_t characterTick(TPE_Vec3 move)
+{
+  move = TPE_vec3(move.x / 16,0,move.z / 16);
+
+  uint32_t r = TPE_characterMove(&character,move,5,&characterWorld);
+
+  TPE_worldStep(&characterWorld);
+
+  return r + sum3(characterJoints[0].position);
+}
+
+uint32_t dynamicBodyTick(TPE_Vec3 move)
+{
+  TPE_Unit groundDist = TPE_JOINT_SIZE(dynamicJoints[0]) + 30;
+  TPE_Vec3 p = dynamicJoints[0].position;
+
+  TPE_Vec3 groundPoint = groundEnvironment(p,groundDist);
+
+  uint8_t onGround = TPE_DISTANCE(p,groundPoint) <= groundDist &&
+    groundPoint.y < p.y - groundDist / 2;
+
+  if (!onGround)
+    onGround = TPE_DISTANCE(p,TPE_castEnvironmentRay(p,
+      TPE_vec3(0,-1 * TPE_F,0),groundEnvironment,128,512,512)) <= groundDist;
+
+  TPE_bodyMultiplyNetSpeed(&dynamicBody,onGround ? 300 : 505);
+  TPE_bodyApplyGravity(&dynamicBody,5);
+
+  if (onGround)
+    TPE_bodyAccelerate(&dynamicBody,TPE_vec3(move.x / 16,0,move.z / 16));
+
+  TPE_worldStep(&dynamicWorld);
+
+  return onGround + sum3(dynamicJoints[0].position);
+}
+
+void prepareInputs(void)
+{
+  for (int i = 0; i < INPUTS; ++i)
+  {
+    units[i] = randomRange(-16 * TPE_F,16 * TPE_F);
+    positiveUnits[i] = randomRange(0,1 << 24);
+    angles[i] = randomRange(-4 * TPE_F,4 * TPE_F);
+    points[i] = randomVec3(8 * TPE_F);
+
+    do
+      directions[i] = randomVec3(TPE_F);
+    while (TPE_vec3Len(directions[i]) < TPE_F / 4);
+
+    /* joint pairs with random overlap (most of them collide), joints near
+       ground with random penetration */
+
+    TPE_Joint *j = jointPairs[i];
+
+    j[0] = TPE_joint(points[i],TPE_F);
+    j[1] = TPE_joint(TPE_vec3Plus(points[i],
+      TPE_vec3Times(TPE_vec3Normalized(directions[i]),randomRange(1,
+      5 * TPE_F / 2))),TPE_F);
+
+    jointsNearGround[i] = TPE_joint(TPE_vec3(points[i].x,
+      randomRange(-1 * TPE_F / 2,TPE_F + TPE_F / 2),points[i].z),TPE_F);
+
+    for (int k = 0; k < 3; ++k)
+    {
+      j[0].velocity[k] = randomRange(-1 * TPE_F / 4,TPE_F / 4);
+      j[1].velocity[k] = randomRange(-1 * TPE_F / 4,TPE_F / 4);
+      jointsNearGround[i].velocity[k] = randomRange(-1 * TPE_F / 4,TPE_F / 4);
+    }
+  }
+}
+
+int rounds = DEFAULT_ROUNDS;
+uint32_t sink = 0;
+
+void printResult(const char *name, uint64_t throughput, uint64_t latency)
+{
+  double calls = ((double) rounds) * INPUTS;
+
+  printf("%-36s %12.2f %12.2f\n",name,throughput / calls,latency / calls);
+}
+
+/* Measures an expression (whose value is converted to uint32_t) evaluated for
+   input index k. For latency the index depends on the previous result so that
+   the calls can't overlap. */
+#define BENCH(name,expression) \
+  { \
+    uint64_t t1, t2; \
+    uint32_t k, r = 0; \
+    t1 = nanoTime(); \
+    for (int round = 0; round < rounds; ++round) \
+      for (uint32_t i = 0; i < INPUTS; ++i) \
+      { \
+        k = i; \
+        sink += (uint32_t) (expression); \
+      } \
+    t1 = nanoTime() - t1; \
+    t2 = nanoTime(); \
+    for (int round = 0; round < rounds; ++round) \
+      for (uint32_t i = 0; i < INPUTS; ++i) \
+      { \
+        k = (i + (r & 1)) & (INPUTS - 1); \
+        r = (uint32_t) (expression); \
+        sink += r; \
+      } \
+    t2 = nanoTime() - t2; \
+    printResult(name,t1,t2); \
+  }
+
+int main(int argc, char **argv)
+{
+  if (argc > 1)
+    rounds = atoi(argv[1]);
+
+  if (rounds < 1)
+  {
+    printf("ERROR: bad arguments\n");
+    return 1;
+  }
+
+  prepareInputs();
+  prepareCharacters();
+
+  printf("build: TPE_APPROXIMATE_LENGTH %d, %d inputs, %d rounds, seed %d\n\n",
+    TPE_APPROXIMATE_LENGTH,INPUTS,rounds,SEED);
+
+  printf("%-36s %12s %12s\n","primitive","thr. ns/call","lat. ns/call");
+
+  BENCH("(loop overhead)",units[k])
+
+  // math:
+
+  BENCH("TPE_sqrt",TPE_sqrt(positiveUnits[k]))
+  BENCH("TPE_vec3Len",TPE_vec3Len(points[k]))
+  BENCH("TPE_vec3LenApprox",TPE_vec3LenApprox(points[k]))
+  BENCH("TPE_vec3Normalize",
+    (joint1.position = points[k], TPE_vec3Normalize(&joint1.position),
+    sum3(joint1.position)))
+  BENCH("TPE_vec3Normalized",sum3(TPE_vec3Normalized(points[k])))
+  BENCH("TPE_sin",TPE_sin(angles[k]))
+  BENCH("TPE_atan",TPE_atan(units[k]))
+
+  // environment:
+
+  BENCH("TPE_envGround",sum3(TPE_envGround(points[k],TPE_F)))
+  BENCH("TPE_envHalfPlane",sum3(TPE_envHalfPlane(points[k],TPE_vec3(0,0,0),
+    TPE_vec3(100,200,-50))))
+  BENCH("TPE_envSphere",sum3(TPE_envSphere(points[k],TPE_vec3(TPE_F,0,0),
+    3 * TPE_F)))
+  BENCH("TPE_envSphereInside",sum3(TPE_envSphereInside(points[k],
+    TPE_vec3(TPE_F,0,0),6 * TPE_F)))
+  BENCH("TPE_envAABox",sum3(TPE_envAABox(points[k],TPE_vec3(TPE_F,0,0),
+    TPE_vec3(3 * TPE_F,2 * TPE_F,TPE_F))))
+  BENCH("TPE_envAABoxInside",sum3(TPE_envAABoxInside(points[k],
+    TPE_vec3(TPE_F,0,0),TPE_vec3(12 * TPE_F,10 * TPE_F,14 * TPE_F))))
+  BENCH("TPE_envBox",sum3(TPE_envBox(points[k],TPE_vec3(TPE_F,0,0),
+    TPE_vec3(3 * TPE_F,2 * TPE_F,TPE_F),TPE_vec3(20,100,50))))
+  BENCH("TPE_envInfiniteCylinder",sum3(TPE_envInfiniteCylinder(points[k],
+    TPE_vec3(TPE_F,0,0),TPE_vec3(100,400,20),2 * TPE_F)))
+  BENCH("TPE_envCylinder",sum3(TPE_envCylinder(points[k],TPE_vec3(TPE_F,0,0),
+    TPE_vec3(100,4 * TPE_F,20),2 * TPE_F)))
+  BENCH("TPE_envCone",sum3(TPE_envCone(points[k],TPE_vec3(TPE_F,0,0),
+    TPE_vec3(100,4 * TPE_F,20),2 * TPE_F)))
+  BENCH("TPE_envLineSegment",sum3(TPE_envLineSegment(points[k],
+    TPE_vec3(-2 * TPE_F,TPE_F,0),TPE_vec3(3 * TPE_F,-1 * TPE_F,2 * TPE_F))))
+  BENCH("TPE_envAATriPrism",sum3(TPE_envAATriPrism(points[k],
+    TPE_vec3(TPE_F,0,0),prismSides,5 * TPE_F,2)))
+  BENCH("TPE_envHeightmap",sum3(TPE_envHeightmap(points[k],TPE_vec3(0,0,0),
+    2 * TPE_F,heightFunction,4 * TPE_F)))
+
+  // collisions (the joints are copied from the inputs first, which is part of
+  // the measurement):
+
+  BENCH("TPE_jointsResolveCollision",
+    (joint1 = jointPairs[k][0], joint2 = jointPairs[k][1],
+    TPE_jointsResolveCollision(&joint1,&joint2,TPE_F,2 * TPE_F,TPE_F / 2,
+    TPE_F / 2,groundEnvironment) + sum3(joint1.position)))
+  BENCH("TPE_jointEnvironmentResolveCollision",
+    (joint1 = jointsNearGround[k],
+    TPE_jointEnvironmentResolveCollision(&joint1,TPE_F / 2,TPE_F / 2,
+    groundEnvironment) + sum3(joint1.position)))
+
+  // characters (whole ticks, the bodies keep walking around randomly):
+
+  BENCH("character tick (TPE_Character)",characterTick(directions[k]))
+  BENCH("character tick (non-rotating body)",dynamicBodyTick(directions[k]))
+
+  printf("\n(checksum %08x)\n",sink);
+
+  return 0;
+}
@@ -10,9 +10,9 @@ TPE_Unit elevatorHeight;
 TPE_Unit ramp[6] = { 1600,0, -500,1400, -700,0 };
 TPE_Unit ramp2[6] = { 2000,-5000, 1500,1700, -5000,-500 };
 
-TPE_Vec3 environmentDistance(TPE_Vec3 p, TPE_Unit maxD)
+TPE_Vec3 levelDistance(TPE_Vec3 p, TPE_Unit maxD)
 {
-  // manually created environment to match the 3D model of it
+  // manually created environment to match the 3D model of it, except elevator
   TPE_ENV_START( TPE_envAABoxInside(p,TPE_vec3(0,2450,-2100),TPE_vec3(12600,5000,10800)),p )
   TPE_ENV_NEXT( TPE_envAABox(p,TPE_vec3(-5693,0,-6580),TPE_vec3(4307,20000,3420)),p )
   TPE_ENV_NEXT( TPE_envAABox(p,TPE_vec3(-10000,-1000,-10000),TPE_vec3(11085,2500,9295)),p )
@@ -20,12 +20,18 @@ TPE_Vec3 environmentDistance(TPE_Vec3 p, TPE_Unit maxD)
   TPE_ENV_NEXT( TPE_envAATriPrism(p,TPE_vec3(2076,651,-6780),ramp2,3000,0), p)
   TPE_ENV_NEXT( TPE_envAABox(p,TPE_vec3(7000,0,-8500),TPE_vec3(3405,2400,3183)),p )
   TPE_ENV_NEXT( TPE_envSphere(p,TPE_vec3(2521,-100,-3799),1200),p )
-  TPE_ENV_NEXT( TPE_envAABox(p,TPE_vec3(5300,elevatorHeight,-4400),TPE_vec3(1000,elevatorHeight,1000)),p )
   TPE_ENV_NEXT( TPE_envHalfPlane(p,TPE_vec3(5051,0,1802),TPE_vec3(-255,0,-255)),p )
   TPE_ENV_NEXT( TPE_envInfiniteCylinder(p,TPE_vec3(320,0,170),TPE_vec3(0,255,0),530),p )
   TPE_ENV_END
 }
 
+TPE_Vec3 environmentDistance(TPE_Vec3 p, TPE_Unit maxD)
+{
+  TPE_ENV_START( levelDistance(p,maxD),p )
+  TPE_ENV_NEXT( TPE_envAABox(p,TPE_vec3(5300,elevatorHeight,-4400),TPE_vec3(1000,elevatorHeight,1000)),p )
+  TPE_ENV_END
+}
+
 int jumpCountdown = 0, onGround = 0;
 TPE_Unit playerRotation = 0, groundDist;
 TPE_Vec3 ballRot, ballPreviousPos, playerDirectionVec;
@@ -191,7 +197,13 @@ int main(void)
       TPE_vec3(1000,1000,1000),ballRot);
 
     if (helper_debugDrawOn)
+    {
+      /* the elevator moves every frame, so only the rest of the level is
+         drawn (and cached), otherwise the cache would be useless */
+      tpe_world.environmentFunction = levelDistance;
       helper_debugDraw(1);
+      tpe_world.environmentFunction = environmentDistance;
+    }
 
     helper_frameEnd();
   }
@@ -33,6 +33,11 @@ TPE_Joint tpe_joints[5];
 TPE_Connection tpe_connections[10];
 TPE_Body tpe_body;
 
+#define PHYSICS_RAM_BUDGET 2048 // bytes of the 32 kB RAM given to physics
+
+TPE_BUDGET_CHECK(physicsBudgetCheck,TPE_WORLD_MEMORY_SIZE(1,5,10),
+  PHYSICS_RAM_BUDGET)
+
 S3L_Scene s3l_scene;
 
 uint8_t debugDraw = 0;
@@ -27,6 +27,11 @@ TPE_Joint tpe_joints[30];
 TPE_Connection tpe_connections[35];
 TPE_Body tpe_bodies[4];
 
+#define PHYSICS_RAM_BUDGET 2048 // bytes of the 32 kB RAM given to physics
+
+TPE_BUDGET_CHECK(physicsBudgetCheck,TPE_WORLD_MEMORY_SIZE(4,30,35),
+  PHYSICS_RAM_BUDGET)
+
 static const S3L_Unit s3l_cubeVertices[S3L_CUBE_VERTEX_COUNT * 3] = { S3L_CUBE_VERTICES(S3L_FRACTIONS_PER_UNIT) };
 static const S3L_Index s3l_cubeTriangles[S3L_CUBE_TRIANGLE_COUNT * 3] = { S3L_CUBE_TRIANGLES };
 
@@ -0,0 +1,49 @@
+/** Records a profile of a demo scene (see scenes.h) with the engine's
+  profiling zones (TPE_PROFILE) enabled, each frame is marked as a zone too,
+  and saves it as Chrome trace JSON (see profile.h).
+
+  usage: profile [scene [frames [file]]]
+    defaults: stack, 300, profile.json */
+
+#include "profile.h" // has to come before the engine
+#include "scenes.h"
+#include <stdlib.h>
+
+int main(int argc, char **argv)
+{
+  int scene = scene_find(argc > 1 ? argv[1] : "stack"),
+    frames = argc > 2 ? atoi(argv[2]) : 300;
+  const char *fileName = argc > 3 ? argv[3] : "profile.json";
+
+  if (scene < 0 || frames < 1)
+  {
+    printf("ERROR: bad arguments\n");
+    return 1;
+  }
+
+  scene_init(scene);
+
+  for (int i = 0; i < frames; ++i)
+  {
+    PROFILE_BEGIN("frame");
+    scene_step(scene);
+    PROFILE_END("frame");
+  }
+
+  FILE *f = fopen(fileName,"w");
+
+  if (!f)
+  {
+    printf("ERROR: couldn't open %s\n",fileName);
+    return 1;
+  }
+
+  uint32_t events = profile_dump(f);
+
+  fclose(f);
+
+  printf("written %u events of %d frames of scene %s to %s\n",events,frames,
+    scenes[scene].name,fileName);
+
+  return 0;
+}
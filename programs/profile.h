@@ -0,0 +1,168 @@
+/**
+  Simple profiler recording zones (e.g. the engine's with TPE_PROFILE, see
+  tinyphysicsengine.h, as well as the program's own ones such as frames) into
+  per thread ring buffers and dumping them as Chrome trace JSON (open in
+  chrome://tracing or ui.perfetto.dev) so that step phases can be seen on the
+  same timeline as the rest of the program, including the rare spikes.
+
+  Usage: include this before tinyphysicsengine.h (it defines TPE_PROFILE and
+  its macros), mark own zones with PROFILE_BEGIN/PROFILE_END, call
+  profile_dump at the end. Each thread only ever writes to its own buffer
+  (no locks are needed), only the registration of a new thread's buffer
+  (allocated with malloc, never freed) is atomic. When a buffer gets full the
+  oldest events are overwritten. Needs GCC or clang (thread local storage and
+  atomic builtins).
+*/
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#ifndef _POSIX_C_SOURCE
+  #define _POSIX_C_SOURCE 199309L // for clock_gettime
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifndef PROFILE_EVENTS
+  #define PROFILE_EVENTS (1 << 20) ///< events per thread, power of two
+#endif
+
+#ifndef PROFILE_THREADS
+  #define PROFILE_THREADS 16 ///< max number of recorded threads
+#endif
+
+typedef struct
+{
+  const char *name;
+  uint64_t time;  ///< ns
+  uint8_t begin;  ///< 1 = zone begin, 0 = zone end
+} ProfileEvent;
+
+typedef struct
+{
+  ProfileEvent events[PROFILE_EVENTS];
+  uint32_t count; ///< total events written, including overwritten ones
+} ProfileBuffer;
+
+ProfileBuffer *_profile_buffers[PROFILE_THREADS];
+uint32_t _profile_threadCount = 0;
+__thread ProfileBuffer *_profile_buffer = 0;
+__thread uint8_t _profile_unrecorded = 0; ///< this thread got no buffer
+
+static inline uint64_t profile_time(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec * ((uint64_t) 1000000000) + t.tv_nsec;
+}
+
+static inline void profile_event(const char *name, uint8_t begin)
+{
+  if (_profile_buffer == 0) // first event of this thread: register a buffer
+  {
+    if (_profile_unrecorded)
+      return; // don't try again, that would grow the thread count forever
+
+    uint32_t index = __atomic_fetch_add(&_profile_threadCount,1,
+      __ATOMIC_RELAXED);
+
+    if (index < PROFILE_THREADS) // else too many threads, not recorded
+      _profile_buffer = malloc(sizeof(ProfileBuffer));
+
+    if (_profile_buffer == 0)
+    {
+      _profile_unrecorded = 1;
+      return;
+    }
+
+    _profile_buffer->count = 0;
+    __atomic_store_n(&_profile_buffers[index],_profile_buffer,
+      __ATOMIC_RELEASE);
+  }
+
+  ProfileEvent *e =
+    _profile_buffer->events + (_profile_buffer->count & (PROFILE_EVENTS - 1));
+
+  e->name = name;
+  e->time = profile_time();
+  e->begin = begin;
+
+  __atomic_store_n(&_profile_buffer->count,_profile_buffer->count + 1,
+    __ATOMIC_RELEASE);
+}
+
+#define PROFILE_BEGIN(name) profile_event(name,1)
+#define PROFILE_END(name) profile_event(name,0)
+
+#define TPE_PROFILE 1
+#define TPE_PROFILE_BEGIN(name) PROFILE_BEGIN(name)
+#define TPE_PROFILE_END(name) PROFILE_END(name)
+
+/** Writes all recorded events as Chrome trace JSON into an open file, should
+  be called when the recorded threads aren't running. Events of zones whose
+  beginning has been overwritten are left out. Returns the number of written
+  events. */
+uint32_t profile_dump(FILE *f)
+{
+  uint32_t threads = __atomic_load_n(&_profile_threadCount,__ATOMIC_ACQUIRE),
+    written = 0;
+  uint64_t start = UINT64_MAX;
+
+  if (threads > PROFILE_THREADS)
+    threads = PROFILE_THREADS;
+
+  for (uint32_t t = 0; t < threads; ++t) // find the earliest time
+  {
+    ProfileBuffer *b = __atomic_load_n(&_profile_buffers[t],__ATOMIC_ACQUIRE);
+
+    if (b == 0 || b->count == 0)
+      continue;
+
+    uint32_t first = b->count > PROFILE_EVENTS ? b->count - PROFILE_EVENTS : 0;
+    uint64_t time = b->events[first & (PROFILE_EVENTS - 1)].time;
+
+    if (time < start)
+      start = time;
+  }
+
+  fprintf(f,"{\"traceEvents\":[");
+
+  for (uint32_t t = 0; t < threads; ++t)
+  {
+    ProfileBuffer *b = __atomic_load_n(&_profile_buffers[t],__ATOMIC_ACQUIRE);
+
+    if (b == 0)
+      continue;
+
+    uint32_t count = __atomic_load_n(&b->count,__ATOMIC_ACQUIRE),
+      first = count > PROFILE_EVENTS ? count - PROFILE_EVENTS : 0;
+    int32_t depth = 0;
+
+    for (uint32_t i = first; i < count; ++i)
+    {
+      const ProfileEvent *e = b->events + (i & (PROFILE_EVENTS - 1));
+
+      if (e->begin)
+        depth++;
+      else if (depth > 0)
+        depth--;
+      else
+        continue; // the beginning was overwritten
+
+      fprintf(f,"%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,"
+        "\"tid\":%u}",written ? "," : "",e->name,e->begin ? 'B' : 'E',
+        (e->time - start) / 1000.0,t);
+
+      written++;
+    }
+  }
+
+  fprintf(f,"\n]}\n");
+
+  return written;
+}
+
+#endif // guard
@@ -0,0 +1,135 @@
+/** Headless rollback benchmark: records the demo scenes' inputs into an input
+  log (with hash checkpoints) together with a snapshot of every tick, then
+  repeatedly rewinds the world by given number of frames and re-simulates it
+  from the log, checking the result matches the recording. Reports how many
+  rollback frames per millisecond can be afforded. */
+
+#define _POSIX_C_SOURCE 199309L // for clock_gettime
+
+#include "scenes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define FRAMES 600
+#define CHECKPOINT_INTERVAL 10
+#define LOG_SIZE (256 * 1024)
+
+uint8_t logData[LOG_SIZE];
+uint32_t hashes[FRAMES + 1];
+
+const int depths[] = {1, 4, 8, 16, 32};
+
+#define DEPTH_COUNT ((int) (sizeof(depths) / sizeof(int)))
+
+double getTime(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+int main(void)
+{
+  TPE_InputLog inputLog;
+
+  printf("%-8s %10s %10s","scene","log B/f","verify");
+
+  for (int d = 0; d < DEPTH_COUNT; ++d)
+  {
+    char s[16];
+    sprintf(s,"R=%d f/ms",depths[d]);
+    printf(" %11s",s);
+  }
+
+  putchar('\n');
+
+  for (int s = 0; s < SCENE_COUNT; ++s)
+  {
+    scene_init(s);
+
+    uint32_t snapshotSize = TPE_worldSnapshotSize(&scene_world);
+    uint32_t stride = (snapshotSize + sizeof(TPE_Joint) - 1) /
+      sizeof(TPE_Joint);
+
+    TPE_Joint *snapshots = malloc((FRAMES + 1) * stride * sizeof(TPE_Joint));
+
+    if (snapshots == 0)
+    {
+      printf("ERROR: couldn't allocate memory\n");
+      return 1;
+    }
+
+    // record:
+
+    TPE_inputLogInit(&inputLog,logData,LOG_SIZE,CHECKPOINT_INTERVAL);
+    scene_inputLog = &inputLog;
+
+    for (int f = 0; f <= FRAMES; ++f)
+    {
+      TPE_worldSnapshot(&scene_world,snapshots + f * stride);
+      hashes[f] = TPE_worldHash(&scene_world);
+
+      if (f < FRAMES)
+        scene_step(s);
+    }
+
+    scene_inputLog = 0;
+
+    if (inputLog.tick != FRAMES)
+    {
+      printf("ERROR: input log full\n");
+      return 1;
+    }
+
+    // verify whole replay from the start:
+
+    TPE_worldRestore(&scene_world,snapshots);
+
+    int32_t mismatch = TPE_inputLogReplay(&inputLog,&scene_world,0,FRAMES);
+
+    if (mismatch >= 0 || TPE_worldHash(&scene_world) != hashes[FRAMES])
+    {
+      printf("ERROR: replay of scene %s differs (tick %d)\n",scenes[s].name,
+        mismatch);
+      return 1;
+    }
+
+    printf("%-8s %10.1f %10s",scenes[s].name,((double) inputLog.size) / FRAMES,
+      "OK");
+
+    // rollbacks:
+
+    for (int d = 0; d < DEPTH_COUNT; ++d)
+    {
+      int depth = depths[d];
+      long frames = 0;
+      double t = getTime();
+
+      for (int f = depth; f <= FRAMES; ++f)
+      {
+        TPE_worldRestore(&scene_world,snapshots + (f - depth) * stride);
+
+        if (TPE_inputLogReplay(&inputLog,&scene_world,f - depth,f) >= 0 ||
+          TPE_worldHash(&scene_world) != hashes[f])
+        {
+          printf("\nERROR: rollback differs (scene %s, frame %d, depth %d)\n",
+            scenes[s].name,f,depth);
+          return 1;
+        }
+
+        frames += depth;
+      }
+
+      t = getTime() - t;
+
+      printf(" %11.1f",frames / (t * 1000.0));
+    }
+
+    putchar('\n');
+
+    free(snapshots);
+  }
+
+  return 0;
+}
@@ -0,0 +1,128 @@
+/** Scaling benchmark: generates stress scenes (see stress.h) with growing
+  number of bodies and measures the time per step along with the number of
+  body pair (AABB) tests and joint pair tests, to see where the quadratic
+  loops start to dominate. The output is tab separated (plot e.g. with
+  gnuplot, log scale), the exponent column estimates k in time ~ N^k between
+  neighboring rows (1 = linear, 2 = quadratic).
+
+  usage: scaling [arrangement [environment [steps [maxBodies [seed]]]]]
+    arrangement: pile, grid, rain, stack (default pile)
+    environment: ground, box, bowl (default box) */
+
+#define _POSIX_C_SOURCE 199309L // for clock_gettime
+
+#define TPE_STATS 1 // for counting the pair tests
+
+#include "stress.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_STEPS 30
+#define DEFAULT_MAX_BODIES 10000
+#define DEFAULT_SEED 1
+
+const unsigned int counts[] =
+  {10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000};
+
+#define COUNT_COUNT ((int) (sizeof(counts) / sizeof(counts[0])))
+
+uint64_t nanoTime(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec * ((uint64_t) 1000000000) + t.tv_nsec;
+}
+
+int findName(const char *name, const char **names, int count)
+{
+  for (int i = 0; i < count; ++i)
+    if (strcmp(name,names[i]) == 0)
+      return i;
+
+  return -1;
+}
+
+int main(int argc, char **argv)
+{
+  int arrangement = STRESS_PILE, environment = STRESS_ENV_BOX,
+    steps = DEFAULT_STEPS;
+  unsigned int maxBodies = DEFAULT_MAX_BODIES, seed = DEFAULT_SEED;
+
+  if (argc > 1)
+    arrangement = findName(argv[1],stress_arrangementNames,
+      STRESS_ARRANGEMENTS);
+
+  if (argc > 2)
+    environment = findName(argv[2],stress_environmentNames,
+      STRESS_ENVIRONMENTS);
+
+  if (argc > 3)
+    steps = atoi(argv[3]);
+
+  if (argc > 4)
+    maxBodies = atoi(argv[4]);
+
+  if (argc > 5)
+    seed = atoi(argv[5]);
+
+  if (arrangement < 0 || environment < 0 || steps < 1 || maxBodies > 65535)
+  {
+    printf("ERROR: bad arguments\n");
+    return 1;
+  }
+
+  printf("# arrangement %s, environment %s, %d steps, seed %u\n",
+    stress_arrangementNames[arrangement],stress_environmentNames[environment],
+    steps,seed);
+
+  printf("# bodies\tjoints\tns/step\tns/step/body\tAABB tests/step\t"
+    "joint pair tests/step\tcontacts/step\texponent\n");
+
+  double previousTime = 0;
+  unsigned int previousCount = 0;
+
+  for (int c = 0; c < COUNT_COUNT && counts[c] <= maxBodies; ++c)
+  {
+    StressScene scene;
+    TPE_WorldStats stats;
+
+    if (!stress_generate(&scene,counts[c],arrangement,environment,seed))
+    {
+      printf("ERROR: couldn't allocate memory\n");
+      return 1;
+    }
+
+    TPE_worldStatsInit(&stats,0);
+    scene.world.stats = &stats;
+
+    uint64_t t = nanoTime();
+
+    for (int i = 0; i < steps; ++i)
+      stress_step(&scene);
+
+    double time = ((double) (nanoTime() - t)) / steps;
+
+    printf("%u\t%u\t%.0f\t%.1f\t%.0f\t%.0f\t%.1f\t",counts[c],
+      scene.jointCount,time,time / counts[c],
+      ((double) stats.aabbTests) / steps,
+      ((double) stats.jointPairTests) / steps,
+      ((double) (stats.jointContacts + stats.environmentContacts)) / steps);
+
+    if (previousCount != 0 && previousTime > 0 && time > 0)
+      printf("%.2f\n",log(time / previousTime) /
+        log(((double) counts[c]) / previousCount));
+    else
+      printf("-\n");
+
+    fflush(stdout);
+
+    previousTime = time;
+    previousCount = counts[c];
+
+    stress_free(&scene);
+  }
+
+  return 0;
+}
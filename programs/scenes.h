@@ -0,0 +1,965 @@
+/**
+  Headless versions of the scenes of the demo programs, i.e. without SDL and
+  any rendering, for benchmarks and tools that need to run on machines without
+  display. Each scene has an init function that builds the world and a frame
+  function that does what the demo does every frame (applying gravity,
+  scripted input instead of keyboard etc.) including the world step.
+*/
+
+#ifndef _SCENES_H
+#define _SCENES_H
+
+#include "../tinyphysicsengine.h"
+#include <string.h>
+
+#define SCENE_MAX_BODIES 128
+#define SCENE_MAX_JOINTS 1024
+#define SCENE_MAX_CONNECTIONS 2048
+
+#define SCENE_FPS 30
+
+/* Code to run right before and after each world step, e.g. for measuring
+   only the step time without the time of applying the scenes' inputs. */
+
+#ifndef SCENE_WORLD_STEP_BEGIN
+  #define SCENE_WORLD_STEP_BEGIN
+#endif
+
+#ifndef SCENE_WORLD_STEP_END
+  #define SCENE_WORLD_STEP_END
+#endif
+
+TPE_Body scene_bodies[SCENE_MAX_BODIES];
+TPE_Joint scene_joints[SCENE_MAX_JOINTS];
+TPE_Connection scene_connections[SCENE_MAX_CONNECTIONS];
+
+unsigned int
+  scene_jointsUsed = 0,
+  scene_connectionsUsed = 0,
+  scene_frame = 0;
+
+TPE_World scene_world;
+
+#define scene_lastBody scene_world.bodies[scene_world.bodyCount - 1]
+
+/** If set, the scenes' inputs and steps go through this log (so they are
+  recorded), the scenes use the following scene_* functions for this. */
+TPE_InputLog *scene_inputLog = 0;
+
+void scene_accelerate(uint16_t body, TPE_Vec3 velocity)
+{
+  if (scene_inputLog)
+    TPE_inputLogAccelerate(scene_inputLog,&scene_world,body,velocity);
+  else
+    TPE_bodyAccelerate(&scene_world.bodies[body],velocity);
+}
+
+void scene_applyGravity(uint16_t body, TPE_Unit downwardsAccel)
+{
+  if (scene_inputLog)
+    TPE_inputLogApplyGravity(scene_inputLog,&scene_world,body,downwardsAccel);
+  else
+    TPE_bodyApplyGravity(&scene_world.bodies[body],downwardsAccel);
+}
+
+void scene_jointPin(uint16_t body, uint8_t joint, TPE_Vec3 position)
+{
+  if (scene_inputLog)
+    TPE_inputLogJointPin(scene_inputLog,&scene_world,body,joint,position);
+  else
+    TPE_jointPin(&scene_world.bodies[body].joints[joint],position);
+}
+
+void scene_jointVelocity(uint16_t body, uint8_t joint, TPE_Vec3 velocity)
+{
+  if (scene_inputLog)
+    TPE_inputLogJointVelocity(scene_inputLog,&scene_world,body,joint,velocity);
+  else
+  {
+    int16_t *v = scene_world.bodies[body].joints[joint].velocity;
+
+    v[0] = velocity.x;
+    v[1] = velocity.y;
+    v[2] = velocity.z;
+  }
+}
+
+/** Moves a body without changing its velocity. */
+void scene_bodyMoveBy(uint16_t body, TPE_Vec3 offset)
+{
+  TPE_Body *b = &scene_world.bodies[body];
+
+  if (!scene_inputLog)
+  {
+    TPE_bodyMoveBy(b,offset);
+    return;
+  }
+
+  for (uint8_t i = 0; i < b->jointCount; ++i)
+  {
+    TPE_Joint *j = &b->joints[i];
+    TPE_Vec3 v = TPE_vec3(j->velocity[0],j->velocity[1],j->velocity[2]);
+
+    scene_jointPin(body,i,TPE_vec3Plus(j->position,offset));
+    scene_jointVelocity(body,i,v);
+  }
+}
+
+void scene_multiplyNetSpeed(uint16_t body, TPE_Unit factor)
+{
+  TPE_Body *b = &scene_world.bodies[body];
+
+  if (!scene_inputLog)
+  {
+    TPE_bodyMultiplyNetSpeed(b,factor);
+    return;
+  }
+
+  for (uint8_t i = 0; i < b->jointCount; ++i)
+  {
+    int16_t *v = b->joints[i].velocity;
+
+    // same computation as in TPE_bodyMultiplyNetSpeed
+
+    scene_jointVelocity(body,i,TPE_vec3(
+      (((TPE_Unit) v[0]) * factor) / TPE_F,
+      (((TPE_Unit) v[1]) * factor) / TPE_F,
+      (((TPE_Unit) v[2]) * factor) / TPE_F));
+  }
+}
+
+void scene_jointAddVelocity(uint16_t body, uint8_t joint, TPE_Vec3 velocity)
+{
+  int16_t *v = scene_world.bodies[body].joints[joint].velocity;
+
+  scene_jointVelocity(body,joint,
+    TPE_vec3(v[0] + velocity.x,v[1] + velocity.y,v[2] + velocity.z));
+}
+
+/** Parameters of scene environments (e.g. positions of moving platforms),
+  changed through scene_setParameter so that they're recorded by input logs
+  (whose parameterFunction has to be scene_parameterFunction). */
+int32_t scene_parameters[4];
+
+void scene_parameterFunction(uint8_t index, int32_t value)
+{
+  scene_parameters[index] = value;
+}
+
+void scene_setParameter(uint8_t index, int32_t value)
+{
+  if (scene_inputLog)
+  {
+    scene_inputLog->parameterFunction = scene_parameterFunction;
+    TPE_inputLogParameter(scene_inputLog,index,value);
+  }
+  else
+    scene_parameterFunction(index,value);
+}
+
+void scene_worldStep(void)
+{
+  SCENE_WORLD_STEP_BEGIN
+
+  if (scene_inputLog)
+    TPE_inputLogStep(scene_inputLog,&scene_world);
+  else
+    TPE_worldStep(&scene_world);
+
+  SCENE_WORLD_STEP_END
+}
+
+void _scene_bodyAdded(int joints, int conns, TPE_Unit mass)
+{
+  TPE_bodyInit(&scene_bodies[scene_world.bodyCount],
+    &scene_joints[scene_jointsUsed],joints,
+    &scene_connections[scene_connectionsUsed],conns,mass);
+
+  scene_jointsUsed += joints;
+  scene_connectionsUsed += conns;
+
+  scene_world.bodyCount++;
+}
+
+void scene_addBox(TPE_Unit w, TPE_Unit h, TPE_Unit d, TPE_Unit jointSize,
+  TPE_Unit mass)
+{
+  TPE_makeBox(scene_joints + scene_jointsUsed,
+    scene_connections + scene_connectionsUsed,w,h,d,jointSize);
+
+  _scene_bodyAdded(8,16,mass);
+}
+
+void scene_add2Line(TPE_Unit w, TPE_Unit jointSize, TPE_Unit mass)
+{
+  TPE_make2Line(scene_joints + scene_jointsUsed,
+    scene_connections + scene_connectionsUsed,w,jointSize);
+
+  _scene_bodyAdded(2,1,mass);
+}
+
+void scene_addTriangle(TPE_Unit s, TPE_Unit d, TPE_Unit mass)
+{
+  TPE_makeTriangle(scene_joints + scene_jointsUsed,
+    scene_connections + scene_connectionsUsed,s,d);
+
+  _scene_bodyAdded(3,3,mass);
+}
+
+void scene_addRect(TPE_Unit w, TPE_Unit d, TPE_Unit jointSize, TPE_Unit mass)
+{
+  TPE_makeRect(scene_joints + scene_jointsUsed,
+    scene_connections + scene_connectionsUsed,w,d,jointSize);
+
+  _scene_bodyAdded(4,6,mass);
+}
+
+void scene_addCenterBox(TPE_Unit w, TPE_Unit h, TPE_Unit d,
+  TPE_Unit jointSize, TPE_Unit mass)
+{
+  TPE_makeCenterBox(scene_joints + scene_jointsUsed,
+    scene_connections + scene_connectionsUsed,w,h,d,jointSize);
+
+  _scene_bodyAdded(9,18,mass);
+}
+
+void scene_addCenterRect(TPE_Unit w, TPE_Unit d, TPE_Unit jointSize,
+  TPE_Unit mass)
+{
+  TPE_makeCenterRect(scene_joints + scene_jointsUsed,
+    scene_connections + scene_connectionsUsed,w,d,jointSize);
+
+  _scene_bodyAdded(5,8,mass);
+}
+
+void scene_addCenterRectFull(TPE_Unit w, TPE_Unit d, TPE_Unit jointSize,
+  TPE_Unit mass)
+{
+  TPE_makeCenterRectFull(scene_joints + scene_jointsUsed,
+    scene_connections + scene_connectionsUsed,w,d,jointSize);
+
+  _scene_bodyAdded(5,10,mass);
+}
+
+void scene_addBall(TPE_Unit s, TPE_Unit mass)
+{
+  scene_joints[scene_jointsUsed] = TPE_joint(TPE_vec3(0,0,0),s);
+
+  _scene_bodyAdded(1,0,mass);
+}
+
+// stack.c:
+
+TPE_Vec3 _scene_stackEnv(TPE_Vec3 p, TPE_Unit maxD)
+{
+  TPE_ENV_START( TPE_envHalfPlane(p,TPE_vec3(0,0,0),TPE_vec3(TPE_F / 2,TPE_F / 2,0)),p )
+  TPE_ENV_NEXT( TPE_envHalfPlane(p,TPE_vec3(0,0,0),TPE_vec3(-1 * TPE_F / 2,TPE_F / 2,-1 * TPE_F / 2)),p )
+  TPE_ENV_NEXT( TPE_envHalfPlane(p,TPE_vec3(0,0,0),TPE_vec3(-1 * TPE_F / 2,TPE_F / 2,TPE_F / 2)),p )
+  TPE_ENV_END
+}
+
+void _scene_stackInit(void)
+{
+  scene_world.environmentFunction = _scene_stackEnv;
+
+  for (int i = 0; i < 16; ++i)
+  {
+    switch (i % 5)
+    {
+      case 0: scene_addBox(800,800,800,400,700); break;
+      case 1: scene_addTriangle(1100,200,600); break;
+      case 2: scene_addBall(500,700); break;
+      case 3: scene_addRect(800,800,400,800); break;
+      case 4: scene_add2Line(900,200,600); break;
+      default: break;
+    }
+
+    TPE_bodyMoveBy(&scene_lastBody,
+      TPE_vec3((1 - (i % 4)) * 1200,8000,(2 - (i / 4)) * 1200));
+  }
+}
+
+void _scene_stackFrame(void)
+{
+  for (int i = 0; i < scene_world.bodyCount; ++i)
+    scene_applyGravity(i,(5 * 30) / SCENE_FPS);
+
+  scene_worldStep();
+}
+
+// cubes.c:
+
+#define _SCENE_CUBES_ROOM_SIZE (14 * TPE_F)
+#define _SCENE_CUBE_SIZE (3 * TPE_F / 2)
+
+TPE_Vec3 _scene_cubesEnv(TPE_Vec3 p, TPE_Unit maxD)
+{
+  return TPE_envAABoxInside(p,TPE_vec3(0,_SCENE_CUBES_ROOM_SIZE / 4,0),
+    TPE_vec3(_SCENE_CUBES_ROOM_SIZE,_SCENE_CUBES_ROOM_SIZE / 2,
+    _SCENE_CUBES_ROOM_SIZE));
+}
+
+void _scene_cubesInit(void)
+{
+  scene_world.environmentFunction = _scene_cubesEnv;
+
+  for (int i = 0; i < 6; ++i)
+  {
+    scene_addBox(_SCENE_CUBE_SIZE / 2,_SCENE_CUBE_SIZE / 2,
+      _SCENE_CUBE_SIZE / 2,_SCENE_CUBE_SIZE / 4,TPE_F / 5);
+    scene_lastBody.friction = TPE_F / 20;
+  }
+
+#define move(i,x,y) \
+  TPE_bodyMoveBy(&scene_world.bodies[i],TPE_vec3((_SCENE_CUBE_SIZE / 2 + 10) \
+    * x,10 + _SCENE_CUBE_SIZE / 2 + y * (_SCENE_CUBE_SIZE + 10),0));
+
+  move(0,0,0)
+  move(1,-2,0)
+  move(2,2,0)
+  move(3,-1,1)
+  move(4,1,1)
+  move(5,0,2)
+
+#undef move
+
+  for (int i = 0; i < 6; ++i)
+    TPE_bodyDeactivate(&scene_bodies[i]);
+
+  // the wrecking ball:
+
+  TPE_Joint *j = scene_joints + scene_jointsUsed;
+  TPE_Connection *c = scene_connections + scene_connectionsUsed;
+
+  j[0] = TPE_joint(TPE_vec3(0,_SCENE_CUBES_ROOM_SIZE / 2,0),0);
+  j[1] = TPE_joint(TPE_vec3(0,_SCENE_CUBES_ROOM_SIZE / 2 - TPE_F / 5,
+    -1 * TPE_F),0);
+  j[2] = TPE_joint(TPE_vec3(0,_SCENE_CUBES_ROOM_SIZE / 2 - TPE_F / 2,
+    -2 * TPE_F),0);
+  j[3] = TPE_joint(TPE_vec3(0,_SCENE_CUBES_ROOM_SIZE / 2 - TPE_F,-4 * TPE_F),
+    TPE_F);
+  j[3].velocity[1] = -1 * TPE_F / 2;
+  j[3].velocity[2] = -1 * TPE_F / 2;
+
+  c[0].joint1 = 0; c[0].joint2 = 1;
+  c[1].joint1 = 1; c[1].joint2 = 2;
+  c[2].joint1 = 2; c[2].joint2 = 3;
+
+  _scene_bodyAdded(4,3,2 * TPE_F);
+
+  scene_lastBody.flags |= TPE_BODY_FLAG_SIMPLE_CONN;
+  scene_lastBody.flags |= TPE_BODY_FLAG_ALWAYS_ACTIVE;
+  scene_lastBody.friction = 0;
+  scene_lastBody.elasticity = TPE_F;
+}
+
+void _scene_cubesFrame(void)
+{
+  TPE_Joint *ballEnd = &scene_world.bodies[6].joints[3];
+
+  scene_jointPin(6,0,TPE_vec3(0,_SCENE_CUBES_ROOM_SIZE / 2 - TPE_F / 100,0));
+
+  for (int i = 0; i < 6; ++i)
+    scene_applyGravity(i,TPE_F / 100);
+
+  scene_jointVelocity(6,3,TPE_vec3(ballEnd->velocity[0],
+    ballEnd->velocity[1] - TPE_F / 100,ballEnd->velocity[2]));
+
+  scene_worldStep();
+}
+
+// water.c:
+
+#define _SCENE_WATER_RES 8
+#define _SCENE_WATER_STEP (TPE_F * 2)
+#define _SCENE_WATER_JOINTS (_SCENE_WATER_RES * _SCENE_WATER_RES)
+#define _SCENE_WATER_ROOM_SIZE \
+  (_SCENE_WATER_RES * _SCENE_WATER_STEP + TPE_F / 4)
+
+TPE_Vec3 _scene_waterEnv(TPE_Vec3 p, TPE_Unit maxD)
+{
+  return TPE_envAABoxInside(p,TPE_vec3(0,0,0),TPE_vec3(_SCENE_WATER_ROOM_SIZE,
+    _SCENE_WATER_ROOM_SIZE,_SCENE_WATER_ROOM_SIZE));
+}
+
+TPE_Vec3 _scene_waterPoint(int index)
+{
+  return TPE_vec3(
+    (-1 * _SCENE_WATER_RES * _SCENE_WATER_STEP) / 2 +
+      (index % _SCENE_WATER_RES) * _SCENE_WATER_STEP + _SCENE_WATER_STEP / 2,
+    0,
+    (-1 * _SCENE_WATER_RES * _SCENE_WATER_STEP) / 2 +
+      (index / _SCENE_WATER_RES) * _SCENE_WATER_STEP + _SCENE_WATER_STEP / 2);
+}
+
+void _scene_waterInit(void)
+{
+  TPE_Joint *j = scene_joints + scene_jointsUsed;
+  TPE_Connection *c = scene_connections + scene_connectionsUsed;
+
+  for (int i = 0; i < _SCENE_WATER_JOINTS; ++i)
+    j[i] = TPE_joint(_scene_waterPoint(i),TPE_F / 4);
+
+  int index = 0;
+
+  for (int k = 0; k < _SCENE_WATER_RES; ++k)
+    for (int i = 0; i < _SCENE_WATER_RES - 1; ++i)
+    {
+      c[index].joint1 = k * _SCENE_WATER_RES + i;
+      c[index].joint2 = c[index].joint1 + 1;
+      index++;
+
+      c[index].joint1 = i * _SCENE_WATER_RES + k;
+      c[index].joint2 = c[index].joint1 + _SCENE_WATER_RES;
+      index++;
+    }
+
+  _scene_bodyAdded(_SCENE_WATER_JOINTS,index,2 * TPE_F);
+
+  scene_lastBody.flags |= TPE_BODY_FLAG_SOFT | TPE_BODY_FLAG_ALWAYS_ACTIVE;
+
+  scene_addBall(5 * TPE_F / 4,200);
+  TPE_bodyMoveBy(&scene_lastBody,TPE_vec3(0,0,_SCENE_WATER_ROOM_SIZE / 4));
+  scene_lastBody.flags |= TPE_BODY_FLAG_ALWAYS_ACTIVE;
+
+  scene_world.environmentFunction = _scene_waterEnv;
+}
+
+void _scene_waterFrame(void)
+{
+  TPE_Body *ball = &scene_world.bodies[1];
+
+  for (int i = 0; i < _SCENE_WATER_JOINTS; ++i)
+    if (i % _SCENE_WATER_RES == 0 || i % _SCENE_WATER_RES == _SCENE_WATER_RES - 1
+      || i / _SCENE_WATER_RES == 0 || i / _SCENE_WATER_RES == _SCENE_WATER_RES - 1)
+      scene_jointPin(0,i,_scene_waterPoint(i));
+
+  scene_applyGravity(1,ball->joints[0].position.y > 0 ? 5 : -10);
+
+  // instead of keyboard the ball is steered around in a square:
+
+  switch ((scene_frame / 40) % 4)
+  {
+    case 0: scene_accelerate(1,TPE_vec3(0,0,25)); break;
+    case 1: scene_accelerate(1,TPE_vec3(25,0,0)); break;
+    case 2: scene_accelerate(1,TPE_vec3(0,0,-25)); break;
+    case 3: scene_accelerate(1,TPE_vec3(-25,0,0)); break;
+    default: break;
+  }
+
+  scene_worldStep();
+}
+
+// car.c (driving forward, steering in cycles):
+
+#define _SCENE_CAR_ACCELERATION (TPE_F / 14)
+#define _SCENE_CAR_TURN_RATE (3 * TPE_F / 4)
+#define _SCENE_CAR_TURN_FRICTION (3 * TPE_F / 4)
+#define _SCENE_CAR_FORW_FRICTION (TPE_F / 14)
+
+TPE_Unit _scene_carRamp[6] = { 0,0, -2400,1400, -2400,0 };
+
+uint8_t _scene_carJointCollisions, _scene_carJointCollisionsPrev;
+
+TPE_Vec3 _scene_carEnv(TPE_Vec3 p, TPE_Unit maxD)
+{
+  TPE_ENV_START( TPE_envGround(p,0),p )
+  TPE_ENV_NEXT( TPE_envSphereInside(p,TPE_vec3(0,10000,0),20000),p )
+  TPE_ENV_NEXT( TPE_envAABox(p,TPE_vec3(-8700,100,-800),TPE_vec3(2200,1000,800)),p )
+  TPE_ENV_NEXT( TPE_envAATriPrism(p,TPE_vec3(8700,0,0),_scene_carRamp,5000,2),p )
+  TPE_ENV_NEXT( TPE_envSphere(p,TPE_vec3(0,-200,0),1700),p )
+  TPE_ENV_END
+}
+
+uint8_t _scene_carCollision(uint16_t b1, uint16_t j1, uint16_t b2, uint16_t j2,
+  TPE_Vec3 p)
+{
+  if (b1 == 1 && b1 == b2 && j1 < 4)
+    _scene_carJointCollisions |= 0x01 << j1;
+
+  return 1;
+}
+
+void _scene_carInit(void)
+{
+  scene_world.environmentFunction = _scene_carEnv;
+  scene_world.collisionCallback = _scene_carCollision;
+
+  _scene_carJointCollisions = 0;
+  _scene_carJointCollisionsPrev = 0;
+
+  scene_addRect(6 * TPE_F / 5,6 * TPE_F / 5,6 * TPE_F / 5,TPE_F / 2);
+  TPE_bodyMoveBy(&scene_lastBody,TPE_vec3(2000,1000,3000));
+  scene_lastBody.friction = TPE_F / 5;
+
+  scene_addCenterRectFull(1000,1800,400,2000);
+
+  TPE_Body *car = &scene_lastBody;
+
+  car->joints[4].position.y += 600;
+  car->joints[4].sizeDivided *= 3;
+  car->joints[4].sizeDivided /= 2;
+
+  TPE_bodyInit(car,car->joints,car->jointCount,car->connections,
+    car->connectionCount,TPE_F / 2);
+
+  TPE_bodyMoveBy(car,TPE_vec3(6 * TPE_F,2 * TPE_F,0));
+  car->elasticity = TPE_F / 100;
+  car->friction = _SCENE_CAR_FORW_FRICTION;
+  car->flags |= TPE_BODY_FLAG_ALWAYS_ACTIVE;
+}
+
+void _scene_carFrame(void)
+{
+  TPE_Body *car = &scene_world.bodies[1];
+
+  // 0: none, 1: right, 2: left
+  uint8_t steering = (scene_frame / 50) % 4;
+  steering = steering == 1 ? 1 : (steering == 3 ? 2 : 0);
+
+  TPE_Vec3 carForw = TPE_vec3Normalized(TPE_vec3Plus(
+    TPE_vec3Minus(car->joints[2].position,car->joints[0].position),
+    TPE_vec3Minus(car->joints[3].position,car->joints[1].position)));
+
+  TPE_Vec3 carSide = TPE_vec3Normalized(TPE_vec3Plus(
+    TPE_vec3Minus(car->joints[1].position,car->joints[0].position),
+    TPE_vec3Minus(car->joints[3].position,car->joints[2].position)));
+
+  TPE_Vec3 carUp = TPE_vec3Cross(carForw,carSide);
+
+  for (int i = 0; i < 4; ++i) // directional wheel friction
+    if (_scene_carJointCollisions & (0x01 << i))
+    {
+      TPE_Vec3 jv = TPE_vec3(car->joints[i].velocity[0],
+        car->joints[i].velocity[1],car->joints[i].velocity[2]);
+
+      TPE_Vec3 ja = carSide;
+
+      if (i >= 2 && steering)
+      {
+        if (steering == 2)
+          ja = TPE_vec3Plus(TPE_vec3Times(carForw,_SCENE_CAR_TURN_RATE),
+            carSide);
+        else
+          ja = TPE_vec3Minus(TPE_vec3Times(carForw,_SCENE_CAR_TURN_RATE),
+            carSide);
+
+        ja = TPE_vec3Normalized(ja);
+      }
+
+      TPE_Vec3 fric = TPE_vec3Times(ja,(TPE_vec3Dot(ja,jv) *
+        _SCENE_CAR_TURN_FRICTION) / TPE_F);
+
+      scene_jointVelocity(1,i,TPE_vec3Minus(jv,fric));
+    }
+
+  if (TPE_vec3Dot(carUp,TPE_vec3Minus(car->joints[4].position,
+    car->joints[0].position)) < 0) // fix flipped geometry
+  {
+    TPE_Joint *j = &car->joints[4];
+    TPE_Vec3 v = TPE_vec3(j->velocity[0],j->velocity[1],j->velocity[2]);
+
+    scene_jointPin(1,4,TPE_vec3Plus(TPE_vec3Times(carUp,300),
+      car->joints[0].position));
+    scene_jointVelocity(1,4,v);
+  }
+
+  for (int i = 0; i < scene_world.bodyCount; ++i)
+    scene_applyGravity(i,5);
+
+  if ((_scene_carJointCollisions | _scene_carJointCollisionsPrev) & 0x03)
+  {
+    TPE_Vec3 a = TPE_vec3((carForw.x * _SCENE_CAR_ACCELERATION) / TPE_F,
+      (carForw.y * _SCENE_CAR_ACCELERATION) / TPE_F,
+      (carForw.z * _SCENE_CAR_ACCELERATION) / TPE_F);
+
+    scene_jointAddVelocity(1,0,a);
+    scene_jointAddVelocity(1,1,a);
+  }
+
+  _scene_carJointCollisionsPrev = _scene_carJointCollisions;
+  _scene_carJointCollisions = 0;
+
+  scene_worldStep();
+}
+
+// shoot.c (starting at the moment of releasing the catapult):
+
+#define _SCENE_CATAPULT_HEIGHT (TPE_F * 2)
+#define _SCENE_CATAPULT_WIDTH (3 * TPE_F / 2)
+#define _SCENE_BALL_RADIUS (2 * TPE_F / 5)
+
+uint8_t _scene_shootHit;
+
+uint8_t _scene_shootCollision(uint16_t b1, uint16_t j1, uint16_t b2,
+  uint16_t j2, TPE_Vec3 p)
+{
+  return !((b1 == 0 && b2 == 1) || (b2 == 1 && b1 == 0));
+}
+
+TPE_Vec3 _scene_shootEnv(TPE_Vec3 p, TPE_Unit maxD)
+{
+  return TPE_envGround(p,0);
+}
+
+void _scene_shootInit(void)
+{
+  scene_world.environmentFunction = _scene_shootEnv;
+  scene_world.collisionCallback = _scene_shootCollision;
+  _scene_shootHit = 0;
+
+  TPE_Joint *j = scene_joints + scene_jointsUsed;
+  TPE_Connection *c = scene_connections + scene_connectionsUsed;
+
+  j[0] = TPE_joint(TPE_vec3(0,_SCENE_CATAPULT_HEIGHT,
+    _SCENE_CATAPULT_WIDTH / 2),10);
+  j[1] = TPE_joint(TPE_vec3(0,_SCENE_CATAPULT_HEIGHT,0),10);
+  j[2] = TPE_joint(TPE_vec3(0,_SCENE_CATAPULT_HEIGHT,
+    -1 * _SCENE_CATAPULT_WIDTH / 2),10);
+
+  c[0].joint1 = 0; c[0].joint2 = 1;
+  c[1].joint1 = 1; c[1].joint2 = 2;
+
+  _scene_bodyAdded(3,2,10);
+
+  j[1].position.x -= 2 * TPE_F; // pulled back
+  j[1].position.y -= TPE_F / 2;
+
+  scene_lastBody.flags |= TPE_BODY_FLAG_SOFT | TPE_BODY_FLAG_SIMPLE_CONN;
+
+  scene_addBall(_SCENE_BALL_RADIUS,2 * TPE_F);
+  scene_lastBody.joints[0].position = j[1].position;
+
+  scene_addCenterBox(TPE_F,TPE_F,3 * TPE_F / 2,2 * TPE_F / 5,TPE_F);
+  scene_lastBody.joints[8].sizeDivided *= 2;
+  TPE_bodyMoveBy(&scene_lastBody,
+    TPE_vec3(8 * TPE_F,6 * TPE_F / 5,-6 * TPE_F / 5));
+  TPE_bodyDeactivate(&scene_lastBody);
+
+  scene_addCenterBox(TPE_F,TPE_F,3 * TPE_F / 2,2 * TPE_F / 5,TPE_F);
+  scene_lastBody.joints[8].sizeDivided *= 2;
+  TPE_bodyMoveBy(&scene_lastBody,
+    TPE_vec3(8 * TPE_F,6 * TPE_F / 5,6 * TPE_F / 5));
+  TPE_bodyDeactivate(&scene_lastBody);
+
+  scene_addCenterRect(TPE_F,3 * TPE_F,TPE_F / 2,TPE_F);
+  scene_lastBody.joints[4].sizeDivided *= 3;
+  scene_lastBody.joints[4].sizeDivided /= 2;
+  TPE_bodyMoveBy(&scene_lastBody,TPE_vec3(8 * TPE_F,3 * TPE_F - TPE_F / 4,0));
+  TPE_bodyDeactivate(&scene_lastBody);
+
+  scene_addCenterBox(6 * TPE_F / 5,6 * TPE_F / 5,2 * TPE_F - TPE_F / 6,
+    TPE_F / 3,TPE_F);
+  scene_lastBody.joints[8].sizeDivided *= 2;
+  TPE_bodyMoveBy(&scene_lastBody,TPE_vec3(8 * TPE_F,4 * TPE_F + TPE_F / 3,0));
+  TPE_bodyDeactivate(&scene_lastBody);
+}
+
+void _scene_shootFrame(void)
+{
+  TPE_Joint *pull = &scene_world.bodies[0].joints[1];
+
+  scene_jointPin(0,0,TPE_vec3(0,_SCENE_CATAPULT_HEIGHT,
+    _SCENE_CATAPULT_WIDTH / 2));
+  scene_jointPin(0,2,TPE_vec3(0,_SCENE_CATAPULT_HEIGHT,
+    -1 * _SCENE_CATAPULT_WIDTH / 2));
+
+  for (int i = 1; i < scene_world.bodyCount; ++i)
+    scene_applyGravity(i,6);
+
+  scene_multiplyNetSpeed(0,(19 * TPE_F) / 20);
+
+  if (scene_world.bodies[1].joints[0].position.x < 0) // ball still in catapult
+  {
+    scene_jointPin(1,0,pull->position);
+    scene_jointVelocity(1,0,
+      TPE_vec3(pull->velocity[0],pull->velocity[1],pull->velocity[2]));
+  }
+  else if (!_scene_shootHit)
+    for (int i = 2; i < scene_world.bodyCount; ++i)
+      if (TPE_bodyIsActive(&scene_world.bodies[i]))
+      {
+        for (int j = 0; j < scene_world.bodyCount; ++j) // activate all
+          scene_accelerate(j,TPE_vec3(0,0,0));
+
+        _scene_shootHit = 1;
+        break;
+      }
+
+  scene_worldStep();
+}
+
+// player.c (walking forward while turning, jumping regularly):
+
+TPE_Unit _scene_playerRamp[6] = { 1600,0, -500,1400, -700,0 };
+TPE_Unit _scene_playerRamp2[6] = { 2000,-5000, 1500,1700, -5000,-500 };
+
+#define _scene_playerElevatorHeight scene_parameters[0]
+
+int _scene_playerJumpCountdown;
+TPE_Unit _scene_playerRotation;
+
+TPE_Vec3 _scene_playerEnv(TPE_Vec3 p, TPE_Unit maxD)
+{
+  TPE_ENV_START( TPE_envAABoxInside(p,TPE_vec3(0,2450,-2100),TPE_vec3(12600,5000,10800)),p )
+  TPE_ENV_NEXT( TPE_envAABox(p,TPE_vec3(-5693,0,-6580),TPE_vec3(4307,20000,3420)),p )
+  TPE_ENV_NEXT( TPE_envAABox(p,TPE_vec3(-10000,-1000,-10000),TPE_vec3(11085,2500,9295)),p )
+  TPE_ENV_NEXT( TPE_envAATriPrism(p,TPE_vec3(-5400,0,0),_scene_playerRamp,3000,2), p)
+  TPE_ENV_NEXT( TPE_envAATriPrism(p,TPE_vec3(2076,651,-6780),_scene_playerRamp2,3000,0), p)
+  TPE_ENV_NEXT( TPE_envAABox(p,TPE_vec3(7000,0,-8500),TPE_vec3(3405,2400,3183)),p )
+  TPE_ENV_NEXT( TPE_envSphere(p,TPE_vec3(2521,-100,-3799),1200),p )
+  TPE_ENV_NEXT( TPE_envAABox(p,TPE_vec3(5300,_scene_playerElevatorHeight,-4400),TPE_vec3(1000,_scene_playerElevatorHeight,1000)),p )
+  TPE_ENV_NEXT( TPE_envHalfPlane(p,TPE_vec3(5051,0,1802),TPE_vec3(-255,0,-255)),p )
+  TPE_ENV_NEXT( TPE_envInfiniteCylinder(p,TPE_vec3(320,0,170),TPE_vec3(0,255,0),530),p )
+  TPE_ENV_END
+}
+
+void _scene_playerInit(void)
+{
+  scene_world.environmentFunction = _scene_playerEnv;
+
+  _scene_playerJumpCountdown = 0;
+  _scene_playerRotation = 0;
+
+  scene_add2Line(400,300,400);
+
+  TPE_Body *player = &scene_lastBody;
+
+  TPE_bodyMoveBy(player,TPE_vec3(1000,1000,1500));
+  TPE_bodyRotateByAxis(player,TPE_vec3(0,0,TPE_F / 4));
+  player->elasticity = 0;
+  player->friction = 0;
+  player->flags |= TPE_BODY_FLAG_NONROTATING | TPE_BODY_FLAG_ALWAYS_ACTIVE;
+
+  scene_addBall(1000,100);
+  TPE_bodyMoveBy(&scene_lastBody,TPE_vec3(-1000,1000,0));
+  scene_lastBody.elasticity = 400;
+  scene_lastBody.friction = 100;
+
+  scene_addCenterRect(600,600,400,50);
+  TPE_bodyMoveBy(&scene_lastBody,TPE_vec3(-3000,1000,2000));
+  scene_lastBody.elasticity = 100;
+  scene_lastBody.friction = 50;
+}
+
+void _scene_playerFrame(void)
+{
+  TPE_Body *player = &scene_world.bodies[0];
+  TPE_Unit groundDist = TPE_JOINT_SIZE(player->joints[0]) + 30;
+
+  if (_scene_playerJumpCountdown > 0)
+    _scene_playerJumpCountdown--;
+
+  TPE_Vec3 groundPoint = _scene_playerEnv(player->joints[0].position,
+    groundDist);
+
+  int onGround = (player->flags & TPE_BODY_FLAG_DEACTIVATED) ||
+    (TPE_DISTANCE(player->joints[0].position,groundPoint) <= groundDist &&
+    groundPoint.y < player->joints[0].position.y - groundDist / 2);
+
+  if (!onGround)
+    onGround = TPE_DISTANCE(player->joints[0].position,
+      TPE_castEnvironmentRay(player->joints[0].position,
+      TPE_vec3(0,-1 * TPE_F,0),_scene_playerEnv,128,512,512)) <= groundDist;
+
+  scene_setParameter(0,
+    (1250 * (TPE_sin(scene_frame * 4) + TPE_F)) / (2 * TPE_F));
+
+  scene_multiplyNetSpeed(0,onGround ? 300 : 505);
+
+  for (int i = 0; i < scene_world.bodyCount; ++i)
+    scene_applyGravity(i,5);
+
+  if (onGround)
+  {
+    TPE_Vec3 dir = TPE_vec3(TPE_sin(_scene_playerRotation) / 15,0,
+      TPE_cos(_scene_playerRotation) / 15);
+
+    if (scene_frame % 90 == 45 && _scene_playerJumpCountdown == 0)
+    {
+      scene_jointVelocity(0,0,TPE_vec3(player->joints[0].velocity[0],90,
+        player->joints[0].velocity[2]));
+
+      _scene_playerJumpCountdown = 8;
+    }
+
+    scene_jointAddVelocity(0,0,dir);
+  }
+
+  _scene_playerRotation += 3;
+
+  scene_worldStep();
+}
+
+// envaccel.c (the demo has no bodies, here some are dropped into the
+// environment to exercise it):
+
+TPE_Vec3 _scene_envaccelEnv(TPE_Vec3 p, TPE_Unit maxD)
+{
+  TPE_ENV_START( TPE_envAABoxInside(p,TPE_vec3(0,0,0),TPE_vec3(30000,30000,30000)), p )
+
+  for (int bigZ = -1; bigZ < 1; ++bigZ)
+    for (int bigY = -1; bigY < 1; ++bigY)
+      for (int bigX = -1; bigX < 1; ++bigX)
+      {
+        TPE_Vec3 bigCenter =
+        TPE_vec3(bigX * 20 * TPE_F,bigY * 20 * TPE_F,bigZ * 20 * TPE_F);
+
+        if (TPE_ENV_BCUBE_TEST(p,maxD,bigCenter,20 * TPE_F))
+          for (int smallZ = 0; smallZ < 2; ++smallZ)
+            for (int smallY = 0; smallY < 2; ++smallY)
+              for (int smallX = 0; smallX < 2; ++smallX)
+              {
+                TPE_Vec3 smallCenter = TPE_vec3Plus(bigCenter,
+                  TPE_vec3(smallX * 8 * TPE_F,smallY * 8 * TPE_F,smallZ * 8 * TPE_F));
+
+                if (TPE_ENV_BSPHERE_TEST(p,maxD,smallCenter,8 * TPE_F))
+                {
+                  TPE_ENV_NEXT( TPE_envBox(p,smallCenter,TPE_vec3(2 * TPE_F,4 * TPE_F / 3,4 * TPE_F / 3),
+                    TPE_vec3(TPE_F / 100,TPE_F / 20,TPE_F / 15)), p );
+
+                  TPE_ENV_NEXT( TPE_envCylinder(p,smallCenter,TPE_vec3(TPE_F * 4,TPE_F * 3,3 * TPE_F / 4),3 * TPE_F / 4), p);
+                  TPE_ENV_NEXT( TPE_envSphere(p,TPE_vec3Minus(smallCenter,TPE_vec3(-3 * TPE_F / 4,TPE_F,0)), 2 * TPE_F  )  , p );
+                }
+              }
+      }
+
+  TPE_ENV_END
+}
+
+void _scene_envaccelInit(void)
+{
+  scene_world.environmentFunction = _scene_envaccelEnv;
+
+  for (int i = 0; i < 8; ++i)
+  {
+    if (i % 2)
+      scene_addBox(TPE_F,TPE_F,TPE_F,TPE_F / 3,TPE_F);
+    else
+      scene_addBall(TPE_F / 2,TPE_F);
+
+    TPE_bodyMoveBy(&scene_lastBody,TPE_vec3(((i % 4) - 2) * 5 * TPE_F + TPE_F,
+      2 * TPE_F,((i / 4) - 1) * 5 * TPE_F + TPE_F));
+  }
+}
+
+void _scene_envaccelFrame(void)
+{
+  for (int i = 0; i < scene_world.bodyCount; ++i)
+    scene_applyGravity(i,5);
+
+  scene_worldStep();
+}
+
+// heightmap.c (the box is driven in a square):
+
+#define _SCENE_HEIGHTMAP_RESOLUTION 32
+#define _SCENE_HEIGHTMAP_STEP (TPE_F * 2)
+#define _SCENE_HEIGHTMAP_LIMIT \
+  ((_SCENE_HEIGHTMAP_RESOLUTION * _SCENE_HEIGHTMAP_STEP) / 2)
+
+TPE_Unit _scene_heightmapHeight(int32_t x, int32_t y)
+{
+  x *= 8;
+  y *= 8;
+
+  return
+    TPE_sin(x + TPE_cos(y * 2)) * TPE_sin(y * 2 + TPE_cos(x * 4)) / (TPE_F / 2);
+}
+
+TPE_Vec3 _scene_heightmapEnv(TPE_Vec3 p, TPE_Unit maxD)
+{
+  return TPE_envHeightmap(p,TPE_vec3(0,0,0),_SCENE_HEIGHTMAP_STEP,
+    _scene_heightmapHeight,maxD);
+}
+
+void _scene_heightmapInit(void)
+{
+  scene_world.environmentFunction = _scene_heightmapEnv;
+
+  scene_addBox(700,700,700,300,1000);
+  TPE_bodyMoveTo(&scene_lastBody,TPE_vec3(0,5000,0));
+}
+
+void _scene_heightmapFrame(void)
+{
+  TPE_Vec3 c = TPE_bodyGetCenterOfMass(&scene_world.bodies[0]);
+
+  if (c.x < -1 * _SCENE_HEIGHTMAP_LIMIT)
+    scene_bodyMoveBy(0,TPE_vec3(2 * _SCENE_HEIGHTMAP_LIMIT,TPE_F,0));
+  else if (c.x > _SCENE_HEIGHTMAP_LIMIT)
+    scene_bodyMoveBy(0,TPE_vec3(-2 * _SCENE_HEIGHTMAP_LIMIT,TPE_F,0));
+
+  if (c.z < -1 * _SCENE_HEIGHTMAP_LIMIT)
+    scene_bodyMoveBy(0,TPE_vec3(0,TPE_F,2 * _SCENE_HEIGHTMAP_LIMIT));
+  else if (c.z > _SCENE_HEIGHTMAP_LIMIT)
+    scene_bodyMoveBy(0,TPE_vec3(0,TPE_F,-2 * _SCENE_HEIGHTMAP_LIMIT));
+
+  scene_applyGravity(0,7);
+
+  switch ((scene_frame / 60) % 4)
+  {
+    case 0: scene_accelerate(0,TPE_vec3(0,0,TPE_F / 50)); break;
+    case 1: scene_accelerate(0,TPE_vec3(TPE_F / 50,0,0)); break;
+    case 2: scene_accelerate(0,TPE_vec3(0,0,-1 * TPE_F / 50)); break;
+    case 3: scene_accelerate(0,TPE_vec3(-1 * TPE_F / 50,0,0)); break;
+    default: break;
+  }
+
+  scene_worldStep();
+}
+
+typedef struct
+{
+  const char *name;
+  void (*init)(void);
+  void (*frame)(void);
+} Scene;
+
+Scene scenes[] =
+{
+  {"stack", _scene_stackInit, _scene_stackFrame},
+  {"cubes", _scene_cubesInit, _scene_cubesFrame},
+  {"water", _scene_waterInit, _scene_waterFrame},
+  {"car", _scene_carInit, _scene_carFrame},
+  {"shoot", _scene_shootInit, _scene_shootFrame},
+  {"player", _scene_playerInit, _scene_playerFrame},
+  {"envaccel", _scene_envaccelInit, _scene_envaccelFrame},
+  {"heightmap", _scene_heightmapInit, _scene_heightmapFrame}
+};
+
+#define SCENE_COUNT ((int) (sizeof(scenes) / sizeof(Scene)))
+
+/** Builds the scene with given index into scene_world. */
+void scene_init(int index)
+{
+  scene_jointsUsed = 0;
+  scene_connectionsUsed = 0;
+  scene_frame = 0;
+
+  for (int i = 0; i < 4; ++i)
+    scene_parameters[i] = 0;
+
+  TPE_worldInit(&scene_world,scene_bodies,0,0);
+
+  scenes[index].init();
+}
+
+/** Simulates one frame of the scene with given index. */
+void scene_step(int index)
+{
+  scenes[index].frame();
+  scene_frame++;
+}
+
+/** Returns the index of a scene with given name or -1. */
+int scene_find(const char *name)
+{
+  for (int i = 0; i < SCENE_COUNT; ++i)
+    if (strcmp(scenes[i].name,name) == 0)
+      return i;
+
+  return -1;
+}
+
+#endif // guard
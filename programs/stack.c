@@ -31,6 +31,11 @@ int main(void)
 
   tpe_world.environmentFunction = environmentDistance;
 
+  TPE_ForceField gravity =
+    TPE_forceField(TPE_FORCE_FIELD_ACCELERATION,TPE_vec3(0,(-5 * 30) / FPS,0),0);
+
+  TPE_worldSetForceFields(&tpe_world,&gravity,1);
+
   s3l_scene.camera.transform.translation.y = 6000;
   s3l_scene.camera.transform.translation.z = -2000;
   s3l_scene.camera.transform.rotation.x = -70;
@@ -84,8 +89,6 @@ int main(void)
 
     for (int i = 0; i < tpe_world.bodyCount; ++i)
     {
-      TPE_bodyApplyGravity(&tpe_world.bodies[i],(5 * 30) / FPS);
-
       TPE_Joint *joints = tpe_world.bodies[i].joints;
       TPE_Vec3 pos = TPE_bodyGetCenterOfMass(&tpe_world.bodies[i]);
       TPE_Vec3 right = TPE_vec3(512,0,0);
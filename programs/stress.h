@@ -0,0 +1,231 @@
+/**
+  Procedural stress scene generator: builds worlds of arbitrary number of
+  bodies (random mix of boxes, center rects, balls and 2-lines) in one of
+  several arrangements and environments, everything determined by a seed.
+  Meant for scaling benchmarks (how step time grows with the number of
+  bodies) and for stress testing.
+
+  The world's size grows with the body count so that the density stays about
+  the same for any count.
+*/
+
+#ifndef _STRESS_H
+#define _STRESS_H
+
+#include "../tinyphysicsengine.h"
+#include <stdlib.h>
+
+#define STRESS_PILE 0  ///< dense 3D grid of bodies falling into a heap
+#define STRESS_GRID 1  ///< one layer of bodies spread on a grid
+#define STRESS_RAIN 2  ///< bodies falling from different heights
+#define STRESS_STACK 3 ///< columns of stacked boxes (boxes only)
+#define STRESS_ARRANGEMENTS 4
+
+#define STRESS_ENV_GROUND 0 ///< infinite flat ground
+#define STRESS_ENV_BOX 1    ///< inside of a box
+#define STRESS_ENV_BOWL 2   ///< inside of a big sphere
+#define STRESS_ENVIRONMENTS 3
+
+#define STRESS_CELL (3 * TPE_F) ///< spacing of bodies
+#define STRESS_GRAVITY 5
+
+const char *stress_arrangementNames[STRESS_ARRANGEMENTS] =
+  {"pile","grid","rain","stack"};
+
+const char *stress_environmentNames[STRESS_ENVIRONMENTS] =
+  {"ground","box","bowl"};
+
+typedef struct
+{
+  TPE_World world;
+  TPE_Body *bodies;
+  TPE_Joint *joints;
+  TPE_Connection *connections;
+  uint32_t jointCount;
+  uint32_t connectionCount;
+} StressScene;
+
+uint32_t _stress_random;
+TPE_Unit _stress_size; // half of the world's width
+
+uint32_t _stress_randomNumber(void)
+{
+  _stress_random ^= _stress_random << 13; // xorshift32
+  _stress_random ^= _stress_random >> 17;
+  _stress_random ^= _stress_random << 5;
+  return _stress_random;
+}
+
+TPE_Unit _stress_randomRange(TPE_Unit from, TPE_Unit to)
+{
+  return from + (TPE_Unit) (_stress_randomNumber() % ((uint32_t) (to - from)));
+}
+
+TPE_Vec3 _stress_envGround(TPE_Vec3 p, TPE_Unit maxD)
+{
+  return TPE_envGround(p,0);
+}
+
+TPE_Vec3 _stress_envBox(TPE_Vec3 p, TPE_Unit maxD)
+{
+  return TPE_envAABoxInside(p,TPE_vec3(0,_stress_size,0),
+    TPE_vec3(2 * _stress_size,2 * _stress_size,2 * _stress_size));
+}
+
+TPE_Vec3 _stress_envBowl(TPE_Vec3 p, TPE_Unit maxD)
+{
+  return TPE_envSphereInside(p,TPE_vec3(0,2 * _stress_size,0),
+    2 * _stress_size);
+}
+
+void _stress_addBody(StressScene *scene, uint8_t shape, TPE_Vec3 position)
+{
+  TPE_Joint *j = scene->joints + scene->jointCount;
+  TPE_Connection *c = scene->connections + scene->connectionCount;
+  uint8_t joints, connections;
+
+  switch (shape)
+  {
+    case 0:
+      TPE_makeBox(j,c,TPE_F,TPE_F,TPE_F,TPE_F / 3);
+      joints = 8; connections = 16;
+      break;
+
+    case 1:
+      TPE_makeCenterRect(j,c,2 * TPE_F,TPE_F,TPE_F / 3);
+      joints = 5; connections = 8;
+      break;
+
+    case 2:
+      j[0] = TPE_joint(TPE_vec3(0,0,0),TPE_F / 2);
+      joints = 1; connections = 0;
+      break;
+
+    default:
+      TPE_make2Line(j,c,2 * TPE_F,TPE_F / 3);
+      joints = 2; connections = 1;
+      break;
+  }
+
+  TPE_Body *b = scene->bodies + scene->world.bodyCount;
+
+  TPE_bodyInit(b,j,joints,c,connections,TPE_F);
+  TPE_bodyMoveBy(b,position);
+
+  scene->jointCount += joints;
+  scene->connectionCount += connections;
+  scene->world.bodyCount++;
+}
+
+/** Builds a scene of bodyCount bodies with given arrangement (STRESS_*),
+  environment (STRESS_ENV_*) and seed. Memory is allocated, free it with
+  stress_free. Returns 1 on success, 0 if memory couldn't be allocated (then
+  nothing stays allocated). Only one scene can exist at a time (environments
+  use a global size). */
+int stress_generate(StressScene *scene, uint16_t bodyCount,
+  uint8_t arrangement, uint8_t environment, uint32_t seed)
+{
+  _stress_random = seed != 0 ? seed : 1;
+
+  scene->bodies = malloc(bodyCount * sizeof(TPE_Body));
+  scene->joints = malloc(bodyCount * 8 * sizeof(TPE_Joint));
+  scene->connections = malloc(bodyCount * 16 * sizeof(TPE_Connection));
+  scene->jointCount = 0;
+  scene->connectionCount = 0;
+
+  if (!scene->bodies || !scene->joints || !scene->connections)
+  {
+    // free what was allocated, zeroed so that a stress_free call is harmless
+    free(scene->bodies);
+    free(scene->joints);
+    free(scene->connections);
+    scene->bodies = 0;
+    scene->joints = 0;
+    scene->connections = 0;
+    return 0;
+  }
+
+  TPE_ClosestPointFunction env = environment == STRESS_ENV_BOX ?
+    _stress_envBox : (environment == STRESS_ENV_BOWL ? _stress_envBowl :
+    _stress_envGround);
+
+  TPE_worldInit(&scene->world,scene->bodies,0,env);
+
+  /* the side of the bodies' footprint (in cells), arrangements with more
+     bodies in a column have smaller footprint */
+
+  int side = 1, layers = arrangement == STRESS_PILE ? 4 :
+    (arrangement == STRESS_STACK ? 8 : 1);
+
+  while (side * side * layers < bodyCount)
+    side++;
+
+  _stress_size = (side + 2) * STRESS_CELL;
+
+  if (arrangement == STRESS_PILE)
+    _stress_size *= 2; // leave space for the heap to spread
+
+  for (uint16_t i = 0; i < bodyCount; ++i)
+  {
+    int column = i / layers, layer = i % layers;
+
+    TPE_Vec3 p = TPE_vec3(
+      ((column % side) - side / 2) * STRESS_CELL,
+      TPE_F + layer * STRESS_CELL,
+      ((column / side) - side / 2) * STRESS_CELL);
+
+    uint8_t shape = _stress_randomNumber() % 4;
+
+    switch (arrangement)
+    {
+      case STRESS_PILE:
+        p.x += _stress_randomRange(-1 * TPE_F / 4,TPE_F / 4);
+        p.y += 2 * TPE_F;
+        p.z += _stress_randomRange(-1 * TPE_F / 4,TPE_F / 4);
+        break;
+
+      case STRESS_RAIN:
+        p.y += _stress_randomRange(0,4 * _stress_size / 3);
+        break;
+
+      case STRESS_STACK:
+        shape = 0;
+        p.y = TPE_F / 2 + layer * (TPE_F + 2 * TPE_F / 3);
+        break;
+
+      default: break;
+    }
+
+    _stress_addBody(scene,shape,p);
+
+    TPE_Body *b = &scene->world.bodies[scene->world.bodyCount - 1];
+
+    if (arrangement == STRESS_PILE || arrangement == STRESS_RAIN)
+      TPE_bodyRotateByAxis(b,TPE_vec3(_stress_randomRange(0,TPE_F),
+        _stress_randomRange(0,TPE_F),_stress_randomRange(0,TPE_F)));
+
+    if (arrangement == STRESS_RAIN)
+      TPE_bodyAccelerate(b,TPE_vec3(_stress_randomRange(-20,20),
+        _stress_randomRange(-60,0),_stress_randomRange(-20,20)));
+  }
+
+  return 1;
+}
+
+/** Steps a stress scene, including applying gravity. */
+void stress_step(StressScene *scene)
+{
+  for (uint16_t i = 0; i < scene->world.bodyCount; ++i)
+    TPE_bodyApplyGravity(&scene->world.bodies[i],STRESS_GRAVITY);
+
+  TPE_worldStep(&scene->world);
+}
+
+void stress_free(StressScene *scene)
+{
+  free(scene->bodies);
+  free(scene->joints);
+  free(scene->connections);
+}
+
+#endif // guard
@@ -1,6 +1,10 @@
 /** General automatic test for tinyphysicsengine, this should always be run
   and passed before publishing a new version of TPE. */
 
+#ifndef TPE_STATS
+  #define TPE_STATS 1 // test the statistics as well
+#endif
+
 #include "../tinyphysicsengine.h"
 #include <stdio.h>
 
@@ -68,11 +72,40 @@ TPE_Unit heightMap(int32_t x, int32_t y)
      (TPE_FRACTIONS_PER_UNIT / 2);
 }
 
+uint32_t drawHash = 0, envCalls = 0;
+
+void drawPixel(uint16_t x, uint16_t y, uint8_t c)
+{
+  drawHash = (drawHash * 31 + x * 7 + y * 13 + c) % 1000000007;
+}
+
+TPE_Vec3 envCounted(TPE_Vec3 p, TPE_Unit maxD)
+{
+  envCalls++;
+  return envFunc(p,maxD);
+}
+
 TPE_Vec3 envFuncHeightmap(TPE_Vec3 p, TPE_Unit maxD)
 {
   return TPE_envHeightmap(p,TPE_vec3(10,20,30),500,heightMap,maxD);
 }
 
+TPE_Vec3 envFuncCharacter(TPE_Vec3 p, TPE_Unit maxD)
+{
+  TPE_ENV_START( TPE_envGround(p,0),p )
+  TPE_ENV_NEXT( TPE_envAABox(p,TPE_vec3(2000,100,0),TPE_vec3(500,100,1000)),p )
+  TPE_ENV_NEXT( TPE_envHalfPlane(p,TPE_vec3(-3000,0,0),TPE_vec3(400,200,0)),p )
+  TPE_ENV_END
+}
+
+TPE_Vec3 envFuncWall(TPE_Vec3 p, TPE_Unit maxD)
+{
+  TPE_ENV_START( TPE_envAABoxInside(p,TPE_vec3(0,0,0),
+    TPE_vec3(1500,800,1500)),p )
+  TPE_ENV_NEXT( TPE_envAABox(p,TPE_vec3(1200,-600,0),TPE_vec3(300,300,300)),p )
+  TPE_ENV_END
+}
+
 int main(void)
 {
   puts("== testing tinyphysicsengine ==");
@@ -216,8 +249,19 @@ int main(void)
 
     puts("dropping bodies onto a ramp...");
 
+    TPE_Joint snapshot[64 + 1]; // + 1 for the body bytes
+
+    TPE_BodyHashCache bodyHashes[4];
+    TPE_WorldHashCache hashCache;
+
+    TPE_worldHashCacheInit(&hashCache,bodyHashes,&w);
+
     for (int i = 0; i < 300; ++i)
     {
+      if (i == 150)
+        ass(TPE_worldSnapshot(&w,snapshot) == TPE_worldSnapshotSize(&w),
+          "snapshot size");
+
       for (uint8_t j = 0; j < w.bodyCount; ++j)
         TPE_bodyApplyGravity(&w.bodies[j],8);
 
@@ -225,10 +269,58 @@ int main(void)
         ass(TPE_worldGetNetSpeed(&w) > 100,"world net speed");
 
       TPE_worldStep(&w);
+      TPE_worldHashCacheUpdate(&hashCache,&w);
     }
 
     puts("simulation finished");
 
+    {
+      uint32_t incrementalHash = hashCache.hash;
+
+      TPE_worldHashCacheInit(&hashCache,bodyHashes,&w);
+
+      ass(hashCache.hash == incrementalHash,"incremental world hash");
+
+      uint32_t tree1[TPE_HASH_TREE_SIZE(4)], tree2[TPE_HASH_TREE_SIZE(4)];
+
+      uint32_t leaves = TPE_worldHashTree(&w,tree1);
+
+      TPE_bodyMoveBy(&w.bodies[2],TPE_vec3(0,1,0)); // sleeping body
+      TPE_worldHashCacheBodyChanged(&hashCache,&w,2);
+
+      ass(hashCache.hash != incrementalHash,"incremental world hash change");
+
+      TPE_worldHashTree(&w,tree2);
+
+      ass(leaves == 4 && tree1[1] != tree2[1] &&
+        TPE_hashTreeFirstDifference(tree1,tree2,leaves) == 2,"hash tree");
+
+      TPE_bodyMoveBy(&w.bodies[2],TPE_vec3(0,-1,0));
+    }
+
+    {
+      // more than 32768 bodies need 65536 leaves
+
+      static TPE_Body bodies[40000];
+      static uint32_t tree1[TPE_HASH_TREE_SIZE(40000)],
+        tree2[TPE_HASH_TREE_SIZE(40000)];
+      TPE_World w2;
+      TPE_Joint joint = TPE_joint(TPE_vec3(0,0,0),100);
+
+      for (int i = 0; i < 40000; ++i)
+        TPE_bodyInit(bodies + i,&joint,1,0,0,TPE_F);
+
+      TPE_worldInit(&w2,bodies,40000,0);
+
+      uint32_t leaves = TPE_worldHashTree(&w2,tree1);
+      bodies[39000].flags |= TPE_BODY_FLAG_DEACTIVATED;
+      TPE_worldHashTree(&w2,tree2);
+
+      ass(leaves == 65536 &&
+        TPE_hashTreeFirstDifference(tree1,tree2,leaves) == 39000,
+        "big hash tree");
+    }
+
     uint32_t hash = TPE_worldHash(&w);
 
     printf("world hash: %lu\n",hash);
@@ -237,6 +329,21 @@ int main(void)
 
     ass(hash == 3411004027,"world hash");
 
+    // roll back and resimulate, must end up in the same state:
+
+    ass(TPE_worldRestore(&w,snapshot) == TPE_worldSnapshotSize(&w),
+      "snapshot restore");
+
+    for (int i = 150; i < 300; ++i)
+    {
+      for (uint8_t j = 0; j < w.bodyCount; ++j)
+        TPE_bodyApplyGravity(&w.bodies[j],8);
+
+      TPE_worldStep(&w);
+    }
+
+    ass(TPE_worldHash(&w) == hash,"world hash after rollback");
+
     for (int i = 0; i < w.bodyCount; ++i)
     {
       ass(TPE_bodyGetCenterOfMass(&w.bodies[i]).x > 0,"x position > 0");
@@ -252,6 +359,14 @@ int main(void)
 
     puts("exploding bodies...");
 
+#if TPE_STATS
+    TPE_WorldStats stats;
+    uint64_t bodyTimes[4] = {0, 0, 0, 0};
+
+    TPE_worldStatsInit(&stats,bodyTimes);
+    w.stats = &stats;
+#endif
+
     for (int i = 0; i < 100; ++i)
     {
       for (uint8_t j = 0; j < w.bodyCount; ++j)
@@ -260,6 +375,66 @@ int main(void)
       TPE_worldStep(&w);
     }
 
+#if TPE_STATS
+    w.stats = 0;
+
+    ass(stats.steps == 100 && stats.environmentCalls > 0 &&
+      stats.environmentContacts > 0 && stats.aabbTests > 0 &&
+      stats.phaseCounts[TPE_STATS_PHASE_INTEGRATE] > 0,"world stats");
+
+    ass(stats.topBodyTimes[0] >= stats.topBodyTimes[1] &&
+      bodyTimes[stats.topBodies[0]] > 0,"world stats top bodies");
+#endif
+
+    // delta encode two consecutive states and decode them back:
+
+    uint8_t delta[TPE_DELTA_MAX_SIZE(64,4)];
+    TPE_Joint snapshot2[64 + 1], decoded[64 + 1];
+
+    TPE_worldSnapshot(&w,snapshot);
+    uint32_t keySize = TPE_snapshotEncodeDelta(&w,0,snapshot,delta);
+
+    ass(TPE_snapshotDecodeDelta(&w,0,delta,keySize - 1,decoded) == 0 &&
+      TPE_snapshotDecodeDelta(&w,0,delta,keySize,decoded) == keySize,
+      "truncated delta rejected");
+
+    TPE_worldStep(&w);
+    hash = TPE_worldHash(&w);
+    TPE_worldSnapshot(&w,snapshot2);
+
+    uint32_t deltaSize = TPE_snapshotEncodeDelta(&w,snapshot,snapshot2,delta);
+
+    ass(deltaSize < keySize,"delta smaller than keyframe");
+
+    TPE_snapshotDecodeDelta(&w,decoded,delta,deltaSize,decoded);
+    TPE_worldRestore(&w,decoded);
+
+    ass(TPE_worldHash(&w) == hash,"decoded delta");
+
+    // record inputs, roll back and replay them from the log:
+
+    uint8_t logData[1024];
+    TPE_InputLog inputLog;
+
+    TPE_inputLogInit(&inputLog,logData,sizeof(logData),5);
+    TPE_worldSnapshot(&w,snapshot);
+
+    for (int i = 0; i < 20; ++i)
+    {
+      TPE_inputLogAccelerate(&inputLog,&w,i % 4,TPE_vec3(0,20,i));
+
+      for (uint8_t j = 0; j < w.bodyCount; ++j)
+        TPE_inputLogApplyGravity(&inputLog,&w,j,8);
+
+      ass(TPE_inputLogStep(&inputLog,&w),"input log step");
+    }
+
+    hash = TPE_worldHash(&w);
+    TPE_worldRestore(&w,snapshot);
+
+    ass(TPE_inputLogReplay(&inputLog,&w,0,20) == -1 &&
+      TPE_worldHash(&w) == hash,"input log replay");
+
     // check if within environment
 
     for (int i = 0; i < w.bodyCount; ++i)
@@ -305,6 +480,549 @@ int main(void)
 
   }
 
+  {
+    TPE_World w;
+    TPE_Vec3 samples[8 * 8 * 8];
+    TPE_DebugDrawCache cache;
+    uint32_t calls = 0;
+    int same = 1;
+
+    TPE_worldInit(&w,0,0,envCounted);
+    TPE_debugDrawCacheInit(&cache,samples,8,400);
+
+    for (int i = 0; i < 10; ++i)
+    {
+      TPE_Vec3 camPos = TPE_vec3(i * 250 - 1000,-500,-2000 + i * 97);
+      uint32_t h;
+
+      drawHash = 0;
+      TPE_worldDebugDraw(&w,drawPixel,camPos,TPE_vec3(0,i * 10,0),
+        TPE_vec3(320,240,TPE_F),8,400);
+      h = drawHash;
+
+      drawHash = 0;
+      envCalls = 0;
+      TPE_worldDebugDrawCached(&w,drawPixel,camPos,TPE_vec3(0,i * 10,0),
+        TPE_vec3(320,240,TPE_F),&cache);
+      calls += envCalls;
+
+      same = same && h == drawHash;
+    }
+
+    ass(same && calls < 10 * 8 * 8 * 8 / 2,"cached debug draw");
+  }
+
+  {
+    TPE_World w;
+    TPE_Body b;
+    TPE_Joint j[8];
+    TPE_Connection c[16];
+    TPE_DebugPrimitive p[64];
+    TPE_Vec3 samples[8 * 8 * 8];
+    TPE_DebugDrawCache cache;
+    uint32_t calls;
+
+    TPE_makeBox(j,c,1000,1000,1000,100);
+    TPE_bodyInit(&b,j,8,c,16,TPE_F);
+    TPE_worldInit(&w,&b,1,0);
+
+    uint32_t n = TPE_worldDebugPrimitives(&w,p,64,TPE_vec3(0,0,0),0);
+
+    ass(n == 16 + 8 && p[0].type == TPE_DEBUG_PRIMITIVE_LINE &&
+      p[0].a.x == j[c[0].joint1].position.x &&
+      p[0].b.z == j[c[0].joint2].position.z &&
+      p[16].type == TPE_DEBUG_PRIMITIVE_SPHERE &&
+      p[16].b.x == TPE_JOINT_SIZE(j[0]) &&
+      TPE_worldDebugPrimitives(&w,p,10,TPE_vec3(0,0,0),0) == n,
+      "debug primitives");
+
+    w.environmentFunction = envCounted;
+    TPE_debugDrawCacheInit(&cache,samples,8,400);
+
+    calls = envCalls;
+    n = TPE_worldDebugPrimitives(&w,p,64,TPE_vec3(0,0,0),&cache);
+    calls = envCalls - calls;
+
+    ass(n > 16 + 8 && p[n < 64 ? n - 1 : 63].type ==
+      TPE_DEBUG_PRIMITIVE_POINT && calls == 8 * 8 * 8,
+      "debug primitives environment");
+
+    calls = envCalls;
+
+    ass(TPE_worldDebugPrimitives(&w,p,64,TPE_vec3(100,0,0),&cache) == n &&
+      envCalls == calls,"cached debug primitives");
+  }
+
+  {
+    TPE_World w1, w2;
+    TPE_Body b1[3], b2[3];
+    TPE_Joint j1[10], j2[10];
+    TPE_Connection c1[9], c2[9];
+    TPE_ForceField f[2];
+
+    for (int i = 0; i < 2; ++i)
+    {
+      TPE_Body *b = i ? b2 : b1;
+      TPE_Joint *j = i ? j2 : j1;
+      TPE_Connection *c = i ? c2 : c1;
+
+      j[0] = TPE_joint(TPE_vec3(0,0,0),300);
+      TPE_bodyInit(b,j,1,0,0,TPE_F);
+
+      TPE_makeCenterRect(j + 1,c,1000,1000,200);
+      TPE_bodyInit(b + 1,j + 1,5,c,8,TPE_F);
+      TPE_bodyMoveBy(b + 1,TPE_vec3(3000,0,0));
+
+      TPE_make2Line(j + 6,c + 8,1000,200);
+      TPE_bodyInit(b + 2,j + 6,2,c + 8,1,TPE_F);
+      b[2].flags |= TPE_BODY_FLAG_NONROTATING;
+      TPE_bodyMoveBy(b + 2,TPE_vec3(-3000,0,0));
+    }
+
+    TPE_worldInit(&w1,b1,3,envFuncHeightmap);
+    TPE_worldInit(&w2,b2,3,envFuncHeightmap);
+
+    f[0] = TPE_forceField(TPE_FORCE_FIELD_ACCELERATION,TPE_vec3(0,-5,0),0);
+    TPE_worldSetForceFields(&w2,f,1);
+
+    int same = 1;
+
+    for (int i = 0; i < 100; ++i)
+    {
+      for (int j = 0; j < 3; ++j)
+        TPE_bodyApplyGravity(b1 + j,5);
+
+      TPE_worldStep(&w1);
+      TPE_worldStep(&w2);
+
+      same = same && TPE_worldHash(&w1) == TPE_worldHash(&w2);
+    }
+
+    ass(same,"force field gravity same as TPE_bodyApplyGravity");
+
+    f[1] = TPE_forceField(TPE_FORCE_FIELD_ATTRACTOR,TPE_vec3(0,0,0),10);
+    f[1].volume = TPE_FORCE_VOLUME_SPHERE;
+    f[1].center = TPE_vec3Plus(j2[0].position,TPE_vec3(0,20600,0));
+    f[1].size.x = 1000;
+
+    TPE_worldSetForceFields(&w1,0,0);
+    TPE_worldSetForceFields(&w2,f + 1,1);
+
+    for (int i = 0; i < 2; ++i)
+    {
+      TPE_worldActivateAll(i ? &w2 : &w1);
+      TPE_bodyStop(i ? b2 : b1);
+      TPE_bodyMoveBy(i ? b2 : b1,TPE_vec3(0,20000,0));
+      (i ? b2 : b1)->deactivateCount = 0;
+      TPE_worldStep(i ? &w2 : &w1);
+    }
+
+    ass(j2[0].velocity[0] == 0 && j2[0].velocity[1] == 10 &&
+      TPE_bodyHash(b1 + 1) == TPE_bodyHash(b2 + 1),
+      "force field attractor volume");
+  }
+
+  {
+    TPE_World w;
+    TPE_Body b[3];
+    TPE_Joint j[10];
+    TPE_Connection c[16];
+    TPE_StaticEntry statics[2];
+
+    TPE_makeBox(j,c,1000,1000,1000,200);
+    TPE_bodyInit(b,j,8,c,16,TPE_F);
+    TPE_bodyMoveBy(b,TPE_vec3(0,3000,0));
+
+    j[8] = TPE_joint(TPE_vec3(500,6000,500),300);
+    TPE_bodyInit(b + 1,j + 8,1,0,0,TPE_F);
+
+    j[9] = TPE_joint(TPE_vec3(-5000,3000,0),300);
+    TPE_bodyInit(b + 2,j + 9,1,0,0,TPE_F);
+
+    TPE_worldInit(&w,b,3,envFuncHeightmap);
+
+    ass(!TPE_worldFreezeBody(&w,0),"freeze without static buffer");
+
+    TPE_worldSetStaticBuffer(&w,statics,2);
+
+    ass(TPE_worldFreezeBody(&w,2) && TPE_worldFreezeBody(&w,0) &&
+      w.staticCount == 2 && statics[0].body == 2,"freeze bodies");
+
+    uint32_t boxHash = TPE_bodyHash(b);
+
+    for (int i = 0; i < 200; ++i)
+    {
+      for (int k = 0; k < 3; ++k)
+        TPE_bodyApplyGravity(b + k,5);
+
+      TPE_worldStep(&w);
+    }
+
+    ass(TPE_bodyHash(b) == boxHash && j[9].position.y == 3000 &&
+      j[8].position.y > 3500,"static body holds");
+
+    TPE_worldUnfreezeBody(&w,0);
+
+    for (int i = 0; i < 200; ++i)
+    {
+      for (int k = 0; k < 3; ++k)
+        TPE_bodyApplyGravity(b + k,5);
+
+      TPE_worldStep(&w);
+    }
+
+    ass(w.staticCount == 1 && statics[0].body == 2 && j[0].position.y < 1000,
+      "unfrozen body falls");
+
+    TPE_Joint snapshot[16];
+
+    TPE_worldSnapshot(&w,snapshot);
+    TPE_worldFreezeBody(&w,1);
+    TPE_worldRestore(&w,snapshot);
+
+    ass(w.staticCount == 1 && statics[0].body == 2 &&
+      !(b[1].flags & TPE_BODY_FLAG_STATIC),"restore rebuilds static index");
+
+    TPE_BodyHashCache bodyHashes[3], bodyHashes2[3];
+    TPE_WorldHashCache hashCache, hashCache2;
+
+    TPE_worldFreezeBody(&w,1);
+    TPE_worldHashCacheInit(&hashCache,bodyHashes,&w);
+    TPE_worldUnfreezeBody(&w,2); // changes the static run of body 1
+    TPE_worldHashCacheInit(&hashCache2,bodyHashes2,&w);
+
+    ass(TPE_worldHashCacheUpdate(&hashCache,&w) == hashCache2.hash,
+      "static runs not hashed");
+
+    TPE_worldFreezeBody(&w,2);
+    TPE_worldDeactivateAll(&w);
+    TPE_worldActivateAll(&w);
+
+    for (int i = 0; i < 10; ++i)
+      TPE_worldStep(&w); // would hang if the static runs were reset
+
+    ass(b[1].staticRun == 2 && b[2].staticRun == 1,
+      "static runs survive activation");
+  }
+
+  {
+    TPE_World w;
+    TPE_Body b[2];
+    TPE_Joint j[2];
+
+    j[0] = TPE_joint(TPE_vec3(0,21000,0),500);
+    TPE_bodyInit(b,j,1,0,0,TPE_F);
+    b[0].flags |= TPE_BODY_FLAG_KINEMATIC;
+
+    j[1] = TPE_joint(TPE_vec3(0,21900,0),300);
+    TPE_bodyInit(b + 1,j + 1,1,0,0,TPE_F);
+
+    TPE_worldInit(&w,b,2,envFuncHeightmap);
+
+    for (int i = 1; i <= 100; ++i)
+    {
+      TPE_bodyKinematicMoveTo(b,TPE_vec3(0,21000 + i * 10,0));
+
+      for (int k = 0; k < 2; ++k)
+        TPE_bodyApplyGravity(b + k,5);
+
+      TPE_worldStep(&w);
+    }
+
+    ass(j[0].position.x == 0 && j[0].position.y == 22000 &&
+      j[0].position.z == 0 && j[1].position.y > 22700 &&
+      j[1].position.y < 23000,"kinematic body carries a body");
+  }
+
+  {
+    TPE_World w;
+    TPE_Body b;
+    TPE_Joint j = TPE_joint(TPE_vec3(0,25000,0),300);
+    TPE_Sensor sensors[2];
+    TPE_SensorEvent events[4];
+    uint8_t flags[1] = {0};
+    int counts[3] = {0, 0, 0}, order = 1;
+
+    TPE_bodyInit(&b,&j,1,0,0,TPE_F);
+    TPE_worldInit(&w,&b,1,envFuncHeightmap);
+
+    sensors[0] = TPE_sensor(TPE_vec3(0,22000,0),500);
+    sensors[1] = TPE_sensor(TPE_vec3(5000,22000,0),500);
+
+    for (int i = 0; i < 100; ++i)
+    {
+      TPE_bodyApplyGravity(&b,5);
+      TPE_worldStep(&w);
+
+      uint16_t n = TPE_worldUpdateSensors(&w,sensors,2,flags,events,4);
+
+      for (int k = 0; k < n; ++k)
+      {
+        order = order && events[k].sensor == 0 && events[k].body == 0 &&
+          (counts[0] == 1 || events[k].type == TPE_SENSOR_EVENT_ENTER) &&
+          counts[2] == 0;
+
+        counts[events[k].type]++;
+      }
+    }
+
+    ass(order && counts[TPE_SENSOR_EVENT_ENTER] == 1 &&
+      counts[TPE_SENSOR_EVENT_STAY] > 0 && counts[TPE_SENSOR_EVENT_EXIT] == 1 &&
+      sensors[0].bodyCount == 0,"sensor events");
+  }
+
+  {
+    TPE_World w;
+    TPE_Body b;
+    TPE_Joint j = TPE_joint(TPE_vec3(0,25000,0),300);
+    TPE_Sensor s = TPE_sensor(TPE_vec3(0,25000,0),500);
+    TPE_SensorEvent e[2];
+    uint8_t types[4], flags[1] = {0};
+
+    TPE_bodyInit(&b,&j,1,0,0,TPE_F);
+    TPE_worldInit(&w,&b,1,envFuncHeightmap);
+    TPE_bodyDeactivate(&b);
+
+    for (int i = 0; i < 4; ++i)
+    {
+      if (i == 2)
+        s.position.x = 5000;
+      else if (i == 3)
+        s.position.x = 0;
+
+      types[i] =
+        TPE_worldUpdateSensors(&w,&s,1,flags,e,2) == 1 ? e[0].type : 255;
+    }
+
+    ass(types[0] == TPE_SENSOR_EVENT_ENTER &&
+      types[1] == TPE_SENSOR_EVENT_STAY && types[2] == TPE_SENSOR_EVENT_EXIT &&
+      types[3] == TPE_SENSOR_EVENT_ENTER && s.bodyCount == 1,
+      "sensor with a deactivated body");
+  }
+
+  {
+    TPE_World w;
+    TPE_Body b;
+    TPE_Joint j = TPE_joint(TPE_vec3(5000,25000,0),300);
+    TPE_Sensor s = TPE_sensor(TPE_vec3(0,25000,0),500);
+    TPE_SensorEvent e[2];
+    uint8_t flags[1] = {0}, type = 255;
+
+    TPE_bodyInit(&b,&j,1,0,0,TPE_F);
+    TPE_worldInit(&w,&b,1,envFuncHeightmap);
+
+    TPE_worldUpdateSensors(&w,&s,1,flags,e,2);
+
+    // move the body into the sensor and let it deactivate in the same step
+
+    TPE_bodyMoveBy(&b,TPE_vec3(-5000,0,0));
+    b.deactivateCount = TPE_DEACTIVATE_AFTER;
+    TPE_worldStep(&w);
+
+    if (TPE_worldUpdateSensors(&w,&s,1,flags,e,2) == 1)
+      type = e[0].type;
+
+    ass((b.flags & TPE_BODY_FLAG_DEACTIVATED) &&
+      type == TPE_SENSOR_EVENT_ENTER,"sensor with a body deactivated in step");
+  }
+
+  {
+    TPE_World w;
+    TPE_Body b;
+    TPE_Joint j[2];
+    TPE_Connection c;
+    TPE_Character character;
+    TPE_Unit stepY = 0, minX = 0;
+    uint8_t ground = 0;
+
+    TPE_make2Line(j,&c,400,300);
+    TPE_bodyInit(&b,j,2,&c,1,TPE_F);
+    TPE_bodyRotateByAxis(&b,TPE_vec3(0,0,TPE_F / 4));
+    TPE_bodyMoveBy(&b,TPE_vec3(0,1500,0));
+    TPE_worldInit(&w,&b,1,envFuncCharacter);
+
+    TPE_characterInit(&character,&b);
+    character.stepHeight = 250;
+
+    for (int i = 0; i < 500; ++i)
+    {
+      /* fall, walk onto the low box (step) and then to the steep slope which
+         can't be climbed */
+
+      ground = TPE_characterMove(&character,
+        TPE_vec3(i < 60 ? 0 : (i < 180 ? 20 : -20),0,0),5,&w);
+
+      TPE_worldStep(&w);
+
+      if (i == 179)
+        stepY = j[0].position.y;
+
+      if (j[0].position.x < minX)
+        minX = j[0].position.x;
+    }
+
+    ass(ground && stepY > 400 && j[0].position.y < 350 &&
+      j[0].position.y == j[1].position.y - 400 && minX > -3000,
+      "character controller");
+  }
+
+  {
+    TPE_World w;
+    TPE_Body b[3];
+    TPE_Joint j[4];
+    TPE_Connection c;
+    TPE_StaticEntry statics[1];
+    TPE_Character character;
+    TPE_Unit maxX = 0, platformY;
+
+    TPE_make2Line(j,&c,400,300);
+    TPE_bodyInit(b,j,2,&c,1,TPE_F);
+    TPE_bodyRotateByAxis(b,TPE_vec3(0,0,TPE_F / 4));
+    TPE_bodyMoveBy(b,TPE_vec3(0,520,0));
+
+    j[2] = TPE_joint(TPE_vec3(1200,600,0),600); // frozen wall
+    TPE_bodyInit(b + 1,j + 2,1,0,0,TPE_F);
+
+    j[3] = TPE_joint(TPE_vec3(-2000,400,0),800); // platform
+    TPE_bodyInit(b + 2,j + 3,1,0,0,TPE_F);
+    b[2].flags |= TPE_BODY_FLAG_KINEMATIC;
+
+    TPE_worldInit(&w,b,3,envFuncCharacter);
+    TPE_worldSetStaticBuffer(&w,statics,1);
+    TPE_worldFreezeBody(&w,1);
+
+    TPE_characterInit(&character,b);
+
+    for (int i = 0; i < 100; ++i)
+    {
+      TPE_characterMove(&character,TPE_vec3(20,0,0),5,&w);
+      TPE_worldStep(&w);
+
+      if (j[0].position.x > maxX)
+        maxX = j[0].position.x;
+    }
+
+    TPE_bodyMoveTo(b,TPE_vec3(-2000,1500,0));
+
+    for (int i = 0; i < 100; ++i)
+    {
+      if (i >= 50)
+        TPE_bodyKinematicMoveTo(b + 2,TPE_vec3(-2000,400 + (i - 50) * 10,0));
+
+      TPE_characterMove(&character,TPE_vec3(0,0,0),5,&w);
+      TPE_worldStep(&w);
+    }
+
+    platformY = j[3].position.y;
+
+    ass(maxX > 150 && maxX < 350 && character.onGround &&
+      character.groundBody == 2 && platformY == 890 &&
+      j[0].position.y > platformY + 1000 && j[0].position.y < platformY + 1200,
+      "character against static and kinematic bodies");
+  }
+
+  {
+    TPE_World w;
+    TPE_Body b;
+    TPE_Joint j[4];
+    TPE_Connection c[6];
+    TPE_Vehicle vehicle;
+    uint8_t settled;
+    TPE_Vec3 p;
+
+    TPE_makeRect(j,c,1000,1600,200);
+    TPE_bodyInit(&b,j,4,c,6,TPE_F);
+    TPE_bodyMoveBy(&b,TPE_vec3(0,1500,0));
+    TPE_worldInit(&w,&b,1,envFuncCharacter);
+
+    TPE_vehicleInit(&vehicle,&b,300,500);
+
+    for (int i = 0; i < 300; ++i)
+    {
+      TPE_vehicleUpdate(&vehicle,envFuncCharacter);
+      TPE_bodyApplyGravity(&b,5);
+      TPE_worldStep(&w);
+    }
+
+    p = TPE_bodyGetCenterOfMass(&b);
+
+    settled = vehicle.onGround == 0x0f && p.y > 300 && p.y < 800 &&
+      p.x == 0 && p.z == 0;
+
+    vehicle.throttle = 2; // drive forward (-z) and then turn left (-x)
+
+    for (int i = 0; i < 100; ++i)
+    {
+      vehicle.steering = i < 60 ? 0 : TPE_F / 16;
+
+      TPE_vehicleUpdate(&vehicle,envFuncCharacter);
+      TPE_bodyApplyGravity(&b,5);
+      TPE_worldStep(&w);
+
+      if (i == 59)
+        p = TPE_bodyGetCenterOfMass(&b);
+    }
+
+    ass(settled && p.z < -1000 && p.x > -100 && p.x < 100 &&
+      TPE_bodyGetCenterOfMass(&b).x < p.x - 500 && vehicle.onGround == 0x0f &&
+      TPE_vehicleWheelPosition(&vehicle,0).y < 400,"raycast vehicle");
+
+    p = TPE_vehicleWheelPosition(&vehicle,4); // only 4 wheels
+
+    ass(p.x == 0 && p.y == 0 && p.z == 0,"vehicle wheel out of range");
+  }
+
+  {
+    TPE_World w[2];
+    TPE_Body b[2];
+    TPE_Joint j[2][2];
+    TPE_Connection c[2];
+    uint8_t same = 1, inside = 1;
+
+    for (int i = 0; i < 2; ++i)
+    {
+      TPE_make2Line(j[i],c + i,800,200);
+      TPE_bodyInit(b + i,j[i],2,c + i,1,TPE_F);
+      TPE_bodyRotateByAxis(b + i,TPE_vec3(0,0,TPE_F / 4));
+      b[i].flags |= TPE_BODY_FLAG_NONROTATING;
+      TPE_bodyAccelerate(b + i,TPE_vec3(50,0,0));
+      TPE_worldInit(w + i,b + i,1,envFuncWall);
+    }
+
+    for (int i = 0; i < 100; ++i)
+    {
+      /* a non-rotating body stuck in the environment has to be moved back
+         the same way by TPE_worldStep and by the stages */
+
+      for (int k = 0; k < 2; ++k)
+        TPE_bodyApplyGravity(b + k,8);
+
+      TPE_worldStep(w);
+
+      TPE_worldStepBegin(w + 1);
+
+      if (!(b[1].flags & TPE_BODY_FLAG_DEACTIVATED))
+      {
+        TPE_worldStepIntegrate(w + 1,0);
+        TPE_worldStepEnvironment(w + 1,0);
+        TPE_worldStepSolve(w + 1,0);
+        TPE_worldStepBroadphase(w + 1,0);
+        TPE_worldStepSleep(w + 1,0);
+      }
+
+      TPE_worldStepEnd(w + 1);
+
+      same = same && TPE_worldHash(w) == TPE_worldHash(w + 1);
+
+      for (int k = 0; k < 2; ++k)
+        inside = inside && j[1][k].position.y > -800 &&
+          j[1][k].position.y < 800 && j[1][k].position.x < 1500;
+    }
+
+    ass(same && inside && j[0][0].position.x == 0 &&
+      j[0][0].position.y == -400,"non-rotating body stages and undo");
+  }
+
   puts("DONE, all OK");
 
   return 0;
@@ -0,0 +1,287 @@
+/** Headless tool for capturing and replaying workload traces (see trace.h).
+
+  usage:
+    trace record scene frames file   captures a trace of a demo scene
+    trace replay file [--phases]     replays a trace, reports timing, hashes
+                                     and optionally a breakdown of phases
+
+  Compile the tool with different settings (e.g. -O2 vs -O3,
+  -DTPE_APPROXIMATE_LENGTH=1, ...) and replay the same trace to compare; the
+  checkpoint hashes tell whether the configuration changed the simulation
+  result. */
+
+#define _POSIX_C_SOURCE 199309L // for clock_gettime
+
+#include <stdint.h>
+#include <time.h>
+
+uint64_t nanoTime(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec * ((uint64_t) 1000000000) + t.tv_nsec;
+}
+
+#define TPE_STATS 1 // only costs anything if world stats are set
+#define TPE_STATS_TIME() nanoTime()
+
+#include "scenes.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define LOG_SIZE (64 * 1024)
+#define CHECKPOINT_INTERVAL 10
+
+uint8_t logData[LOG_SIZE];
+
+TPE_ClosestPointFunction environment;
+unsigned long environmentCalls = 0;
+
+TPE_WorldStats stats;
+uint64_t bodyTimes[SCENE_MAX_BODIES];
+
+const char *phaseNames[TPE_STATS_PHASES] =
+  {"integrate","environment","tension","reshape","cancel","bodies",
+   "deactivation"};
+
+double getTime(void)
+{
+  return nanoTime() / 1000000000.0;
+}
+
+void printStats(uint32_t ticks)
+{
+  uint64_t total = 0;
+
+  for (int i = 0; i < TPE_STATS_PHASES; ++i)
+    total += stats.phaseTimes[i];
+
+  printf("\n%-14s %10s %10s %8s\n","phase","us/step","runs/step","share");
+
+  for (int i = 0; i < TPE_STATS_PHASES; ++i)
+    printf("%-14s %10.2f %10.1f %7.1f%%\n",phaseNames[i],
+      stats.phaseTimes[i] / 1000.0 / ticks,
+      ((double) stats.phaseCounts[i]) / ticks,
+      total ? (100.0 * stats.phaseTimes[i]) / total : 0);
+
+  printf("\nper step: %.1f AABB tests, %.1f joint pair tests, %.1f joint "
+    "contacts,\n  %.1f environment contacts, %.2f extra reshape passes\n",
+    ((double) stats.aabbTests) / ticks,((double) stats.jointPairTests) / ticks,
+    ((double) stats.jointContacts) / ticks,
+    ((double) stats.environmentContacts) / ticks,
+    ((double) stats.reshapeExtraPasses) / ticks);
+
+  printf("total: %u unresolved environment collisions, %u wakeups, %u "
+    "deactivations\n",stats.unresolvedCollisions,stats.wakeups,
+    stats.deactivations);
+
+  printf("most expensive bodies:");
+
+  for (int k = 0; k < 4; ++k)
+  {
+    int best = -1;
+
+    for (int i = 0; i < scene_world.bodyCount; ++i)
+      if (bodyTimes[i] > 0 && (best < 0 || bodyTimes[i] > bodyTimes[best]))
+        best = i;
+
+    if (best < 0)
+      break;
+
+    printf(" %d (%.1f%%)",best,(100.0 * bodyTimes[best]) / total);
+    bodyTimes[best] = 0;
+  }
+
+  putchar('\n');
+}
+
+TPE_Vec3 countingEnvironment(TPE_Vec3 p, TPE_Unit maxD)
+{
+  environmentCalls++;
+  return environment(p,maxD);
+}
+
+int record(const char *sceneName, int frames, const char *fileName)
+{
+  int scene = scene_find(sceneName);
+
+  if (scene < 0)
+  {
+    printf("ERROR: unknown scene\n");
+    return 1;
+  }
+
+  FILE *f = fopen(fileName,"wb");
+
+  if (!f)
+  {
+    printf("ERROR: couldn't open file\n");
+    return 1;
+  }
+
+  Trace trace;
+
+  scene_init(scene);
+  trace_beginCapture(&trace,f,&scene_world,sceneName,logData,LOG_SIZE,
+    CHECKPOINT_INTERVAL);
+
+  scene_inputLog = &trace.log;
+
+  for (int i = 0; i < frames; ++i)
+  {
+    scene_step(scene);
+    trace_tick(&trace);
+  }
+
+  scene_inputLog = 0;
+
+  trace_endCapture(&trace);
+
+  printf("recorded %d frames of scene %s, %ld bytes, world hash %08x\n",
+    frames,sceneName,ftell(f),TPE_worldHash(&scene_world));
+
+  fclose(f);
+
+  return 0;
+}
+
+int replay(const char *fileName, int phases)
+{
+  FILE *f = fopen(fileName,"rb");
+
+  if (!f)
+  {
+    printf("ERROR: couldn't open file\n");
+    return 1;
+  }
+
+  char environmentName[256];
+  uint16_t checkpointInterval;
+  int scene = -1;
+
+  /* The environment function (and collision callback) can't be stored in the
+     file, so it's taken from the scene of the same name, i.e. the scene is
+     initialized and then its world is overwritten by the trace (loaded twice
+     because the name is only known after loading). */
+
+  TPE_CollisionCallback collisionCallback = 0;
+
+  for (int i = 0; i < 2; ++i)
+  {
+    rewind(f);
+
+    if (!trace_loadWorld(f,&scene_world,scene_bodies,SCENE_MAX_BODIES,
+      scene_joints,SCENE_MAX_JOINTS,scene_connections,SCENE_MAX_CONNECTIONS,
+      environmentName,&checkpointInterval))
+    {
+      printf("ERROR: bad trace file\n");
+      fclose(f);
+      return 1;
+    }
+
+    if (i == 0)
+    {
+      scene = scene_find(environmentName);
+
+      if (scene < 0)
+      {
+        printf("ERROR: unknown environment %s\n",environmentName);
+        fclose(f);
+        return 1;
+      }
+
+      scene_init(scene);
+      environment = scene_world.environmentFunction;
+      collisionCallback = scene_world.collisionCallback;
+    }
+  }
+
+  scene_world.collisionCallback = collisionCallback;
+
+  scene_world.environmentFunction = countingEnvironment;
+
+  if (phases)
+  {
+    TPE_worldStatsInit(&stats,bodyTimes);
+    scene_world.stats = &stats;
+  }
+
+  printf("build: TPE_APPROXIMATE_LENGTH %d, TPE_RESHAPE_ITERATIONS %d, "
+    "TPE_COLLISION_RESOLUTION_ITERATIONS %d\n",TPE_APPROXIMATE_LENGTH,
+    TPE_RESHAPE_ITERATIONS,TPE_COLLISION_RESOLUTION_ITERATIONS);
+
+  TPE_InputLog inputLog;
+  uint32_t ticks, totalTicks = 0, checkpoints = 0, mismatches = 0;
+  int32_t firstMismatch = -1;
+  double time = 0;
+
+  while (trace_readChunk(f,&inputLog,logData,LOG_SIZE,&ticks))
+  {
+    uint32_t tick = 0;
+
+    inputLog.parameterFunction = scene_parameterFunction;
+
+    double t = getTime();
+
+    while (tick < ticks)
+    {
+      int32_t mismatch =
+        TPE_inputLogReplay(&inputLog,&scene_world,tick,ticks);
+
+      if (mismatch < 0)
+        break;
+
+      // continue after the mismatching checkpoint to count all of them
+
+      if (firstMismatch < 0)
+        firstMismatch = totalTicks + mismatch;
+
+      mismatches++;
+      tick = mismatch;
+    }
+
+    time += getTime() - t;
+    totalTicks += ticks;
+  }
+
+  fclose(f);
+
+  if (checkpointInterval != 0)
+    checkpoints = totalTicks / checkpointInterval;
+
+  printf("environment %s, %d bodies, %u ticks\n",environmentName,
+    scene_world.bodyCount,totalTicks);
+
+  printf("time per step: %.2f us (%.0f steps/s, includes input application)\n",
+    time * 1000000.0 / totalTicks,totalTicks / time);
+
+  printf("environment calls per step: %.1f\n",
+    ((double) environmentCalls) / totalTicks);
+
+  printf("hash checkpoints: %u/%u match",checkpoints - mismatches,checkpoints);
+
+  if (firstMismatch >= 0)
+    printf(", first mismatch after tick %d",firstMismatch);
+
+  printf("\nfinal world hash: %08x\n",TPE_worldHash(&scene_world));
+
+  if (phases)
+    printStats(totalTicks);
+
+  return mismatches != 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc == 5 && strcmp(argv[1],"record") == 0)
+    return record(argv[2],atoi(argv[3]),argv[4]);
+
+  if ((argc == 3 || argc == 4) && strcmp(argv[1],"replay") == 0)
+    return replay(argv[2],argc == 4 && strcmp(argv[3],"--phases") == 0);
+
+  printf("usage:\n  trace record scene frames file\n"
+    "  trace replay file [--phases]\n");
+
+  return 1;
+}
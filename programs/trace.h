@@ -0,0 +1,237 @@
+/**
+  Workload traces: a binary file with the initial state of a world followed
+  by a stream of all external inputs (see TPE_InputLog), so that a real
+  workload (e.g. a match of a game) can be captured and then replayed
+  headlessly, e.g. to benchmark TPE_worldStep under different build
+  configurations or to attach to a bug report.
+
+  File format (all numbers little endian):
+
+  - header: "TPET", version (1 byte), environment name length (1 byte) and
+    the name (identifies the environment function, which can't be stored),
+    body count (2 bytes), checkpoint interval (2 bytes)
+  - for each body: joint count (1), connection count (1), joint mass (2),
+    friction (2), elasticity (2), flags (1), deactivate count (1), then the
+    joints (position 3 * 4, velocity 3 * 2, size 1) and the connections
+    (joint1 1, joint2 1, length 2)
+  - chunks until end of file: tick count (4), size (4), input log data (size
+    bytes), each chunk contains only whole ticks
+*/
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "../tinyphysicsengine.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TRACE_VERSION 1
+
+typedef struct
+{
+  FILE *file;
+  TPE_InputLog log;       ///< record inputs through this log
+  uint32_t chunkStartTick;
+} Trace;
+
+void _trace_write(FILE *f, uint32_t value, int bytes)
+{
+  for (int i = 0; i < bytes; ++i)
+  {
+    fputc(value & 0xff,f);
+    value >>= 8;
+  }
+}
+
+uint32_t _trace_read(FILE *f, int bytes)
+{
+  uint32_t r = 0;
+
+  for (int i = 0; i < bytes; ++i)
+    r |= ((uint32_t) (fgetc(f) & 0xff)) << (i * 8);
+
+  return r;
+}
+
+/** Starts capturing a trace into an open file: writes the initial state of
+  the world and initializes the trace's input log in given buffer. From now on
+  all inputs to the world have to go through trace->log and trace_tick has to
+  be called after each step. */
+void trace_beginCapture(Trace *trace, FILE *f, const TPE_World *world,
+  const char *environmentName, uint8_t *buffer, uint32_t capacity,
+  uint16_t checkpointInterval)
+{
+  trace->file = f;
+  trace->chunkStartTick = 0;
+
+  TPE_inputLogInit(&trace->log,buffer,capacity,checkpointInterval);
+
+  fwrite("TPET",1,4,f);
+  _trace_write(f,TRACE_VERSION,1);
+  _trace_write(f,strlen(environmentName),1);
+  fwrite(environmentName,1,strlen(environmentName),f);
+  _trace_write(f,world->bodyCount,2);
+  _trace_write(f,checkpointInterval,2);
+
+  for (uint16_t i = 0; i < world->bodyCount; ++i)
+  {
+    const TPE_Body *b = world->bodies + i;
+
+    _trace_write(f,b->jointCount,1);
+    _trace_write(f,b->connectionCount,1);
+    _trace_write(f,(uint16_t) b->jointMass,2);
+    _trace_write(f,(uint16_t) b->friction,2);
+    _trace_write(f,(uint16_t) b->elasticity,2);
+    _trace_write(f,b->flags,1);
+    _trace_write(f,b->deactivateCount,1);
+
+    for (uint8_t j = 0; j < b->jointCount; ++j)
+    {
+      const TPE_Joint *joint = b->joints + j;
+
+      _trace_write(f,joint->position.x,4);
+      _trace_write(f,joint->position.y,4);
+      _trace_write(f,joint->position.z,4);
+
+      for (int k = 0; k < 3; ++k)
+        _trace_write(f,(uint16_t) joint->velocity[k],2);
+
+      _trace_write(f,joint->sizeDivided,1);
+    }
+
+    for (uint8_t j = 0; j < b->connectionCount; ++j)
+    {
+      _trace_write(f,b->connections[j].joint1,1);
+      _trace_write(f,b->connections[j].joint2,1);
+      _trace_write(f,b->connections[j].length,2);
+    }
+  }
+}
+
+/** Writes the recorded ticks as a chunk and empties the log. */
+void trace_flush(Trace *trace)
+{
+  if (trace->log.size == 0)
+    return;
+
+  _trace_write(trace->file,trace->log.tick - trace->chunkStartTick,4);
+  _trace_write(trace->file,trace->log.size,4);
+  fwrite(trace->log.data,1,trace->log.size,trace->file);
+
+  trace->log.size = 0;
+  trace->chunkStartTick = trace->log.tick;
+}
+
+/** To be called after each world step (done with TPE_inputLogStep) during
+  capture, streams the log to the file when it gets half full. */
+void trace_tick(Trace *trace)
+{
+  if (trace->log.size > trace->log.capacity / 2)
+    trace_flush(trace);
+}
+
+/** Ends the capture (the file isn't closed). */
+void trace_endCapture(Trace *trace)
+{
+  trace_flush(trace);
+  fflush(trace->file);
+}
+
+/** Loads the header and initial world state of a trace from an open file into
+  given world (whose environment function is then to be set by the caller
+  according to environmentName). Returns 1 on success, 0 on error (bad file,
+  not enough space). */
+int trace_loadWorld(FILE *f, TPE_World *world, TPE_Body *bodies,
+  uint16_t maxBodies, TPE_Joint *joints, uint32_t maxJoints,
+  TPE_Connection *connections, uint32_t maxConnections,
+  char environmentName[256], uint16_t *checkpointInterval)
+{
+  char magic[4];
+
+  if (fread(magic,1,4,f) != 4 || memcmp(magic,"TPET",4) != 0 ||
+    _trace_read(f,1) != TRACE_VERSION)
+    return 0;
+
+  uint32_t len = _trace_read(f,1);
+
+  if (fread(environmentName,1,len,f) != len)
+    return 0;
+
+  environmentName[len] = 0;
+
+  uint16_t bodyCount = _trace_read(f,2);
+  *checkpointInterval = _trace_read(f,2);
+
+  if (bodyCount > maxBodies)
+    return 0;
+
+  TPE_worldInit(world,bodies,0,0);
+
+  for (uint16_t i = 0; i < bodyCount; ++i)
+  {
+    TPE_Body *b = bodies + i;
+
+    b->jointCount = _trace_read(f,1);
+    b->connectionCount = _trace_read(f,1);
+    b->jointMass = (int16_t) _trace_read(f,2);
+    b->friction = (int16_t) _trace_read(f,2);
+    b->elasticity = (int16_t) _trace_read(f,2);
+    b->flags = _trace_read(f,1);
+    b->deactivateCount = _trace_read(f,1);
+
+    if (b->jointCount > maxJoints || b->connectionCount > maxConnections)
+      return 0;
+
+    b->joints = joints;
+    b->connections = connections;
+
+    for (uint8_t j = 0; j < b->jointCount; ++j)
+    {
+      joints[j].position.x = (int32_t) _trace_read(f,4);
+      joints[j].position.y = (int32_t) _trace_read(f,4);
+      joints[j].position.z = (int32_t) _trace_read(f,4);
+
+      for (int k = 0; k < 3; ++k)
+        joints[j].velocity[k] = (int16_t) _trace_read(f,2);
+
+      joints[j].sizeDivided = _trace_read(f,1);
+    }
+
+    for (uint8_t j = 0; j < b->connectionCount; ++j)
+    {
+      connections[j].joint1 = _trace_read(f,1);
+      connections[j].joint2 = _trace_read(f,1);
+      connections[j].length = _trace_read(f,2);
+    }
+
+    joints += b->jointCount;
+    maxJoints -= b->jointCount;
+    connections += b->connectionCount;
+    maxConnections -= b->connectionCount;
+  }
+
+  world->bodyCount = bodyCount;
+
+  return !feof(f);
+}
+
+/** Reads the next chunk of a trace into given buffer and sets up an input log
+  over it (for TPE_inputLogReplay), ticks is set to the number of ticks in the
+  chunk. Returns 1 on success, 0 at the end of the file or on error. */
+int trace_readChunk(FILE *f, TPE_InputLog *inputLog, uint8_t *buffer,
+  uint32_t capacity, uint32_t *ticks)
+{
+  *ticks = _trace_read(f,4);
+  uint32_t size = _trace_read(f,4);
+
+  if (feof(f) || size > capacity || fread(buffer,1,size,f) != size)
+    return 0;
+
+  TPE_inputLogInit(inputLog,buffer,capacity,0);
+  inputLog->size = size;
+  inputLog->tick = *ticks;
+
+  return 1;
+}
+
+#endif // guard
@@ -157,12 +157,53 @@ typedef int16_t TPE_UnitReduced;        ///< Like TPE_Unit but saving space
   #define TPE_NONROTATING_COLLISION_RESOLVE_ATTEMPTS 8
 #endif
 
+#ifndef TPE_CHARACTER_ITERATIONS
+/** Maximum number of collisions with the environment a character controller
+  (TPE_Character) resolves per each part of its movement. */
+  #define TPE_CHARACTER_ITERATIONS 4
+#endif
+
+#ifndef TPE_CHARACTER_MAX_OBSTACLES
+/** Maximum number of static and kinematic bodies near a character controller
+  (TPE_Character) it collides with in one move, further ones are ignored. */
+  #define TPE_CHARACTER_MAX_OBSTACLES 16
+#endif
+
+#ifndef TPE_VEHICLE_CAST_STEPS
+/** Maximum number of sphere tracing steps of a vehicle wheel's suspension
+  cast against the environment (TPE_Vehicle), more help on steep surfaces. */
+  #define TPE_VEHICLE_CAST_STEPS 8
+#endif
+
 #ifndef TPE_APPROXIMATE_NET_SPEED
 /** Whether to use a fast approximation for calculating net speed of bodies
   which increases performance a bit. */
   #define TPE_APPROXIMATE_NET_SPEED 1
 #endif
 
+#ifndef TPE_DELTA_QUANTIZATION
+/** Number of lowest bits of joint positions that will be thrown away by the
+  snapshot delta encoder (TPE_snapshotEncodeDelta), 0 means lossless encoding,
+  higher values mean smaller data but lower precision of decoded positions. */
+  #define TPE_DELTA_QUANTIZATION 0
+#endif
+
+#ifndef TPE_STATS
+/** Whether to support collecting statistics of world steps (see
+  TPE_WorldStats), 0 compiles all of it out so that it has no cost. */
+  #define TPE_STATS 0
+#endif
+
+#ifndef TPE_PROFILE
+/** Whether to mark profiling zones (the world step, its phases for each body,
+  environment function calls during the step, ray casts and debug draw) so
+  that they can be recorded by a profiler. If enabled, TPE_PROFILE_BEGIN(name)
+  and TPE_PROFILE_END(name) have to be defined, they're called with string
+  literal zone names at the beginning and end of each zone (zones nest
+  properly). 0 compiles the zones out so that they have no cost. */
+  #define TPE_PROFILE 0
+#endif
+
 #define TPE_PRINTF_VEC3(v) printf("[%d %d %d]",(v).x,(v).y,(v).z);
 
 typedef struct
@@ -250,6 +291,17 @@ typedef struct
                                             performance. */
 #define TPE_BODY_FLAG_ALWAYS_ACTIVE 32 /**< Will never deactivate due to low
                                             energy. */
+#define TPE_BODY_FLAG_STATIC 64        /**< Static, never moves and has
+                                            infinite mass in collisions, kept
+                                            in the world's static index, set
+                                            by TPE_worldFreezeBody. */
+#define TPE_BODY_FLAG_KINEMATIC 128    /**< Kinematic, moved only by the
+                                            velocities the user sets (e.g.
+                                            with TPE_bodyKinematicMoveTo),
+                                            has infinite mass in collisions,
+                                            isn't affected by gravity or the
+                                            environment and never
+                                            deactivates. */
 
 /** Function used for defining static environment, working similarly to an SDF
   (signed distance function). The parameters are: 3D point P, max distance D.
@@ -287,16 +339,137 @@ typedef struct
   TPE_UnitReduced elasticity;      ///< elasticity of each joint
   uint8_t flags;
   uint8_t deactivateCount;
+  uint8_t staticRun;  /**< if static, number of static bodies from this one on
+                           in the world's array (at most 255), used to skip
+                           them, kept by TPE_worldFreezeBody etc. */
 } TPE_Body;
 
+#if TPE_STATS
+
+#ifndef TPE_STATS_TIME
+/** Returns current time for measuring the cost of step phases and bodies in
+  statistics, in any unit (e.g. CPU cycles or nanoseconds), uint64_t. By
+  default the time is measured in "work units": environment function calls
+  plus joint pair collision tests, which is deterministic and platform
+  independent, redefine this for real time. */
+  #define TPE_STATS_TIME() \
+    (((uint64_t) _TPE_stats->environmentCalls) + _TPE_stats->jointPairTests)
+#endif
+
+#ifndef TPE_STATS_TOP_BODIES
+/** Number of the most expensive bodies TPE_WorldStats keeps track of. */
+  #define TPE_STATS_TOP_BODIES 4
+#endif
+
+#define TPE_STATS_PHASE_INTEGRATE 0    ///< applying velocities
+#define TPE_STATS_PHASE_ENVIRONMENT 1  ///< resolving environment collisions
+#define TPE_STATS_PHASE_TENSION 2      ///< connection tension acceleration
+#define TPE_STATS_PHASE_RESHAPE 3      ///< reshaping hard bodies
+#define TPE_STATS_PHASE_CANCEL 4       ///< cancelling out velocities
+#define TPE_STATS_PHASE_BODIES 5       ///< body-body collisions
+#define TPE_STATS_PHASE_DEACTIVATION 6 ///< updating deactivation
+#define TPE_STATS_PHASES 7
+
+/** Statistics of world steps, filled by TPE_worldStep when the world's stats
+  pointer is set (only available with TPE_STATS enabled). The values
+  accumulate over steps until reset with TPE_worldStatsInit. */
+typedef struct
+{
+  uint32_t steps;
+  uint32_t phaseCounts[TPE_STATS_PHASES]; ///< how many times each phase ran
+  uint64_t phaseTimes[TPE_STATS_PHASES];  ///< total time of each phase
+  uint32_t reshapeExtraPasses;   ///< times the TPE_RESHAPE_ITERATIONS fired
+  uint32_t aabbTests;            ///< body pair bounding box tests
+  uint32_t jointPairTests;       ///< joint pair collision tests
+  uint32_t jointContacts;        ///< colliding joint pairs
+  uint32_t environmentContacts;  ///< joint collisions with environment
+  uint32_t environmentCalls;     ///< environment function calls
+  uint32_t unresolvedCollisions; ///< environment collisions not resolved
+  uint32_t wakeups;              ///< bodies activated by collisions
+  uint32_t deactivations;        ///< bodies put to sleep
+  uint64_t *bodyTimes; /**< optional caller's array (one item per body)
+                            accumulating time spent on each body, or 0 */
+  uint16_t topBodies[TPE_STATS_TOP_BODIES]; /**< most expensive bodies of the
+                                                 last step, the most expensive
+                                                 first */
+  uint64_t topBodyTimes[TPE_STATS_TOP_BODIES]; ///< their times, 0 = no body
+} TPE_WorldStats;
+
+/** Initializes (resets) statistics, bodyTimes is an optional array for
+  accumulating time spent on each body (it has to be zeroed by the caller), may
+  be 0. */
+void TPE_worldStatsInit(TPE_WorldStats *stats, uint64_t *bodyTimes);
+
+#endif // TPE_STATS
+
+#define TPE_FORCE_FIELD_ACCELERATION 0 /**< constant acceleration given by
+                                            vector (e.g. gravity) */
+#define TPE_FORCE_FIELD_ATTRACTOR 1    /**< acceleration of given strength
+                                            towards center (negative strength
+                                            repels) */
+#define TPE_FORCE_FIELD_WIND 2         /**< velocity is pulled towards vector
+                                            by strength / TPE_F of the
+                                            difference */
+#define TPE_FORCE_FIELD_DAMPING 3      /**< velocity is reduced by
+                                            strength / TPE_F */
+
+#define TPE_FORCE_VOLUME_ALL 0         ///< field affects the whole world
+#define TPE_FORCE_VOLUME_AABB 1        ///< box at center, half sizes in size
+#define TPE_FORCE_VOLUME_SPHERE 2      ///< sphere at center, radius in size.x
+
+/** Force field affecting velocities of all joints in its volume, applied by
+  TPE_worldStep during integration (so deactivated and disabled bodies are not
+  affected), i.e. without an extra pass over the joints. */
+typedef struct
+{
+  uint8_t type;     ///< TPE_FORCE_FIELD_* constant
+  uint8_t volume;   ///< TPE_FORCE_VOLUME_* constant
+  TPE_Unit strength;
+  TPE_Vec3 vector;
+  TPE_Vec3 center;  ///< center of the volume and of an attractor
+  TPE_Vec3 size;
+} TPE_ForceField;
+
+/** Entry of a world's index of static bodies (see TPE_worldFreezeBody). */
+typedef struct
+{
+  TPE_Vec3 aabbMin;
+  TPE_Vec3 aabbMax;
+  uint16_t body;     ///< index of the body in the world
+} TPE_StaticEntry;
+
 typedef struct
 {
   TPE_Body *bodies;
   uint16_t bodyCount;
   TPE_ClosestPointFunction environmentFunction;
   TPE_CollisionCallback collisionCallback;
+  const TPE_ForceField *forceFields; ///< array of force fields, may be 0
+  uint8_t forceFieldCount;
+  TPE_StaticEntry *statics;  ///< static index sorted by aabbMin.x, may be 0
+  uint16_t staticCount;
+  uint16_t staticCapacity;
+  TPE_Unit staticMaxWidth;   ///< maximum x size of static AABBs
+#if TPE_STATS
+  TPE_WorldStats *stats; ///< if not 0, TPE_worldStep will fill the statistics
+#endif
 } TPE_World;
 
+/** Size in bytes of the memory needed by a world with given total numbers of
+  bodies, joints and connections: the world struct and the arrays (not
+  counting optional buffers such as snapshots, see TPE_SNAPSHOT_SIZE etc.). */
+#define TPE_WORLD_MEMORY_SIZE(bodyCount,jointCount,connectionCount) \
+  (sizeof(TPE_World) + (bodyCount) * sizeof(TPE_Body) + \
+  (jointCount) * sizeof(TPE_Joint) + \
+  (connectionCount) * sizeof(TPE_Connection))
+
+/** Makes compilation fail if given memory size exceeds given budget (both in
+  bytes and known at compile time), e.g. to guard the RAM budget of an
+  embedded program with TPE_WORLD_MEMORY_SIZE. Name is an arbitrary unique
+  identifier (it names a typedef). */
+#define TPE_BUDGET_CHECK(name,size,budget) \
+  typedef char name[((size) <= (budget)) ? 1 : -1];
+
 /** Tests the mathematical validity of given closest point function (function
   representing the physics environment), i.e. whether for example approaching
   some closest point in a straight line keeps approximately the same closest
@@ -324,6 +497,40 @@ void TPE_worldInit(TPE_World *world,
   TPE_Body *bodies, uint16_t bodyCount,
   TPE_ClosestPointFunction environmentFunction);
 
+/** Creates a force field affecting the whole world, the volume can then be
+  changed by setting its volume, center and size. */
+TPE_ForceField TPE_forceField(uint8_t type, TPE_Vec3 vector,
+  TPE_Unit strength);
+
+/** Sets the memory for a world's index of static bodies, an array of capacity
+  entries, which limits the number of bodies that can be frozen. */
+void TPE_worldSetStaticBuffer(TPE_World *world, TPE_StaticEntry *entries,
+  uint16_t capacity);
+
+/** Turns a body into a static one (TPE_BODY_FLAG_STATIC): it is stopped and
+  from then on it is never integrated or deactivated and has infinite mass in
+  collisions. Static bodies are kept in a separate index sorted along the x
+  axis so that they are found in logarithmic time by the broadphase instead of
+  being tested by every active body. Use this both for creating static
+  obstacles and for baking bodies that settled down. Returns 1 on success or 0
+  if the static index is full (or not set). Note the index refers to bodies by
+  indices so bodies mustn't be reordered while static. The index is not part
+  of snapshots, TPE_worldRestore rebuilds it if static bodies changed. */
+uint8_t TPE_worldFreezeBody(TPE_World *world, uint16_t bodyIndex);
+
+/** Turns a static body back into a dynamic one, active and with zero
+  velocity. */
+void TPE_worldUnfreezeBody(TPE_World *world, uint16_t bodyIndex);
+
+/** Sets the force fields of a world (fields are not copied). */
+void TPE_worldSetForceFields(TPE_World *world, const TPE_ForceField *fields,
+  uint8_t fieldCount);
+
+/** Applies force fields to velocity of a joint at given position. This is
+  called by TPE_worldStep, it's public for applying fields by other means. */
+void TPE_forceFieldsApply(const TPE_ForceField *fields, uint8_t fieldCount,
+  TPE_Joint *joint);
+
 /** Gets orientation (rotation) of a body from a position of three of its
   joints. The vector from joint1 to joint2 is considered the body's forward
   direction, the vector from joint1 to joint3 its right direction. The returned
@@ -364,7 +571,9 @@ TPE_Joint TPE_joint(TPE_Vec3 position, TPE_Unit size);
 
 /** Mostly for internal use, resolves a potential collision of two joints in a
   way that keeps the joints outside provided environment (if the function
-  pointer is not 0). Returns 1 if joints collided or 0 otherwise. */
+  pointer is not 0). Mass of TPE_INFINITY means the joint won't be moved or
+  have its velocity changed (only one of the masses can be infinite). Returns 1
+  if joints collided or 0 otherwise. */
 uint8_t TPE_jointsResolveCollision(TPE_Joint *j1, TPE_Joint *j2,
   TPE_Unit mass1, TPE_Unit mass2, TPE_Unit elasticity, TPE_Unit friction,
   TPE_ClosestPointFunction env);
@@ -448,6 +657,151 @@ TPE_Vec3 TPE_castEnvironmentRay(TPE_Vec3 rayPos, TPE_Vec3 rayDir,
 TPE_Vec3 TPE_castBodyRay(TPE_Vec3 rayPos, TPE_Vec3 rayDir, int16_t excludeBody,
   const TPE_World *world, int16_t *bodyIndex, int16_t *jointIndex);
 
+#ifndef TPE_SENSOR_MAX_BODIES
+  /** Maximum number of bodies a sensor keeps track of at once (at most 32),
+    further overlapping bodies are ignored until some of them leave. */
+  #define TPE_SENSOR_MAX_BODIES 8
+#endif
+
+#if TPE_SENSOR_MAX_BODIES <= 8
+  typedef uint8_t _TPE_SensorMask;
+#elif TPE_SENSOR_MAX_BODIES <= 16
+  typedef uint16_t _TPE_SensorMask;
+#elif TPE_SENSOR_MAX_BODIES <= 32
+  typedef uint32_t _TPE_SensorMask;
+#else
+  #error "TPE_SENSOR_MAX_BODIES can't be more than 32"
+#endif
+
+#define TPE_SENSOR_EVENT_ENTER 0 ///< body started overlapping the sensor
+#define TPE_SENSOR_EVENT_STAY 1  ///< body keeps overlapping the sensor
+#define TPE_SENSOR_EVENT_EXIT 2  ///< body stopped overlapping the sensor
+
+/** Sensor (trigger) volume, a sphere that doesn't collide with anything but
+  reports bodies overlapping it, useful for pickups, checkpoints, zones etc.
+  It's much cheaper than a body with a collision callback returning 0 as it's
+  only tested against body AABBs and then joint spheres, and deactivated and
+  static bodies can be skipped until the sensor moves or changes size (see
+  TPE_worldUpdateSensors).
+  The position can be changed freely (e.g. to follow a body). Initialize it
+  with TPE_sensor. */
+typedef struct
+{
+  TPE_Vec3 position;
+  TPE_Unit radius;
+  uint16_t bodies[TPE_SENSOR_MAX_BODIES]; ///< bodies overlapping now
+  uint8_t bodyCount;
+  _TPE_SensorMask seen;                   ///< internal, bit per bodies item
+  TPE_Vec3 lastPosition;                  ///< internal, at the last update
+  TPE_Unit lastRadius;                    ///< internal, at the last update
+} TPE_Sensor;
+
+typedef struct
+{
+  uint16_t sensor; ///< index of the sensor
+  uint16_t body;   ///< index of the body in the world
+  uint8_t type;    ///< TPE_SENSOR_EVENT_* constant
+} TPE_SensorEvent;
+
+TPE_Sensor TPE_sensor(TPE_Vec3 position, TPE_Unit radius);
+
+/** Tests given sensors against the world's bodies (not disabled ones), to be
+  called after each TPE_worldStep. Enter and stay events are written to the
+  events buffer in the order of bodies, exit events follow. At most maxEvents
+  events are written, the returned number is the count of all events (it can
+  be bigger, then some were dropped). bodyFlags is an optional array (one item
+  per body, zeroed by the caller before the first update, one array per set of
+  sensors) in which the function keeps the body flags of the last update, it
+  is used to skip deactivated and static bodies that were already so at the
+  last update (those are assumed not to have moved, so if you move such a body
+  manually, activate it first); if it's 0, all bodies are always tested. */
+uint16_t TPE_worldUpdateSensors(const TPE_World *world, TPE_Sensor *sensors,
+  uint16_t sensorCount, uint8_t *bodyFlags, TPE_SensorEvent *events,
+  uint16_t maxEvents);
+
+/** Character controller, e.g. for players or NPCs: moves a kinematic body
+  (e.g. a vertical 2line) by collide-and-slide against the environment and
+  the world's static and kinematic bodies, with stepping up on low obstacles
+  and a slope limit. Standing on a kinematic body (a moving platform) carries
+  the character along. Unlike a dynamic non-rotating body it needs no extra
+  ground probing (the ground contact is remembered from the last move) and
+  the environment isn't resolved again by TPE_worldStep: walking on ground
+  takes one environment query per joint, roughly half the time of such a body
+  controlled as in player.c (measured by micro.c). Being kinematic, the
+  character pushes dynamic bodies but isn't pushed by them. */
+typedef struct
+{
+  TPE_Body *body;         ///< kinematic body of the character
+  TPE_Vec3 velocity;      ///< own velocity (falling, jumping, ...) per tick
+  TPE_Unit stepHeight;    ///< maximum height of obstacles stepped onto
+  TPE_Unit slopeLimit;    ///< minimum normal y of walkable ground (of TPE_F)
+  TPE_Vec3 groundNormal;  ///< normal of the ground touched in the last move
+  int32_t groundBody;     ///< body stood on in the last move, -1 if none
+  uint8_t onGround;       ///< whether ground was touched in the last move
+} TPE_Character;
+
+/** Initializes a character controller with given body (which is made
+  kinematic), step height of half the size of the body's first joint and slope
+  limit of 45 degrees. */
+void TPE_characterInit(TPE_Character *character, TPE_Body *body);
+
+/** Moves a character by move (walking, usually horizontal, per tick) plus its
+  velocity to which gravity is added first. The resulting movement is set as
+  the body's joint velocities so it's performed by the following TPE_worldStep
+  of given world (which the body has to be in). Returns 1 if the character is
+  on ground, else 0. */
+uint8_t TPE_characterMove(TPE_Character *character, TPE_Vec3 move,
+  TPE_Unit gravity, const TPE_World *world);
+
+#define TPE_VEHICLE_MAX_WHEELS 8
+
+/** Raycast vehicle, a cheap alternative to cars made of joints: the chassis is
+  a body whose joints are the mounts of the wheels (at most
+  TPE_VEHICLE_MAX_WHEELS), the wheels themselves aren't joints but spheres
+  cast from the mounts along the suspension against the environment. A wheel
+  touching the environment pushes its mount up by a spring and damper and
+  applies tyre friction and drive to it, the rest is done by TPE_worldStep.
+  The chassis orientation is taken from its first three joints: forward is the
+  direction from joint 0 to joint 2, left from joint 0 to joint 1 (as with
+  TPE_makeRect and the joints 0 and 1 at the back). The chassis joints only
+  touch the environment when the vehicle lands on its side or roof. Wheels
+  don't collide with bodies. */
+typedef struct
+{
+  TPE_Body *body;             ///< chassis, its joints are the wheel mounts
+  TPE_Unit wheelRadius;
+  TPE_Unit suspensionLength;  ///< suspension travel below the mount
+  TPE_Unit stiffness;         /**< spring, velocity change per tick per unit of
+                                   compression (of TPE_F) */
+  TPE_Unit damping;           /**< damper, velocity change per tick per unit of
+                                   compression change (of TPE_F) */
+  TPE_Unit sideFriction;      ///< part of side sliding cancelled (of TPE_F)
+  TPE_Unit rollFriction;      ///< part of rolling cancelled (of TPE_F)
+  TPE_Unit steering;          ///< angle of steered wheels, positive = left
+  TPE_Unit throttle;          ///< acceleration of driven wheels per tick
+  uint8_t steeredWheels;      ///< bit mask of steered wheels
+  uint8_t drivenWheels;       ///< bit mask of driven wheels
+  uint8_t onGround;           ///< bit mask of wheels touching the environment
+  TPE_Unit compression[TPE_VEHICLE_MAX_WHEELS]; ///< current, 0 in the air
+} TPE_Vehicle;
+
+/** Initializes a vehicle with given chassis body which is made always active.
+  The default setup is for a four wheel chassis made with TPE_makeRect: front
+  wheels (joints 2 and 3) steered, rear ones (joints 0 and 1) driven, critical
+  damping. */
+void TPE_vehicleInit(TPE_Vehicle *vehicle, TPE_Body *body,
+  TPE_Unit wheelRadius, TPE_Unit suspensionLength);
+
+/** Casts the wheels and applies the suspension, tyre friction and drive to the
+  chassis joints, to be called each tick before TPE_worldStep (with gravity
+  applied by the caller as to other bodies). Returns the onGround bit mask. */
+uint8_t TPE_vehicleUpdate(TPE_Vehicle *vehicle, TPE_ClosestPointFunction env);
+
+/** Returns the current position of a wheel's center, e.g. for rendering. For
+  a wheel index out of range (not a joint of the chassis or not below
+  TPE_VEHICLE_MAX_WHEELS) a zero vector is returned. */
+TPE_Vec3 TPE_vehicleWheelPosition(const TPE_Vehicle *vehicle, uint8_t wheel);
+
 /** Performs one step (tick, frame, ...) of the physics world simulation
   including updating positions and velocities of bodies, collision detection and
   resolution, possible reshaping or deactivation of inactive bodies etc. The
@@ -455,6 +809,68 @@ TPE_Vec3 TPE_castBodyRay(TPE_Vec3 rayPos, TPE_Vec3 rayDir, int16_t excludeBody,
   1/30th of a second. */
 void TPE_worldStep(TPE_World *world);
 
+/* TPE_worldStep is composed of the following stages which can also be called
+  directly, e.g. to insert custom forces between stages or to interleave the
+  step with other work. TPE_worldStep does exactly this:
+
+  TPE_worldStepBegin(world);
+
+  for each body i that is neither deactivated, disabled nor static:
+    TPE_worldStepIntegrate(world,i);
+    TPE_worldStepEnvironment(world,i);
+    TPE_worldStepSolve(world,i);
+    TPE_worldStepBroadphase(world,i); // calls TPE_worldStepNarrowphase
+    TPE_worldStepSleep(world,i);
+
+  TPE_worldStepEnd(world);
+
+  Ordering guarantees: each body goes through the stages in the above order
+  and a body is completely stepped before the next one, i.e. bodies with
+  lower indices have already been moved when a body collides with them.
+  Changing the order (e.g. integrating all bodies before resolving any
+  collisions) is allowed but gives different (non-deterministic with regards
+  to TPE_worldStep) results, and per body times of statistics are only
+  correct in the above order. The stages are meant for inserting user work
+  between them, not for running them concurrently: they share global state
+  of the step in progress (and bodies of the world), so no two stages may run
+  at the same time, not even for different bodies or worlds. */
+
+/** Starts a step of given world, to be called before any other stage. */
+void TPE_worldStepBegin(TPE_World *world);
+
+/** Applies force fields and velocities to joints of given body (kinematic
+  bodies only move by their velocities). */
+void TPE_worldStepIntegrate(TPE_World *world, uint16_t bodyIndex);
+
+/** Resolves collisions of given body with the environment (not for kinematic
+  bodies), it must directly follow TPE_worldStepIntegrate of the same body
+  (non-rotating bodies that can't be pushed out are moved back to their
+  position from before the integration). */
+void TPE_worldStepEnvironment(TPE_World *world, uint16_t bodyIndex);
+
+/** Solves connections of given body: tension, reshaping and canceling out of
+  velocities (does nothing for non-rotating and kinematic bodies). */
+void TPE_worldStepSolve(TPE_World *world, uint16_t bodyIndex);
+
+/** Finds bodies possibly colliding with given body by AABB tests (bodies with
+  higher indices and deactivated ones, so that each pair is tested once) and
+  calls TPE_worldStepNarrowphase for each of them, static bodies are looked
+  up in the world's static index. If the body was the last
+  one integrated, its AABB from right after integration is used. */
+void TPE_worldStepBroadphase(TPE_World *world, uint16_t bodyIndex);
+
+/** Resolves collision of two bodies, waking both up if they collided, returns
+  1 if they collided, otherwise 0. Can be called directly when using custom
+  broadphase. */
+uint8_t TPE_worldStepNarrowphase(TPE_World *world, uint16_t bodyIndex,
+  uint16_t otherIndex);
+
+/** Handles deactivation (sleeping) of given body. */
+void TPE_worldStepSleep(TPE_World *world, uint16_t bodyIndex);
+
+/** Ends a step started with TPE_worldStepBegin. */
+void TPE_worldStepEnd(TPE_World *world);
+
 void TPE_worldDeactivateAll(TPE_World *world);
 void TPE_worldActivateAll(TPE_World *world);
 
@@ -501,6 +917,11 @@ void TPE_bodyAccelerate(TPE_Body *body, TPE_Vec3 velocity);
 
 void TPE_bodyApplyGravity(TPE_Body *body, TPE_Unit downwardsAccel);
 
+/** Sets velocities of a kinematic body (TPE_BODY_FLAG_KINEMATIC) so that its
+  center of mass gets to given position in the next step, all joints move by
+  the same offset. */
+void TPE_bodyKinematicMoveTo(TPE_Body *body, TPE_Vec3 position);
+
 /** Adds angular velocity to a soft body. The rotation vector specifies the axis
   of rotation by its direction and angular velocity by its magnitude (magnitude
   of TPE_FRACTIONS_PER_UNIT will add linear velocity of TPE_FRACTIONS_PER_UNIT
@@ -539,11 +960,67 @@ void TPE_worldDebugDraw(TPE_World *world, TPE_DebugDrawFunction drawFunc,
   TPE_Vec3 camPos, TPE_Vec3 camRot, TPE_Vec3 camView, uint16_t envGridRes,
   TPE_Unit envGridSize);
 
+/** Cache of environment samples for TPE_worldDebugDrawCached, so that the
+  environment function doesn't have to be evaluated on the whole probe grid
+  every frame. */
+typedef struct
+{
+  TPE_Vec3 *samples;   ///< caller's array of resolution^3 samples
+  uint16_t resolution; ///< probe grid resolution (as envGridRes)
+  TPE_Unit cellSize;   ///< probe grid cell size (as envGridSize)
+  TPE_Vec3 cell;       ///< grid coordinates of the cached grid's center cell
+  uint8_t valid;       ///< 0 means all samples will be taken again
+} TPE_DebugDrawCache;
+
+/** Initializes a debug draw cache over caller's array of samples which must
+  have envGridRes^3 items. */
+void TPE_debugDrawCacheInit(TPE_DebugDrawCache *cache, TPE_Vec3 *samples,
+  uint16_t envGridRes, TPE_Unit envGridSize);
+
+/** Marks all samples of a debug draw cache as invalid, call this when the
+  environment changes (e.g. a moving platform) to get it redrawn correctly. */
+#define TPE_debugDrawCacheInvalidate(cache) ((cache)->valid = 0)
+
+/** Same as TPE_worldDebugDraw but the environment is probed through a cache
+  (see TPE_DebugDrawCache) which holds the grid resolution and cell size: only
+  the grid cells that came into view since the last call (as the camera moved)
+  are sampled. */
+void TPE_worldDebugDrawCached(TPE_World *world,
+  TPE_DebugDrawFunction drawFunc, TPE_Vec3 camPos, TPE_Vec3 camRot,
+  TPE_Vec3 camView, TPE_DebugDrawCache *cache);
+
 #define TPE_DEBUG_COLOR_CONNECTION 0
 #define TPE_DEBUG_COLOR_JOINT 1
 #define TPE_DEBUG_COLOR_ENVIRONMENT 2
 #define TPE_DEBUG_COLOR_INACTIVE 3
 
+#define TPE_DEBUG_PRIMITIVE_LINE 0   ///< line from a to b
+#define TPE_DEBUG_PRIMITIVE_SPHERE 1 ///< sphere at a with radius b.x
+#define TPE_DEBUG_PRIMITIVE_POINT 2  ///< point at a
+
+/** World space primitive of a debug view, see TPE_worldDebugPrimitives. */
+typedef struct
+{
+  TPE_Vec3 a;
+  TPE_Vec3 b;
+  uint8_t type;  ///< TPE_DEBUG_PRIMITIVE_* constant
+  uint8_t color; ///< TPE_DEBUG_COLOR_* constant
+} TPE_DebugPrimitive;
+
+/** Alternative to TPE_worldDebugDraw that doesn't project and draw anything but
+  fills given buffer with world space primitives (lines for connections,
+  spheres for joints and points for the environment) which can then be rendered
+  in batches by the caller, e.g. by GPU. The environment is probed on a grid
+  like in TPE_worldDebugDraw, centered at envGridCenter (e.g. a point in front
+  of the camera), with the resolution and cell size of given cache (see
+  TPE_DebugDrawCache) through which the samples are reused between calls,
+  cache 0 skips the environment. At most maxCount primitives are written, the
+  returned number is the count of all primitives of the view, which may be
+  bigger (then a bigger buffer is needed). */
+uint32_t TPE_worldDebugPrimitives(const TPE_World *world,
+  TPE_DebugPrimitive *buffer, uint32_t maxCount, TPE_Vec3 envGridCenter,
+  TPE_DebugDrawCache *cache);
+
 uint32_t TPE_jointHash(const TPE_Joint *joint);
 uint32_t TPE_connectionHash(const TPE_Connection *connection);
 uint32_t TPE_bodyHash(const TPE_Body *body);
@@ -553,6 +1030,248 @@ uint32_t TPE_bodyHash(const TPE_Body *body);
   possibly not all of it, for details check the code. */
 uint32_t TPE_worldHash(const TPE_World *world);
 
+/** Cached hash of one body, for incremental world hashing, see
+  TPE_WorldHashCache. */
+typedef struct
+{
+  uint32_t hash;           ///< full hash of the body (mixed with its index)
+  uint32_t staticHash;     ///< hash of the static part (connections, mass...)
+  uint8_t flags;           ///< body flags at the time of hashing
+} TPE_BodyHashCache;
+
+/** Incrementally maintained world hash, an alternative to TPE_worldHash for
+  when the hash is needed very often (e.g. every tick for desync detection).
+  Per body hashes are combined in an order independent way (a sum, with each
+  body hash mixed with the body's index so that order of bodies still matters)
+  so that only the bodies that could have changed since the last update (the
+  active ones and the ones that were just deactivated) have to be rehashed,
+  sleeping and disabled bodies cost nothing. The static part of bodies
+  (connections, masses, frictions, elasticities) is only hashed on init. The
+  resulting hash detects the same differences in state as TPE_worldHash but
+  has a different value. */
+typedef struct
+{
+  TPE_BodyHashCache *bodies; ///< caller provided array, one item per body
+  uint16_t bodyCount;
+  uint32_t sum;              ///< sum of all body hashes
+  uint32_t hash;             ///< resulting world hash
+} TPE_WorldHashCache;
+
+/** Initializes the incremental world hash cache by hashing the whole world.
+  This has to be called again whenever bodies are added/removed or their
+  static properties (connections etc.) change. The bodyCaches array must have
+  at least as many items as the world has bodies. */
+void TPE_worldHashCacheInit(TPE_WorldHashCache *cache,
+  TPE_BodyHashCache *bodyCaches, const TPE_World *world);
+
+/** Updates the incremental world hash (normally after each TPE_worldStep) and
+  returns it. Only active bodies and bodies whose flags have changed are
+  rehashed, so if you manually change a sleeping body without changing its
+  flags (e.g. move it), you have to report it with
+  TPE_worldHashCacheBodyChanged. */
+uint32_t TPE_worldHashCacheUpdate(TPE_WorldHashCache *cache,
+  const TPE_World *world);
+
+/** Rehashes given body in the incremental world hash cache, use this after
+  manually changing a sleeping body. */
+void TPE_worldHashCacheBodyChanged(TPE_WorldHashCache *cache,
+  const TPE_World *world, uint16_t bodyIndex);
+
+/** Upper bound of the number of items of the array needed by
+  TPE_worldHashTree for given number of bodies. */
+#define TPE_HASH_TREE_SIZE(bodyCount) (4 * (bodyCount) + 2)
+
+/** Computes a hash tree (Merkle tree) of the world into given array (which
+  must have at least TPE_HASH_TREE_SIZE items) and returns the number of tree
+  leaves (the body count rounded up to a power of two). This serves to quickly
+  find where two states of the world differ, e.g. when peers of a network game
+  desync: they can exchange the tree level by level, descending only into the
+  differing nodes (see TPE_hashTreeDescend) which pinpoints the diverging body
+  in log2(bodyCount) round trips. The tree is stored as a binary heap: item 1
+  is the root (hash of the whole world, differs from TPE_worldHash), children
+  of item N are items 2 * N and 2 * N + 1, level L occupies items 2^L to
+  2^(L + 1) - 1 and item leafCount + B is the hash of body B (TPE_bodyHash),
+  unused leaves are 0. */
+uint32_t TPE_worldHashTree(const TPE_World *world, uint32_t *tree);
+
+/** Performs one step of finding a difference between a local hash tree and a
+  remote one: given a differing tree node and the remote values of its two
+  children, returns the index of the child in which the trees differ (the left
+  one is preferred), or 0 if both children match (which means the node values
+  didn't really differ). Once the returned index is greater or equal to the
+  leaf count, it's a leaf and index - leafCount is the differing body. */
+uint32_t TPE_hashTreeDescend(const uint32_t *tree, uint32_t node,
+  uint32_t remoteLeft, uint32_t remoteRight);
+
+/** Compares two hash trees with the same leaf count (e.g. when the whole
+  remote tree is available) and returns the index of the first body in which
+  they differ, or -1 if the trees are the same. */
+int32_t TPE_hashTreeFirstDifference(const uint32_t *tree1,
+  const uint32_t *tree2, uint32_t leafCount);
+
+/** Size in bytes of a world snapshot (see TPE_worldSnapshot) for a world with
+  given total number of joints and bodies, can be used to statically allocate
+  snapshot buffers. */
+#define TPE_SNAPSHOT_SIZE(jointCount,bodyCount) \
+  ((jointCount) * sizeof(TPE_Joint) + (bodyCount) * 2)
+
+/** Returns the size in bytes of a snapshot of given world, i.e. the size of a
+  buffer needed by TPE_worldSnapshot. */
+uint32_t TPE_worldSnapshotSize(const TPE_World *world);
+
+/** Saves the part of the world state that changes during simulation (joint
+  positions and velocities, body flags and deactivation counters) into a
+  caller-provided buffer that must be at least TPE_worldSnapshotSize bytes big
+  and aligned for TPE_Joint (e.g. declare it as an array of TPE_Joint or
+  uint32_t). The static topology (connections, masses, frictions, elasticities,
+  joint and body counts) is NOT saved, it's expected to stay the same, so a
+  snapshot can only be restored to the same world (or an identically built
+  one). This is meant to be fast (e.g. for rollback netcode), no allocation is
+  done. Returns the number of bytes written. */
+uint32_t TPE_worldSnapshot(const TPE_World *world, void *buffer);
+
+/** Restores the world state from a snapshot made by TPE_worldSnapshot, see its
+  description. If static bodies differ from those in the snapshot, the static
+  index is rebuilt (bodies that don't fit in it stop being static). Returns the
+  number of bytes read. */
+uint32_t TPE_worldRestore(TPE_World *world, const void *buffer);
+
+/** Upper bound of the size in bytes of data produced by
+  TPE_snapshotEncodeDelta for a world with given total number of joints and
+  bodies. */
+#define TPE_DELTA_MAX_SIZE(jointCount,bodyCount) \
+  (1 + (bodyCount) * 5 + (jointCount) * 24)
+
+/** Encodes a difference between two snapshots (see TPE_worldSnapshot) of given
+  world (which here only serves to provide the snapshot layout, i.e. joint
+  counts and sizes of bodies) into a compact byte stream, e.g. for sending the
+  world state over network. Bodies that haven't changed (e.g. sleeping ones)
+  are skipped, joint positions are quantized (see TPE_DELTA_QUANTIZATION) and
+  XOR-ed with the previous values so that only the changed bits are stored, all
+  numbers are stored as variable length integers. If previous is 0, a keyframe
+  (a full state not depending on any previous state) is encoded. The out buffer
+  has to be at least TPE_DELTA_MAX_SIZE bytes big. Returns the number of bytes
+  written. */
+uint32_t TPE_snapshotEncodeDelta(const TPE_World *world, const void *previous,
+  const void *current, uint8_t *out);
+
+/** Decodes data encoded with TPE_snapshotEncodeDelta, i.e. reconstructs the
+  current snapshot from the previous one (which may be 0 if the data is a
+  keyframe). The current and previous pointers may point to the same buffer (in
+  which case the snapshot is updated in place). The data (of size bytes, e.g.
+  as received over network) isn't trusted, reading never goes past its end.
+  Returns the number of bytes read or 0 if the data is truncated or malformed,
+  in which case the current snapshot may be partially overwritten. */
+uint32_t TPE_snapshotDecodeDelta(const TPE_World *world, const void *previous,
+  const uint8_t *data, uint32_t size, void *current);
+
+/** State of a delta encoded stream of snapshots, each end (encoder and
+  decoder) keeps its own. */
+typedef struct
+{
+  void *previous;            ///< last state, buffer of snapshot size
+  uint16_t keyframeInterval; ///< keyframe every N frames, 0 = only 1st frame
+  uint16_t frame;
+} TPE_DeltaStream;
+
+/** Initializes a delta stream, previousBuffer has to be a buffer big enough to
+  hold the world snapshot (same conditions as with TPE_worldSnapshot). */
+void TPE_deltaStreamInit(TPE_DeltaStream *stream, void *previousBuffer,
+  uint16_t keyframeInterval);
+
+/** Encodes next frame of a delta stream given the current world snapshot,
+  automatically inserting keyframes according to the keyframe interval. Returns
+  the number of bytes written to out. */
+uint32_t TPE_deltaStreamEncode(TPE_DeltaStream *stream, const TPE_World *world,
+  const void *current, uint8_t *out);
+
+/** Decodes next frame of a delta stream (produced by TPE_deltaStreamEncode)
+  of size bytes into the current snapshot (which may then be restored with
+  TPE_worldRestore). Returns the number of bytes read or 0 if the data is
+  truncated or malformed (see TPE_snapshotDecodeDelta), then the stream stays
+  as it was. */
+uint32_t TPE_deltaStreamDecode(TPE_DeltaStream *stream, const TPE_World *world,
+  const uint8_t *data, uint32_t size, void *current);
+
+/* Types of input log entries, each entry is the type byte followed by its
+  varint encoded arguments. */
+#define TPE_INPUT_STEP 0           ///< world step (end of tick), no args
+#define TPE_INPUT_CHECKPOINT 1     ///< world hash after step, 4 bytes
+#define TPE_INPUT_ACCELERATE 2     ///< body, velocity (3 values)
+#define TPE_INPUT_SPIN 3           ///< body, rotation (3 values)
+#define TPE_INPUT_GRAVITY 4        ///< body, acceleration
+#define TPE_INPUT_JOINT_PIN 5      ///< body, joint, position (3 values)
+#define TPE_INPUT_JOINT_VELOCITY 6 ///< body, joint, velocity (3 values)
+#define TPE_INPUT_PARAMETER 7      ///< parameter index, value
+
+/** Maximum size in bytes of a single input log entry. */
+#define TPE_INPUT_LOG_MAX_ENTRY 24
+
+/** Log of external inputs to the world (body accelerations, gravity, pins,
+  environment parameters etc.) recorded per tick, with periodic world hash
+  checkpoints. Together with world snapshots this allows rewinding the world
+  to any recorded tick and deterministically re-simulating it (e.g. for
+  rollback netcode or replays), while the checkpoints detect that the
+  re-simulation went differently (i.e. the log is incomplete or the code is
+  not deterministic). The log is a compact byte stream in a user provided
+  buffer, the record functions (TPE_inputLog*) apply the input to the world
+  and write it to the log in one go, so these are to be called instead of the
+  plain functions. */
+typedef struct
+{
+  uint8_t *data;
+  uint32_t size;               ///< bytes used
+  uint32_t capacity;           ///< size of the data buffer
+  uint32_t tick;               ///< number of recorded steps
+  uint16_t checkpointInterval; ///< checkpoint every N ticks, 0 = none
+
+  /** Function through which environment parameters (anything the
+    environment function depends on and that may change, e.g. a door
+    position) are set, called both when recording and replaying, may be 0. */
+  void (*parameterFunction)(uint8_t index, int32_t value);
+} TPE_InputLog;
+
+/** Initializes an empty input log in given buffer. */
+void TPE_inputLogInit(TPE_InputLog *inputLog, uint8_t *buffer,
+  uint32_t capacity, uint16_t checkpointInterval);
+
+/* The following functions apply the input to given body of the world and
+  record it, they return 1 on success or 0 if the log is full (in which case
+  nothing is done). */
+
+uint8_t TPE_inputLogAccelerate(TPE_InputLog *inputLog, TPE_World *world,
+  uint16_t body, TPE_Vec3 velocity);
+uint8_t TPE_inputLogSpin(TPE_InputLog *inputLog, TPE_World *world,
+  uint16_t body, TPE_Vec3 rotation);
+uint8_t TPE_inputLogApplyGravity(TPE_InputLog *inputLog, TPE_World *world,
+  uint16_t body, TPE_Unit downwardsAccel);
+uint8_t TPE_inputLogJointPin(TPE_InputLog *inputLog, TPE_World *world,
+  uint16_t body, uint8_t joint, TPE_Vec3 position);
+uint8_t TPE_inputLogJointVelocity(TPE_InputLog *inputLog, TPE_World *world,
+  uint16_t body, uint8_t joint, TPE_Vec3 velocity);
+
+/** Sets an environment parameter through the log's parameterFunction and
+  records it. Returns 1 on success, 0 if the log is full. */
+uint8_t TPE_inputLogParameter(TPE_InputLog *inputLog, uint8_t index,
+  int32_t value);
+
+/** Steps the world and records the end of the tick (plus a hash checkpoint if
+  it's due). Returns 1 on success, 0 if the log is full. */
+uint8_t TPE_inputLogStep(TPE_InputLog *inputLog, TPE_World *world);
+
+/** Returns the byte offset in the log at which given tick starts, or the log
+  size if the tick hasn't been recorded. */
+uint32_t TPE_inputLogTickOffset(const TPE_InputLog *inputLog, uint32_t tick);
+
+/** Re-simulates recorded ticks from fromTick (including) to toTick
+  (excluding), the world must be in the state at the start of fromTick (e.g.
+  restored from a snapshot taken then). Checkpoints are verified on the way;
+  returns -1 if all checkpoints matched, otherwise the tick (after which the
+  hash was recorded) at which the first mismatch was found (re-simulation
+  stops there). */
+int32_t TPE_inputLogReplay(const TPE_InputLog *inputLog, TPE_World *world,
+  uint32_t fromTick, uint32_t toTick);
+
 // FUNCTIONS FOR GENERATING BODIES
 
 void TPE_makeBox(TPE_Joint joints[8], TPE_Connection connections[16],
@@ -626,6 +1345,62 @@ TPE_Vec3 TPE_envAATriPrism(TPE_Vec3 point, TPE_Vec3 center,
 
 uint16_t _TPE_body1Index, _TPE_body2Index, _TPE_joint1Index, _TPE_joint2Index;
 TPE_CollisionCallback _TPE_collisionCallback;
+TPE_ClosestPointFunction _TPE_stepEnvironment; ///< env. of the step in progress
+
+/* AABB of the last integrated body (taken right after integration), used by
+  the following broadphase of the same body. */
+TPE_Vec3 _TPE_stepAABBMin, _TPE_stepAABBMax;
+int32_t _TPE_stepAABBBody = -1;
+
+/* Position of the 1st joint of the last integrated body before integration,
+  non-rotating bodies are moved back there if they can't get out of the
+  environment. */
+TPE_Vec3 _TPE_stepOrigPos;
+
+#if TPE_STATS
+/* Statistics of the step in progress (0 if not collected), the environment
+  function is called through a counting wrapper then. */
+TPE_WorldStats *_TPE_stats = 0;
+TPE_ClosestPointFunction _TPE_statsEnvironment;
+uint64_t _TPE_statsTime, _TPE_statsBodyStartTime;
+
+#define _TPE_STATS_ADD(field,n) \
+  do { if (_TPE_stats != 0) _TPE_stats->field += (n); } while (0)
+
+// ends a phase of the step, starts the next one
+#define _TPE_STATS_PHASE(phase) \
+  do \
+  { \
+    if (_TPE_stats != 0) \
+    { \
+      uint64_t t = TPE_STATS_TIME(); \
+      _TPE_stats->phaseTimes[phase] += t - _TPE_statsTime; \
+      _TPE_stats->phaseCounts[phase]++; \
+      _TPE_statsTime = t; \
+    } \
+  } while (0)
+#else
+  #define _TPE_STATS_ADD(field,n) do {} while (0)
+  #define _TPE_STATS_PHASE(phase) do {} while (0)
+#endif
+
+#if TPE_PROFILE
+  #define _TPE_PROFILE_BEGIN(name) do { TPE_PROFILE_BEGIN(name); } while (0)
+  #define _TPE_PROFILE_END(name) do { TPE_PROFILE_END(name); } while (0)
+
+TPE_ClosestPointFunction _TPE_profileEnvironment;
+
+TPE_Vec3 _TPE_profiledEnvironment(TPE_Vec3 point, TPE_Unit maxDistance)
+{
+  TPE_PROFILE_BEGIN("environment function");
+  point = _TPE_profileEnvironment(point,maxDistance);
+  TPE_PROFILE_END("environment function");
+  return point;
+}
+#else
+  #define _TPE_PROFILE_BEGIN(name) do {} while (0)
+  #define _TPE_PROFILE_END(name) do {} while (0)
+#endif
 
 static inline TPE_Unit TPE_nonZero(TPE_Unit x)
 {
@@ -789,6 +1564,7 @@ void TPE_bodyInit(TPE_Body *body,
   body->connections = connections;
   body->connectionCount = connectionCount;
   body->deactivateCount = 0;
+  body->staticRun = 0;
   body->friction = TPE_F / 2;
   body->elasticity = TPE_F / 2;
   body->flags = 0;
@@ -816,6 +1592,263 @@ void TPE_worldInit(TPE_World *world, TPE_Body *bodies, uint16_t bodyCount,
   world->bodyCount = bodyCount;
   world->environmentFunction = environmentFunction;
   world->collisionCallback = 0;
+  world->forceFields = 0;
+  world->forceFieldCount = 0;
+  world->statics = 0;
+  world->staticCount = 0;
+  world->staticCapacity = 0;
+  world->staticMaxWidth = 0;
+#if TPE_STATS
+  world->stats = 0;
+#endif
+}
+
+TPE_ForceField TPE_forceField(uint8_t type, TPE_Vec3 vector,
+  TPE_Unit strength)
+{
+  TPE_ForceField f;
+
+  f.type = type;
+  f.volume = TPE_FORCE_VOLUME_ALL;
+  f.strength = strength;
+  f.vector = vector;
+  f.center = TPE_vec3(0,0,0);
+  f.size = TPE_vec3(0,0,0);
+
+  return f;
+}
+
+void TPE_worldSetStaticBuffer(TPE_World *world, TPE_StaticEntry *entries,
+  uint16_t capacity)
+{
+  world->statics = entries;
+  world->staticCount = 0;
+  world->staticCapacity = capacity;
+  world->staticMaxWidth = 0;
+}
+
+/* Returns the index of the first static entry whose aabbMin.x is not lower
+  than x. */
+uint16_t _TPE_staticLowerBound(const TPE_World *world, TPE_Unit x)
+{
+  uint16_t a = 0, b = world->staticCount;
+
+  while (a < b)
+  {
+    uint16_t m = (a + b) / 2;
+
+    if (world->statics[m].aabbMin.x < x)
+      a = m + 1;
+    else
+      b = m;
+  }
+
+  return a;
+}
+
+/* Adds a body to the static index (without touching the body), returns 0 if
+  the index is full. */
+uint8_t _TPE_staticInsert(TPE_World *world, uint16_t bodyIndex)
+{
+  if (world->staticCount >= world->staticCapacity)
+    return 0;
+
+  TPE_StaticEntry e;
+
+  TPE_bodyGetAABB(world->bodies + bodyIndex,&e.aabbMin,&e.aabbMax);
+  e.body = bodyIndex;
+
+  uint16_t index = _TPE_staticLowerBound(world,e.aabbMin.x);
+
+  for (uint16_t i = world->staticCount; i > index; --i)
+    world->statics[i] = world->statics[i - 1];
+
+  world->statics[index] = e;
+  world->staticCount++;
+
+  if (e.aabbMax.x - e.aabbMin.x > world->staticMaxWidth)
+    world->staticMaxWidth = e.aabbMax.x - e.aabbMin.x;
+
+  return 1;
+}
+
+/* Updates the static runs (see TPE_Body) after the static flag of given body
+  changed. */
+void _TPE_staticUpdateRuns(TPE_World *world, uint16_t bodyIndex)
+{
+  uint8_t run = 0;
+
+  if (bodyIndex + 1 < world->bodyCount &&
+    (world->bodies[bodyIndex + 1].flags & TPE_BODY_FLAG_STATIC))
+    run = world->bodies[bodyIndex + 1].staticRun;
+
+  for (uint16_t i = bodyIndex + 1; i > 0; --i)
+  {
+    TPE_Body *body = world->bodies + i - 1;
+
+    if (!(body->flags & TPE_BODY_FLAG_STATIC))
+    {
+      if (i - 1 != bodyIndex)
+        break;
+
+      run = 0;
+      continue;
+    }
+
+    run += run < 255;
+
+    if (i - 1 != bodyIndex && body->staticRun == run)
+      break; // the rest is up to date
+
+    body->staticRun = run;
+  }
+}
+
+/* Rebuilds the static index and the static runs from the bodies' static flags,
+  bodies that don't fit in the index stop being static. */
+void _TPE_worldRebuildStatics(TPE_World *world)
+{
+  uint8_t run = 0;
+
+  world->staticCount = 0;
+  world->staticMaxWidth = 0;
+
+  for (uint16_t i = world->bodyCount; i > 0; --i)
+  {
+    TPE_Body *body = world->bodies + i - 1;
+
+    if ((body->flags & TPE_BODY_FLAG_STATIC) && !_TPE_staticInsert(world,i - 1))
+    {
+      body->flags &= ~TPE_BODY_FLAG_STATIC;
+      body->deactivateCount = 0;
+    }
+
+    if (!(body->flags & TPE_BODY_FLAG_STATIC))
+    {
+      body->staticRun = 0;
+      run = 0;
+      continue;
+    }
+
+    run += run < 255;
+    body->staticRun = run;
+  }
+}
+
+uint8_t TPE_worldFreezeBody(TPE_World *world, uint16_t bodyIndex)
+{
+  TPE_Body *body = world->bodies + bodyIndex;
+
+  if (body->flags & TPE_BODY_FLAG_STATIC)
+    return 1;
+
+  if (!_TPE_staticInsert(world,bodyIndex))
+    return 0;
+
+  TPE_bodyStop(body);
+  body->flags &= ~TPE_BODY_FLAG_DEACTIVATED;
+  body->flags |= TPE_BODY_FLAG_STATIC;
+  body->deactivateCount = 0;
+  _TPE_staticUpdateRuns(world,bodyIndex);
+
+  return 1;
+}
+
+void TPE_worldUnfreezeBody(TPE_World *world, uint16_t bodyIndex)
+{
+  TPE_Body *body = world->bodies + bodyIndex;
+
+  if (!(body->flags & TPE_BODY_FLAG_STATIC))
+    return;
+
+  uint16_t count = 0;
+
+  world->staticMaxWidth = 0;
+
+  for (uint16_t i = 0; i < world->staticCount; ++i)
+    if (world->statics[i].body != bodyIndex)
+    {
+      TPE_StaticEntry *e = world->statics + i;
+
+      if (e->aabbMax.x - e->aabbMin.x > world->staticMaxWidth)
+        world->staticMaxWidth = e->aabbMax.x - e->aabbMin.x;
+
+      world->statics[count] = *e;
+      count++;
+    }
+
+  world->staticCount = count;
+
+  body->flags &= ~TPE_BODY_FLAG_STATIC;
+  _TPE_staticUpdateRuns(world,bodyIndex);
+  body->staticRun = 0;
+  body->deactivateCount = 0;
+  TPE_bodyStop(body);
+}
+
+void TPE_worldSetForceFields(TPE_World *world, const TPE_ForceField *fields,
+  uint8_t fieldCount)
+{
+  world->forceFields = fields;
+  world->forceFieldCount = fieldCount;
+}
+
+void TPE_forceFieldsApply(const TPE_ForceField *fields, uint8_t fieldCount,
+  TPE_Joint *joint)
+{
+  for (uint8_t i = 0; i < fieldCount; ++i)
+  {
+    const TPE_ForceField *f = fields + i;
+    TPE_Vec3 d = TPE_vec3Minus(f->center,joint->position);
+
+    if (f->volume == TPE_FORCE_VOLUME_AABB)
+    {
+      if (TPE_abs(d.x) > f->size.x || TPE_abs(d.y) > f->size.y ||
+        TPE_abs(d.z) > f->size.z)
+        continue;
+    }
+    else if (f->volume == TPE_FORCE_VOLUME_SPHERE)
+    {
+      if (TPE_abs(d.x) > f->size.x || TPE_abs(d.y) > f->size.x ||
+        TPE_abs(d.z) > f->size.x || TPE_LENGTH(d) > f->size.x)
+        continue;
+    }
+
+    switch (f->type)
+    {
+      case TPE_FORCE_FIELD_ACCELERATION:
+        joint->velocity[0] += f->vector.x;
+        joint->velocity[1] += f->vector.y;
+        joint->velocity[2] += f->vector.z;
+        break;
+
+      case TPE_FORCE_FIELD_ATTRACTOR:
+        if (d.x != 0 || d.y != 0 || d.z != 0)
+        {
+          d = TPE_vec3Times(TPE_vec3Normalized(d),f->strength);
+          joint->velocity[0] += d.x;
+          joint->velocity[1] += d.y;
+          joint->velocity[2] += d.z;
+        }
+        break;
+
+      case TPE_FORCE_FIELD_WIND:
+        joint->velocity[0] +=
+          ((f->vector.x - joint->velocity[0]) * f->strength) / TPE_F;
+        joint->velocity[1] +=
+          ((f->vector.y - joint->velocity[1]) * f->strength) / TPE_F;
+        joint->velocity[2] +=
+          ((f->vector.z - joint->velocity[2]) * f->strength) / TPE_F;
+        break;
+
+      case TPE_FORCE_FIELD_DAMPING:
+        for (uint8_t j = 0; j < 3; ++j)
+          joint->velocity[j] -= (joint->velocity[j] * f->strength) / TPE_F;
+        break;
+
+      default: break;
+    }
+  }
 }
   
 #define C(n,a,b) connections[n].joint1 = a; connections[n].joint2 = b;
@@ -910,182 +1943,417 @@ void TPE_bodyDeactivate(TPE_Body *body)
   body->flags |= TPE_BODY_FLAG_DEACTIVATED;
 }
 
-void TPE_worldStep(TPE_World *world)
+#if TPE_STATS
+TPE_Vec3 _TPE_statsCountingEnvironment(TPE_Vec3 point, TPE_Unit maxDistance)
 {
-  _TPE_collisionCallback = world->collisionCallback;
+  _TPE_stats->environmentCalls++;
+  return _TPE_statsEnvironment(point,maxDistance);
+}
 
-  for (uint16_t i = 0; i < world->bodyCount; ++i)
-  {
-    TPE_Body *body = world->bodies + i;   
+/** Records the time spent on a body in the current step. */
+void _TPE_statsBodyDone(uint16_t bodyIndex, uint64_t time)
+{
+  if (_TPE_stats->bodyTimes != 0)
+    _TPE_stats->bodyTimes[bodyIndex] += time;
 
-    if (body->flags & (TPE_BODY_FLAG_DEACTIVATED | TPE_BODY_FLAG_DISABLED))
-      continue; 
+  // insert into the sorted list of the most expensive bodies:
 
-    TPE_Joint *joint = body->joints, *joint2;
+  for (uint8_t i = 0; i < TPE_STATS_TOP_BODIES; ++i)
+    if (time > _TPE_stats->topBodyTimes[i])
+    {
+      for (uint8_t j = TPE_STATS_TOP_BODIES - 1; j > i; --j)
+      {
+        _TPE_stats->topBodies[j] = _TPE_stats->topBodies[j - 1];
+        _TPE_stats->topBodyTimes[j] = _TPE_stats->topBodyTimes[j - 1];
+      }
 
-    TPE_Vec3 origPos = body->joints[0].position;
+      _TPE_stats->topBodies[i] = bodyIndex;
+      _TPE_stats->topBodyTimes[i] = time;
+      break;
+    }
+}
 
-    for (uint16_t j = 0; j < body->jointCount; ++j) // apply velocities
-    {
-      // non-rotating bodies will copy the 1st joint's velocity
+void TPE_worldStatsInit(TPE_WorldStats *stats, uint64_t *bodyTimes)
+{
+  uint8_t *b = (uint8_t *) stats;
 
-      if (body->flags & TPE_BODY_FLAG_NONROTATING)
-        for (uint8_t k = 0; k < 3; ++k)
-          joint->velocity[k] = body->joints[0].velocity[k];
+  for (uint32_t i = 0; i < sizeof(TPE_WorldStats); ++i)
+    b[i] = 0;
 
-      joint->position.x += joint->velocity[0];
-      joint->position.y += joint->velocity[1];
-      joint->position.z += joint->velocity[2];
+  stats->bodyTimes = bodyTimes;
+}
+#endif
 
-      joint++;
-    }
+void TPE_worldStepBegin(TPE_World *world)
+{
+  _TPE_collisionCallback = world->collisionCallback;
 
-    TPE_Connection *connection = body->connections;
+  _TPE_stepEnvironment = world->environmentFunction;
 
-    TPE_Vec3 aabbMin, aabbMax;
+#if TPE_STATS
+  _TPE_stats = world->stats;
 
-    TPE_bodyGetAABB(body,&aabbMin,&aabbMax);
-        
-    _TPE_body1Index = i;
-  
-    _TPE_body2Index = _TPE_body1Index;
+  if (_TPE_stats != 0)
+  {
+    _TPE_statsEnvironment = _TPE_stepEnvironment;
+    _TPE_stepEnvironment = _TPE_statsCountingEnvironment;
+    _TPE_stats->steps++;
 
-    uint8_t collided =    
-      TPE_bodyEnvironmentResolveCollision(body,world->environmentFunction);
+    for (uint8_t i = 0; i < TPE_STATS_TOP_BODIES; ++i)
+      _TPE_stats->topBodyTimes[i] = 0;
+  }
+#endif
 
-    if (body->flags & TPE_BODY_FLAG_NONROTATING)
-    {
-      /* Non-rotating bodies may end up still colliding after environment coll 
-      resolvement (unlike rotating bodies where each joint is ensured separately
-      to not collide). So if still in collision, we try a few more times. If not
-      successful, we simply undo any shifts we've done. This should absolutely
-      prevent any body escaping out of environment bounds. */
- 
-      for (uint8_t i = 0; i < TPE_NONROTATING_COLLISION_RESOLVE_ATTEMPTS; ++i) 
-      {
-        if (!collided)
-          break;
+#if TPE_PROFILE
+  _TPE_profileEnvironment = _TPE_stepEnvironment;
+  _TPE_stepEnvironment = _TPE_profiledEnvironment;
+#endif
+}
 
-        collided =
-          TPE_bodyEnvironmentResolveCollision(body,world->environmentFunction);
-      }
+void TPE_worldStepEnd(TPE_World *world)
+{
+  (void) world;
 
-      if (collided &&
-        TPE_bodyEnvironmentCollide(body,world->environmentFunction))
-        TPE_bodyMoveBy(body,TPE_vec3Minus(origPos,body->joints[0].position));
-    }
-    else // normal, rotating bodies
-    {
-      TPE_Unit bodyTension = 0;
+  _TPE_stepAABBBody = -1;
 
-      for (uint16_t j = 0; j < body->connectionCount; ++j) // joint tension
-      {
-        joint  = &(body->joints[connection->joint1]);
-        joint2 = &(body->joints[connection->joint2]);
+#if TPE_STATS
+  _TPE_stats = 0;
+#endif
+}
 
-        TPE_Vec3 dir = TPE_vec3Minus(joint2->position,joint->position);
+void TPE_worldStepIntegrate(TPE_World *world, uint16_t bodyIndex)
+{
+  TPE_Body *body = world->bodies + bodyIndex;
 
-        TPE_Unit tension = TPE_connectionTension(TPE_LENGTH(dir),
-          connection->length);
+#if TPE_STATS
+  if (_TPE_stats != 0)
+  {
+    _TPE_statsTime = TPE_STATS_TIME();
+    _TPE_statsBodyStartTime = _TPE_statsTime;
+  }
+#endif
 
-        bodyTension += tension > 0 ? tension : -tension;
+  _TPE_PROFILE_BEGIN("integrate");
 
-        if (tension > TPE_TENSION_ACCELERATION_THRESHOLD || 
-          tension < -1 * TPE_TENSION_ACCELERATION_THRESHOLD)
-        {
-          TPE_vec3Normalize(&dir);
-
-          if (tension > TPE_TENSION_GREATER_ACCELERATION_THRESHOLD ||
-            tension < -1 * TPE_TENSION_GREATER_ACCELERATION_THRESHOLD)
-          { 
-            /* apply twice the acceleration after a second threshold, not so
-               elegant but seems to work :) */
-            dir.x *= 2;
-            dir.y *= 2;
-            dir.z *= 2;
-          }
+  TPE_Joint *joint = body->joints;
 
-          dir.x /= TPE_TENSION_ACCELERATION_DIVIDER;
-          dir.y /= TPE_TENSION_ACCELERATION_DIVIDER;
-          dir.z /= TPE_TENSION_ACCELERATION_DIVIDER;
+  _TPE_stepOrigPos = joint->position;
 
-          if (tension < 0)
-          {
-            dir.x *= -1;
-            dir.y *= -1;
-            dir.z *= -1;
-          }
+  for (uint16_t j = 0; j < body->jointCount; ++j) // apply velocities
+  {
+    // non-rotating bodies will copy the 1st joint's velocity
 
-          joint->velocity[0] += dir.x;
-          joint->velocity[1] += dir.y;
-          joint->velocity[2] += dir.z;
+    if (body->flags & TPE_BODY_FLAG_NONROTATING)
+      for (uint8_t k = 0; k < 3; ++k)
+        joint->velocity[k] = body->joints[0].velocity[k];
 
-          joint2->velocity[0] -= dir.x;
-          joint2->velocity[1] -= dir.y;
-          joint2->velocity[2] -= dir.z;
-        }
+    if (world->forceFieldCount != 0 &&
+      !(body->flags & TPE_BODY_FLAG_KINEMATIC) &&
+      (j == 0 || !(body->flags & TPE_BODY_FLAG_NONROTATING)))
+      TPE_forceFieldsApply(world->forceFields,world->forceFieldCount,joint);
 
-        connection++;
-      }
+    joint->position.x += joint->velocity[0];
+    joint->position.y += joint->velocity[1];
+    joint->position.z += joint->velocity[2];
 
-      if (body->connectionCount > 0)
-      {
-        uint8_t hard = !(body->flags & TPE_BODY_FLAG_SOFT);
+    joint++;
+  }
 
-        if (hard)
-        {
-          TPE_bodyReshape(body,world->environmentFunction);
+  TPE_bodyGetAABB(body,&_TPE_stepAABBMin,&_TPE_stepAABBMax);
+  _TPE_stepAABBBody = bodyIndex;
 
-          bodyTension /= body->connectionCount;
-        
-          if (bodyTension > TPE_RESHAPE_TENSION_LIMIT)
-            for (uint8_t k = 0; k < TPE_RESHAPE_ITERATIONS; ++k)
-              TPE_bodyReshape(body,world->environmentFunction);
-        }
-        
-        if (!(body->flags & TPE_BODY_FLAG_SIMPLE_CONN))  
-          TPE_bodyCancelOutVelocities(body,hard);
-      }
-    }
+  _TPE_STATS_PHASE(TPE_STATS_PHASE_INTEGRATE);
+  _TPE_PROFILE_END("integrate");
+}
 
-    for (uint16_t j = 0; j < world->bodyCount; ++j)
-    {
-      if (j > i || (world->bodies[j].flags & TPE_BODY_FLAG_DEACTIVATED))
-      {
-        // firstly quick-check collision of body AA bounding boxes
+void TPE_worldStepEnvironment(TPE_World *world, uint16_t bodyIndex)
+{
+  TPE_Body *body = world->bodies + bodyIndex;
+  TPE_ClosestPointFunction env = _TPE_stepEnvironment;
 
-        TPE_Vec3 aabbMin2, aabbMax2;
-        TPE_bodyGetAABB(&world->bodies[j],&aabbMin2,&aabbMax2);
+  if (body->flags & TPE_BODY_FLAG_KINEMATIC)
+    return;
 
-        _TPE_body2Index = j;
+  _TPE_body1Index = bodyIndex;
+  _TPE_body2Index = _TPE_body1Index;
 
-        if (TPE_checkOverlapAABB(aabbMin,aabbMax,aabbMin2,aabbMax2) &&
-          TPE_bodiesResolveCollision(body,world->bodies + j,
-          world->environmentFunction))
-        {
-          TPE_bodyActivate(body);
-          body->deactivateCount = TPE_LIGHT_DEACTIVATION; 
+  _TPE_PROFILE_BEGIN("environment");
 
-          TPE_bodyActivate(world->bodies + j);
-          world->bodies[j].deactivateCount = TPE_LIGHT_DEACTIVATION;
-        }
-      }
+  uint8_t collided =    
+    TPE_bodyEnvironmentResolveCollision(body,env);
+
+  if (body->flags & TPE_BODY_FLAG_NONROTATING)
+  {
+    /* Non-rotating bodies may end up still colliding after environment coll 
+    resolvement (unlike rotating bodies where each joint is ensured separately
+    to not collide). So if still in collision, we try a few more times. If not
+    successful, we simply undo any shifts we've done. This should absolutely
+    prevent any body escaping out of environment bounds. */
+
+    for (uint8_t i = 0; i < TPE_NONROTATING_COLLISION_RESOLVE_ATTEMPTS; ++i) 
+    {
+      if (!collided)
+        break;
+
+      collided =
+        TPE_bodyEnvironmentResolveCollision(body,env);
     }
 
-    if (!(body->flags & TPE_BODY_FLAG_ALWAYS_ACTIVE))
+    if (collided &&
+      TPE_bodyEnvironmentCollide(body,env))
+      TPE_bodyMoveBy(body,
+        TPE_vec3Minus(_TPE_stepOrigPos,body->joints[0].position));
+  }
+
+  _TPE_STATS_PHASE(TPE_STATS_PHASE_ENVIRONMENT);
+  _TPE_PROFILE_END("environment");
+}
+
+void TPE_worldStepSolve(TPE_World *world, uint16_t bodyIndex)
+{
+  TPE_Body *body = world->bodies + bodyIndex;
+
+  if (body->flags & (TPE_BODY_FLAG_NONROTATING | TPE_BODY_FLAG_KINEMATIC))
+    return;
+
+  TPE_ClosestPointFunction env = _TPE_stepEnvironment;
+  TPE_Connection *connection = body->connections;
+  TPE_Joint *joint, *joint2;
+
+  _TPE_PROFILE_BEGIN("tension");
+
+  TPE_Unit bodyTension = 0;
+
+  for (uint16_t j = 0; j < body->connectionCount; ++j) // joint tension
+  {
+    joint  = &(body->joints[connection->joint1]);
+    joint2 = &(body->joints[connection->joint2]);
+
+    TPE_Vec3 dir = TPE_vec3Minus(joint2->position,joint->position);
+
+    TPE_Unit tension = TPE_connectionTension(TPE_LENGTH(dir),
+      connection->length);
+
+    bodyTension += tension > 0 ? tension : -tension;
+
+    if (tension > TPE_TENSION_ACCELERATION_THRESHOLD || 
+      tension < -1 * TPE_TENSION_ACCELERATION_THRESHOLD)
     {
-      if (body->deactivateCount >= TPE_DEACTIVATE_AFTER)
+      TPE_vec3Normalize(&dir);
+
+      if (tension > TPE_TENSION_GREATER_ACCELERATION_THRESHOLD ||
+        tension < -1 * TPE_TENSION_GREATER_ACCELERATION_THRESHOLD)
+      { 
+        /* apply twice the acceleration after a second threshold, not so
+           elegant but seems to work :) */
+        dir.x *= 2;
+        dir.y *= 2;
+        dir.z *= 2;
+      }
+
+      dir.x /= TPE_TENSION_ACCELERATION_DIVIDER;
+      dir.y /= TPE_TENSION_ACCELERATION_DIVIDER;
+      dir.z /= TPE_TENSION_ACCELERATION_DIVIDER;
+
+      if (tension < 0)
       {
-        TPE_bodyStop(body);
-        body->deactivateCount = 0;
-        body->flags |= TPE_BODY_FLAG_DEACTIVATED;
+        dir.x *= -1;
+        dir.y *= -1;
+        dir.z *= -1;
       }
-      else if (TPE_bodyGetAverageSpeed(body) <= TPE_LOW_SPEED)
-        body->deactivateCount++;
-      else
-        body->deactivateCount = 0;
+
+      joint->velocity[0] += dir.x;
+      joint->velocity[1] += dir.y;
+      joint->velocity[2] += dir.z;
+
+      joint2->velocity[0] -= dir.x;
+      joint2->velocity[1] -= dir.y;
+      joint2->velocity[2] -= dir.z;
+    }
+
+    connection++;
+  }
+
+  _TPE_STATS_PHASE(TPE_STATS_PHASE_TENSION);
+  _TPE_PROFILE_END("tension");
+
+  if (body->connectionCount > 0)
+  {
+    uint8_t hard = !(body->flags & TPE_BODY_FLAG_SOFT);
+
+    if (hard)
+    {
+      _TPE_PROFILE_BEGIN("reshape");
+
+      TPE_bodyReshape(body,env);
+
+      bodyTension /= body->connectionCount;
+    
+      if (bodyTension > TPE_RESHAPE_TENSION_LIMIT)
+      {
+        _TPE_STATS_ADD(reshapeExtraPasses,1);
+
+        for (uint8_t k = 0; k < TPE_RESHAPE_ITERATIONS; ++k)
+          TPE_bodyReshape(body,env);
+      }
+
+      _TPE_STATS_PHASE(TPE_STATS_PHASE_RESHAPE);
+      _TPE_PROFILE_END("reshape");
+    }
+    
+    if (!(body->flags & TPE_BODY_FLAG_SIMPLE_CONN))  
+    {
+      _TPE_PROFILE_BEGIN("cancel");
+      TPE_bodyCancelOutVelocities(body,hard);
+      _TPE_STATS_PHASE(TPE_STATS_PHASE_CANCEL);
+      _TPE_PROFILE_END("cancel");
+    }
+  }
+}
+
+void TPE_worldStepBroadphase(TPE_World *world, uint16_t bodyIndex)
+{
+  TPE_Vec3 aabbMin, aabbMax;
+
+  _TPE_PROFILE_BEGIN("bodies");
+
+  if (_TPE_stepAABBBody == bodyIndex)
+  {
+    aabbMin = _TPE_stepAABBMin;
+    aabbMax = _TPE_stepAABBMax;
+  }
+  else
+    TPE_bodyGetAABB(world->bodies + bodyIndex,&aabbMin,&aabbMax);
+
+  for (uint16_t j = 0; j < world->bodyCount; ++j)
+  {
+    if (world->bodies[j].flags & TPE_BODY_FLAG_STATIC)
+    {
+      if (world->bodies[j].staticRun > 1) // skip the whole static run
+        j += world->bodies[j].staticRun - 1;
+
+      continue;
+    }
+
+    if (j > bodyIndex || (world->bodies[j].flags & TPE_BODY_FLAG_DEACTIVATED))
+    {
+      // firstly quick-check collision of body AA bounding boxes
+
+      TPE_Vec3 aabbMin2, aabbMax2;
+      TPE_bodyGetAABB(&world->bodies[j],&aabbMin2,&aabbMax2);
+
+      _TPE_STATS_ADD(aabbTests,1);
+
+      if (TPE_checkOverlapAABB(aabbMin,aabbMax,aabbMin2,aabbMax2))
+        TPE_worldStepNarrowphase(world,bodyIndex,j);
+    }
+  }
+
+  // static bodies, only those whose AABB may overlap along x:
+
+  for (uint16_t j = _TPE_staticLowerBound(world,
+    aabbMin.x - world->staticMaxWidth); j < world->staticCount; ++j)
+  {
+    const TPE_StaticEntry *e = world->statics + j;
+
+    if (e->aabbMin.x > aabbMax.x)
+      break;
+
+    _TPE_STATS_ADD(aabbTests,1);
+
+    if (TPE_checkOverlapAABB(aabbMin,aabbMax,e->aabbMin,e->aabbMax))
+      TPE_worldStepNarrowphase(world,bodyIndex,e->body);
+  }
+
+  _TPE_STATS_PHASE(TPE_STATS_PHASE_BODIES);
+  _TPE_PROFILE_END("bodies");
+}
+
+uint8_t TPE_worldStepNarrowphase(TPE_World *world, uint16_t bodyIndex,
+  uint16_t otherIndex)
+{
+  TPE_Body *body = world->bodies + bodyIndex,
+    *body2 = world->bodies + otherIndex;
+
+  _TPE_body1Index = bodyIndex;
+  _TPE_body2Index = otherIndex;
+
+  if (!TPE_bodiesResolveCollision(body,body2,_TPE_stepEnvironment))
+    return 0;
+
+  TPE_bodyActivate(body);
+  body->deactivateCount = TPE_LIGHT_DEACTIVATION; 
+
+  if (!(body2->flags & TPE_BODY_FLAG_STATIC))
+  {
+    TPE_bodyActivate(body2);
+    body2->deactivateCount = TPE_LIGHT_DEACTIVATION;
+  }
+
+  return 1;
+}
+
+void TPE_worldStepSleep(TPE_World *world, uint16_t bodyIndex)
+{
+  TPE_Body *body = world->bodies + bodyIndex;
+
+  _TPE_PROFILE_BEGIN("deactivation");
+
+  if (!(body->flags &
+    (TPE_BODY_FLAG_ALWAYS_ACTIVE | TPE_BODY_FLAG_KINEMATIC)))
+  {
+    if (body->deactivateCount >= TPE_DEACTIVATE_AFTER)
+    {
+      TPE_bodyStop(body);
+      body->deactivateCount = 0;
+      body->flags |= TPE_BODY_FLAG_DEACTIVATED;
+      _TPE_STATS_ADD(deactivations,1);
+    }
+    else if (TPE_bodyGetAverageSpeed(body) <= TPE_LOW_SPEED)
+      body->deactivateCount++;
+    else
+      body->deactivateCount = 0;
+  }
+
+  _TPE_STATS_PHASE(TPE_STATS_PHASE_DEACTIVATION);
+  _TPE_PROFILE_END("deactivation");
+
+#if TPE_STATS
+  if (_TPE_stats != 0)
+    _TPE_statsBodyDone(bodyIndex,_TPE_statsTime - _TPE_statsBodyStartTime);
+#endif
+}
+
+void TPE_worldStep(TPE_World *world)
+{
+  _TPE_PROFILE_BEGIN("TPE_worldStep");
+
+  TPE_worldStepBegin(world);
+
+  for (uint16_t i = 0; i < world->bodyCount; ++i)
+  {
+    if (world->bodies[i].flags & TPE_BODY_FLAG_STATIC)
+    {
+      if (world->bodies[i].staticRun > 1) // skip the whole static run
+        i += world->bodies[i].staticRun - 1;
+
+      continue;
     }
+
+    if (world->bodies[i].flags & (TPE_BODY_FLAG_DEACTIVATED |
+      TPE_BODY_FLAG_DISABLED))
+      continue; 
+
+    TPE_worldStepIntegrate(world,i);
+    TPE_worldStepEnvironment(world,i);
+    TPE_worldStepSolve(world,i);
+    TPE_worldStepBroadphase(world,i);
+    TPE_worldStepSleep(world,i);
   }
+
+  TPE_worldStepEnd(world);
+
+  _TPE_PROFILE_END("TPE_worldStep");
 }
 
 void TPE_bodyActivate(TPE_Body *body)
@@ -1097,6 +2365,7 @@ void TPE_bodyActivate(TPE_Body *body)
     TPE_bodyStop(body);
     body->flags &= ~TPE_BODY_FLAG_DEACTIVATED;
     body->deactivateCount = 0;
+    _TPE_STATS_ADD(wakeups,1);
   }
 }
 
@@ -1455,13 +2724,26 @@ void TPE_bodyMoveBy(TPE_Body *body, TPE_Vec3 offset)
 void TPE_bodyApplyGravity(TPE_Body *body, TPE_Unit downwardsAccel)
 {
   if ((body->flags & TPE_BODY_FLAG_DEACTIVATED) ||
-      (body->flags & TPE_BODY_FLAG_DISABLED))
+      (body->flags & TPE_BODY_FLAG_DISABLED) ||
+      (body->flags & (TPE_BODY_FLAG_STATIC | TPE_BODY_FLAG_KINEMATIC)))
     return;
 
   for (uint16_t i = 0; i < body->jointCount; ++i)
     body->joints[i].velocity[1] -= downwardsAccel;
 }
 
+void TPE_bodyKinematicMoveTo(TPE_Body *body, TPE_Vec3 position)
+{
+  position = TPE_vec3Minus(position,TPE_bodyGetCenterOfMass(body));
+
+  for (uint16_t i = 0; i < body->jointCount; ++i)
+  {
+    body->joints[i].velocity[0] = position.x;
+    body->joints[i].velocity[1] = position.y;
+    body->joints[i].velocity[2] = position.z;
+  }
+}
+
 void TPE_bodyAccelerate(TPE_Body *body, TPE_Vec3 velocity)
 {
   TPE_bodyActivate(body);
@@ -1538,11 +2820,21 @@ TPE_Unit TPE_sin(TPE_Unit x)
   #undef _PI2
 }
 
+// mass of a body's joints in collisions
+#define _TPE_BODY_MASS(b) \
+  (((b)->flags & (TPE_BODY_FLAG_STATIC | TPE_BODY_FLAG_KINEMATIC)) ? \
+  TPE_INFINITY : (b)->jointMass)
+
 uint8_t TPE_bodiesResolveCollision(TPE_Body *b1, TPE_Body *b2,
   TPE_ClosestPointFunction env)
 {
   uint8_t r = 0;
 
+  if (_TPE_BODY_MASS(b1) == TPE_INFINITY && _TPE_BODY_MASS(b2) == TPE_INFINITY)
+    return 0;
+
+  _TPE_STATS_ADD(jointPairTests,b1->jointCount * b2->jointCount);
+
   for (uint16_t i = 0; i < b1->jointCount; ++i)
     for (uint16_t j = 0; j < b2->jointCount; ++j)
     {
@@ -1553,7 +2845,8 @@ uint8_t TPE_bodiesResolveCollision(TPE_Body *b1, TPE_Body *b2,
       _TPE_joint2Index = j;
 
       if (TPE_jointsResolveCollision(&(b1->joints[i]),&(b2->joints[j]),
-        b1->jointMass,b2->jointMass,(b1->elasticity + b2->elasticity) / 2,
+        _TPE_BODY_MASS(b1),_TPE_BODY_MASS(b2),
+        (b1->elasticity + b2->elasticity) / 2,
         (b1->friction + b2->friction) / 2,env))
       {
         r = 1;
@@ -1584,9 +2877,20 @@ uint8_t TPE_jointsResolveCollision(TPE_Joint *j1, TPE_Joint *j2,
         TPE_vec3Plus(j1->position,dir)))
       return 0;
 
+    _TPE_STATS_ADD(jointContacts,1);
+
     TPE_Vec3
       pos1Backup = j1->position,
       pos2Backup = j2->position;
+
+    TPE_Unit velBackup[3]; // velocity of an infinite mass joint, to restore
+
+    TPE_Joint *jInf = mass1 == TPE_INFINITY ? j1 :
+      (mass2 == TPE_INFINITY ? j2 : 0);
+
+    if (jInf != 0)
+      for (uint8_t i = 0; i < 3; ++i)
+        velBackup[i] = jInf->velocity[i];
   
     // separate joints, the shift distance will depend on the weight ratio:
 
@@ -1594,8 +2898,9 @@ uint8_t TPE_jointsResolveCollision(TPE_Joint *j1, TPE_Joint *j2,
 
     TPE_vec3Normalize(&dir);
 
-    TPE_Unit ratio = (mass2 * TPE_F) / 
-      TPE_nonZero(mass1 + mass2);
+    TPE_Unit ratio = mass2 == TPE_INFINITY ? TPE_F :
+      (mass1 == TPE_INFINITY ? 0 :
+      (mass2 * TPE_F) / TPE_nonZero(mass1 + mass2));
 
     TPE_Unit shiftDistance = (ratio * d) / TPE_F;
 
@@ -1644,7 +2949,14 @@ uint8_t TPE_jointsResolveCollision(TPE_Joint *j1, TPE_Joint *j2,
 
     v2 = TPE_vec3Dot(vel,dir);
 
-    TPE_getVelocitiesAfterCollision(&v1,&v2,mass1,mass2,elasticity);
+    // infinite mass (static bodies) keeps its velocity:
+
+    if (mass2 == TPE_INFINITY)
+      v1 = v2 + (elasticity * TPE_nonZero(v2 - v1)) / TPE_F;
+    else if (mass1 == TPE_INFINITY)
+      v2 = v1 - (elasticity * TPE_nonZero(v2 - v1)) / TPE_F;
+    else
+      TPE_getVelocitiesAfterCollision(&v1,&v2,mass1,mass2,elasticity);
 
     vel = TPE_vec3Times(dir,v1);
 
@@ -1666,14 +2978,20 @@ uint8_t TPE_jointsResolveCollision(TPE_Joint *j1, TPE_Joint *j2,
 
 #undef assignVec
 
+    if (jInf != 0)
+      for (uint8_t i = 0; i < 3; ++i)
+        jInf->velocity[i] = velBackup[i];
+
     if (env != 0)
     {
       // ensure the joints aren't colliding with environment
 
-      if (TPE_jointEnvironmentResolveCollision(j1,elasticity,friction,env) == 2)
+      if (mass1 != TPE_INFINITY &&
+        TPE_jointEnvironmentResolveCollision(j1,elasticity,friction,env) == 2)
         j1->position = pos1Backup;
 
-      if (TPE_jointEnvironmentResolveCollision(j2,elasticity,friction,env) == 2)
+      if (mass2 != TPE_INFINITY &&
+        TPE_jointEnvironmentResolveCollision(j2,elasticity,friction,env) == 2)
         j2->position = pos2Backup;
     }
 
@@ -1737,6 +3055,8 @@ uint8_t TPE_jointEnvironmentResolveCollision(TPE_Joint *joint,
 
     // colliding
 
+    _TPE_STATS_ADD(environmentContacts,1);
+
     TPE_Vec3 positionBackup = joint->position, shift;
     uint8_t success = 0;
 
@@ -1820,6 +3140,7 @@ uint8_t TPE_jointEnvironmentResolveCollision(TPE_Joint *joint,
     else
     {
       TPE_LOG("WARNING: joint-environment collision couldn't be resolved");
+      _TPE_STATS_ADD(unresolvedCollisions,1);
 
       joint->position = positionBackup;
       joint->velocity[0] = 0;
@@ -2072,68 +3393,117 @@ void _TPE_drawDebugPixel(
     f(x,y,c);
 }
 
-void TPE_worldDebugDraw(TPE_World *world, TPE_DebugDrawFunction drawFunc,
-  TPE_Vec3 camPos, TPE_Vec3 camRot, TPE_Vec3 camView, uint16_t envGridRes,
-  TPE_Unit envGridSize)
+#define _TPE_DEBUG_Z_LIMIT 250
+
+/* Samples the environment at a probe grid point with given grid coordinates,
+  if cache is not 0, a sample of the cell taken in a previous call is reused
+  (the cache's cell and valid are only updated after the whole grid). */
+TPE_Vec3 _TPE_debugEnvironmentSample(TPE_ClosestPointFunction env,
+  TPE_Vec3 point, TPE_Unit cellX, TPE_Unit cellY, TPE_Unit cellZ,
+  uint16_t envGridRes, TPE_Unit envGridSize, TPE_DebugDrawCache *cache)
 {
-#define Z_LIMIT 250
-  if (world->environmentFunction != 0)
+  if (cache == 0)
+    return env(point,envGridSize);
+
+  /* The cache is indexed by grid coordinates modulo resolution, so a cell
+     that scrolled out of view is replaced by one that scrolled in. */
+
+  TPE_Unit c[3] = {cellX, cellY, cellZ},
+    cOld[3] = {cache->cell.x, cache->cell.y, cache->cell.z};
+  uint32_t index = 0;
+  uint8_t cached = cache->valid;
+
+  for (uint8_t m = 0; m < 3; ++m)
   {
-    // environment:
+    if (c[m] < cOld[m] || c[m] >= cOld[m] + envGridRes)
+      cached = 0;
 
-    TPE_Vec3 testPoint;
+    index = index * envGridRes +
+      ((c[m] % envGridRes) + envGridRes) % envGridRes;
+  }
 
-    TPE_Unit gridHalfSize = (envGridSize * envGridRes) / 2;
+  if (!cached)
+    cache->samples[index] = env(point,envGridSize);
 
-    TPE_Vec3 center;
+  return cache->samples[index];
+}
 
-    if (envGridRes != 0)
-    {
-      center = TPE_vec3(0,TPE_sin(camRot.x),TPE_cos(camRot.x));
+/* Draws the environment probed on a grid, if cache is not 0, samples of the
+  grid cells that were already sampled in previous calls are reused. */
+void _TPE_debugDrawEnvironment(TPE_ClosestPointFunction env,
+  TPE_DebugDrawFunction drawFunc, TPE_Vec3 camPos, TPE_Vec3 camRot,
+  TPE_Vec3 camView, uint16_t envGridRes, TPE_Unit envGridSize,
+  TPE_DebugDrawCache *cache)
+{
+  TPE_Vec3 testPoint;
 
-      _TPE_vec2Rotate(&center.x,&center.z,camRot.y);
+  TPE_Unit gridHalfSize = (envGridSize * envGridRes) / 2;
 
-      center = TPE_vec3Times(center,gridHalfSize);
-      center = TPE_vec3Plus(camPos,center);
+  TPE_Vec3 center, cell;
 
-      center.x = (center.x / envGridSize) * envGridSize;
-      center.y = (center.y / envGridSize) * envGridSize;
-      center.z = (center.z / envGridSize) * envGridSize;
-    }
+  if (envGridRes != 0)
+  {
+    center = TPE_vec3(0,TPE_sin(camRot.x),TPE_cos(camRot.x));
 
-    testPoint.y = center.y - gridHalfSize;
+    _TPE_vec2Rotate(&center.x,&center.z,camRot.y);
+
+    center = TPE_vec3Times(center,gridHalfSize);
+    center = TPE_vec3Plus(camPos,center);
+
+    // grid coordinates of the center cell (center is a multiple of cell size):
+
+    cell.x = center.x / envGridSize;
+    cell.y = center.y / envGridSize;
+    cell.z = center.z / envGridSize;
+
+    center.x = cell.x * envGridSize;
+    center.y = cell.y * envGridSize;
+    center.z = cell.z * envGridSize;
+  }
+
+  testPoint.y = center.y - gridHalfSize;
+
+  for (uint16_t j = 0; j < envGridRes; ++j)
+  {
+    testPoint.x = center.x - gridHalfSize;
 
-    for (uint8_t j = 0; j < envGridRes; ++j)
+    for (uint16_t k = 0; k < envGridRes; ++k)
     {
-      testPoint.x = center.x - gridHalfSize;
+      testPoint.z = center.z - gridHalfSize;
 
-      for (uint8_t k = 0; k < envGridRes; ++k)
+      for (uint16_t l = 0; l < envGridRes; ++l)
       {
-        testPoint.z = center.z - gridHalfSize;
+        TPE_Vec3 r = _TPE_debugEnvironmentSample(env,testPoint,cell.x + k,
+          cell.y + j,cell.z + l,envGridRes,envGridSize,cache);
 
-        for (uint8_t l = 0; l < envGridRes; ++l)
+        if (r.x != testPoint.x || r.y != testPoint.y || r.z != testPoint.z)
         {
-          TPE_Vec3 r = world->environmentFunction(testPoint,envGridSize);
-
-          if (r.x != testPoint.x || r.y != testPoint.y || r.z != testPoint.z)
-          {
-            r = _TPE_project3DPoint(r,camPos,camRot,camView);
+          r = _TPE_project3DPoint(r,camPos,camRot,camView);
  
-            if (r.z > Z_LIMIT)
-              _TPE_drawDebugPixel(r.x,r.y,camView.x,camView.y,
-                TPE_DEBUG_COLOR_ENVIRONMENT,drawFunc);
-          }
-
-          testPoint.z += envGridSize;
+          if (r.z > _TPE_DEBUG_Z_LIMIT)
+            _TPE_drawDebugPixel(r.x,r.y,camView.x,camView.y,
+              TPE_DEBUG_COLOR_ENVIRONMENT,drawFunc);
         }
 
-        testPoint.x += envGridSize;
+        testPoint.z += envGridSize;
       }
 
-      testPoint.y += envGridSize;
+      testPoint.x += envGridSize;
     }
+
+    testPoint.y += envGridSize;
+  }
+
+  if (cache != 0 && envGridRes != 0)
+  {
+    cache->cell = cell;
+    cache->valid = 1;
   }
+}
 
+void _TPE_debugDrawBodies(TPE_World *world, TPE_DebugDrawFunction drawFunc,
+  TPE_Vec3 camPos, TPE_Vec3 camRot, TPE_Vec3 camView)
+{
   for (uint16_t i = 0; i < world->bodyCount; ++i)
   {
     // connections:
@@ -2148,7 +3518,7 @@ void TPE_worldDebugDraw(TPE_World *world, TPE_DebugDrawFunction drawFunc,
       p1 = _TPE_project3DPoint(p1,camPos,camRot,camView);
       p2 = _TPE_project3DPoint(p2,camPos,camRot,camView);
 
-      if (p1.z <= Z_LIMIT || p2.z <= Z_LIMIT)
+      if (p1.z <= _TPE_DEBUG_Z_LIMIT || p2.z <= _TPE_DEBUG_Z_LIMIT)
         continue;
 
       TPE_Vec3 diff = TPE_vec3Minus(p2,p1);
@@ -2174,7 +3544,7 @@ void TPE_worldDebugDraw(TPE_World *world, TPE_DebugDrawFunction drawFunc,
       TPE_Vec3 p = _TPE_project3DPoint(world->bodies[i].joints[j].position,
         camPos,camRot,camView);
 
-      if (p.z > Z_LIMIT)
+      if (p.z > _TPE_DEBUG_Z_LIMIT)
       {
         uint8_t color = (world->bodies[i].flags & TPE_BODY_FLAG_DEACTIVATED) ?
           TPE_DEBUG_COLOR_INACTIVE : TPE_DEBUG_COLOR_JOINT;
@@ -2209,7 +3579,132 @@ void TPE_worldDebugDraw(TPE_World *world, TPE_DebugDrawFunction drawFunc,
       }
     }
   }
-#undef Z_LIMIT
+}
+
+void TPE_worldDebugDraw(TPE_World *world, TPE_DebugDrawFunction drawFunc,
+  TPE_Vec3 camPos, TPE_Vec3 camRot, TPE_Vec3 camView, uint16_t envGridRes,
+  TPE_Unit envGridSize)
+{
+  _TPE_PROFILE_BEGIN("TPE_worldDebugDraw");
+
+  if (world->environmentFunction != 0)
+    _TPE_debugDrawEnvironment(world->environmentFunction,drawFunc,camPos,
+      camRot,camView,envGridRes,envGridSize,0);
+
+  _TPE_debugDrawBodies(world,drawFunc,camPos,camRot,camView);
+
+  _TPE_PROFILE_END("TPE_worldDebugDraw");
+}
+
+void TPE_debugDrawCacheInit(TPE_DebugDrawCache *cache, TPE_Vec3 *samples,
+  uint16_t envGridRes, TPE_Unit envGridSize)
+{
+  cache->samples = samples;
+  cache->resolution = envGridRes;
+  cache->cellSize = envGridSize;
+  cache->valid = 0;
+}
+
+void TPE_worldDebugDrawCached(TPE_World *world,
+  TPE_DebugDrawFunction drawFunc, TPE_Vec3 camPos, TPE_Vec3 camRot,
+  TPE_Vec3 camView, TPE_DebugDrawCache *cache)
+{
+  _TPE_PROFILE_BEGIN("TPE_worldDebugDraw");
+
+  if (world->environmentFunction != 0)
+    _TPE_debugDrawEnvironment(world->environmentFunction,drawFunc,camPos,
+      camRot,camView,cache->resolution,cache->cellSize,cache);
+
+  _TPE_debugDrawBodies(world,drawFunc,camPos,camRot,camView);
+
+  _TPE_PROFILE_END("TPE_worldDebugDraw");
+}
+
+uint32_t TPE_worldDebugPrimitives(const TPE_World *world,
+  TPE_DebugPrimitive *buffer, uint32_t maxCount, TPE_Vec3 envGridCenter,
+  TPE_DebugDrawCache *cache)
+{
+  _TPE_PROFILE_BEGIN("TPE_worldDebugPrimitives");
+
+  uint32_t count = 0;
+
+#define _ADD(t,c,p1,p2) \
+  { if (count < maxCount) { buffer[count].type = (t); \
+    buffer[count].color = (c); buffer[count].a = (p1); \
+    buffer[count].b = (p2); } count++; }
+
+  for (uint16_t i = 0; i < world->bodyCount; ++i)
+  {
+    const TPE_Body *b = world->bodies + i;
+
+    uint8_t inactive = (b->flags & TPE_BODY_FLAG_DEACTIVATED) != 0;
+
+    for (uint16_t j = 0; j < b->connectionCount; ++j)
+      _ADD(TPE_DEBUG_PRIMITIVE_LINE,
+        inactive ? TPE_DEBUG_COLOR_INACTIVE : TPE_DEBUG_COLOR_CONNECTION,
+        b->joints[b->connections[j].joint1].position,
+        b->joints[b->connections[j].joint2].position)
+
+    for (uint16_t j = 0; j < b->jointCount; ++j)
+      _ADD(TPE_DEBUG_PRIMITIVE_SPHERE,
+        inactive ? TPE_DEBUG_COLOR_INACTIVE : TPE_DEBUG_COLOR_JOINT,
+        b->joints[j].position,TPE_vec3(TPE_JOINT_SIZE(b->joints[j]),0,0))
+  }
+
+  if (world->environmentFunction != 0 && cache != 0 && cache->resolution != 0)
+  {
+    // same grid as in TPE_worldDebugDraw (center snapped to cell size):
+
+    uint16_t envGridRes = cache->resolution;
+    TPE_Unit envGridSize = cache->cellSize,
+      gridHalfSize = (envGridSize * envGridRes) / 2;
+    TPE_Vec3 testPoint, cell;
+
+    cell.x = envGridCenter.x / envGridSize;
+    cell.y = envGridCenter.y / envGridSize;
+    cell.z = envGridCenter.z / envGridSize;
+
+    envGridCenter.x = cell.x * envGridSize;
+    envGridCenter.y = cell.y * envGridSize;
+    envGridCenter.z = cell.z * envGridSize;
+
+    testPoint.y = envGridCenter.y - gridHalfSize;
+
+    for (uint16_t j = 0; j < envGridRes; ++j)
+    {
+      testPoint.x = envGridCenter.x - gridHalfSize;
+
+      for (uint16_t k = 0; k < envGridRes; ++k)
+      {
+        testPoint.z = envGridCenter.z - gridHalfSize;
+
+        for (uint16_t l = 0; l < envGridRes; ++l)
+        {
+          TPE_Vec3 r = _TPE_debugEnvironmentSample(world->environmentFunction,
+            testPoint,cell.x + k,cell.y + j,cell.z + l,envGridRes,envGridSize,
+            cache);
+
+          if (r.x != testPoint.x || r.y != testPoint.y || r.z != testPoint.z)
+            _ADD(TPE_DEBUG_PRIMITIVE_POINT,TPE_DEBUG_COLOR_ENVIRONMENT,r,r)
+
+          testPoint.z += envGridSize;
+        }
+
+        testPoint.x += envGridSize;
+      }
+
+      testPoint.y += envGridSize;
+    }
+
+    cache->cell = cell;
+    cache->valid = 1;
+  }
+
+#undef _ADD
+
+  _TPE_PROFILE_END("TPE_worldDebugPrimitives");
+
+  return count;
 }
 
 TPE_Vec3 TPE_envBox(TPE_Vec3 point, TPE_Vec3 center, TPE_Vec3 maxCornerVec,
@@ -2599,7 +4094,7 @@ TPE_Vec3 TPE_fakeSphereRotation(TPE_Vec3 position1, TPE_Vec3 position2,
   return m;
 }
 
-TPE_Vec3 TPE_castEnvironmentRay(TPE_Vec3 rayPos, TPE_Vec3 rayDir,
+TPE_Vec3 _TPE_castEnvironmentRay(TPE_Vec3 rayPos, TPE_Vec3 rayDir,
   TPE_ClosestPointFunction environment, TPE_Unit insideStepSize,
   TPE_Unit rayMarchMaxStep, uint32_t maxSteps)
 {
@@ -2699,9 +4194,25 @@ TPE_Vec3 TPE_castEnvironmentRay(TPE_Vec3 rayPos, TPE_Vec3 rayDir,
   return TPE_vec3(TPE_INFINITY,TPE_INFINITY,TPE_INFINITY);
 }
 
+TPE_Vec3 TPE_castEnvironmentRay(TPE_Vec3 rayPos, TPE_Vec3 rayDir,
+  TPE_ClosestPointFunction environment, TPE_Unit insideStepSize,
+  TPE_Unit rayMarchMaxStep, uint32_t maxSteps)
+{
+  _TPE_PROFILE_BEGIN("TPE_castEnvironmentRay");
+
+  TPE_Vec3 r = _TPE_castEnvironmentRay(rayPos,rayDir,environment,
+    insideStepSize,rayMarchMaxStep,maxSteps);
+
+  _TPE_PROFILE_END("TPE_castEnvironmentRay");
+
+  return r;
+}
+
 TPE_Vec3 TPE_castBodyRay(TPE_Vec3 rayPos, TPE_Vec3 rayDir, int16_t excludeBody,
   const TPE_World *world, int16_t *bodyIndex, int16_t *jointIndex)
 {
+  _TPE_PROFILE_BEGIN("TPE_castBodyRay");
+
   TPE_Vec3 bestP = TPE_vec3(TPE_INFINITY,TPE_INFINITY,TPE_INFINITY);
   TPE_Unit bestD = TPE_INFINITY;
 
@@ -2785,205 +4296,1744 @@ TPE_Vec3 TPE_castBodyRay(TPE_Vec3 rayPos, TPE_Vec3 rayDir, int16_t excludeBody,
     }
   }
 
+  _TPE_PROFILE_END("TPE_castBodyRay");
+
   return bestP;
 }
 
-void TPE_worldDeactivateAll(TPE_World *world)
+TPE_Sensor TPE_sensor(TPE_Vec3 position, TPE_Unit radius)
 {
-  for (uint16_t i = 0; i < world->bodyCount; ++i)
-    TPE_bodyDeactivate(&world->bodies[i]);
+  TPE_Sensor s;
+
+  s.position = position;
+  s.radius = radius;
+  s.bodyCount = 0;
+  s.seen = 0;
+  s.lastPosition = position;
+  s.lastRadius = -1; // forces testing all bodies in the first update
+
+  return s;
 }
 
-void TPE_worldActivateAll(TPE_World *world)
+uint16_t TPE_worldUpdateSensors(const TPE_World *world, TPE_Sensor *sensors,
+  uint16_t sensorCount, uint8_t *bodyFlags, TPE_SensorEvent *events,
+  uint16_t maxEvents)
 {
-  for (uint16_t i = 0; i < world->bodyCount; ++i)
-    TPE_bodyActivate(&world->bodies[i]);
-}
+  uint16_t count = 0;
+
+#define _ADD(s,b,t) \
+  { if (count < maxEvents) { events[count].sensor = (s); \
+    events[count].body = (b); events[count].type = (t); } count++; }
+
+  for (uint16_t i = 0; i < sensorCount; ++i)
+    sensors[i].seen = 0;
+
+  for (uint16_t i = 0; i < world->bodyCount; ++i)
+  {
+    const TPE_Body *body = world->bodies + i;
+
+    uint8_t still = 0;
+
+    if (bodyFlags != 0)
+    {
+      /* only a body that was already deactivated or static at the last update
+         can be skipped, e.g. one that moved and deactivated in the same step
+         has changed flags */
+      still = bodyFlags[i] == body->flags && (body->flags &
+        (TPE_BODY_FLAG_DEACTIVATED | TPE_BODY_FLAG_STATIC));
+
+      bodyFlags[i] = body->flags;
+    }
+
+    if (body->flags & TPE_BODY_FLAG_DISABLED)
+      continue;
+
+    uint8_t aabbValid = 0;
+    TPE_Vec3 aabbMin, aabbMax;
+
+    for (uint16_t j = 0; j < sensorCount; ++j)
+    {
+      TPE_Sensor *sensor = sensors + j;
+      uint8_t k = 0;
+
+      if (still && sensor->radius == sensor->lastRadius &&
+        sensor->position.x == sensor->lastPosition.x &&
+        sensor->position.y == sensor->lastPosition.y &&
+        sensor->position.z == sensor->lastPosition.z)
+      {
+        // neither the body nor the sensor moved, the overlap can't change
+
+        while (k < sensor->bodyCount && sensor->bodies[k] != i)
+          k++;
+
+        if (k < sensor->bodyCount)
+        {
+          _ADD(j,i,TPE_SENSOR_EVENT_STAY)
+          sensor->seen |= ((_TPE_SensorMask) 1) << k;
+        }
+
+        continue;
+      }
+
+      if (!aabbValid)
+      {
+        TPE_bodyGetAABB(body,&aabbMin,&aabbMax);
+        aabbValid = 1;
+      }
+
+      TPE_Vec3 r = TPE_vec3(sensor->radius,sensor->radius,sensor->radius);
+
+      if (!TPE_checkOverlapAABB(aabbMin,aabbMax,
+        TPE_vec3Minus(sensor->position,r),TPE_vec3Plus(sensor->position,r)))
+        continue;
+
+      uint8_t overlap = 0;
+
+      for (uint16_t l = 0; l < body->jointCount; ++l)
+      {
+        TPE_Vec3 d =
+          TPE_vec3Minus(body->joints[l].position,sensor->position);
+        TPE_Unit maxD = sensor->radius + TPE_JOINT_SIZE(body->joints[l]);
+
+        if (TPE_abs(d.x) <= maxD && TPE_abs(d.y) <= maxD &&
+          TPE_abs(d.z) <= maxD && ((int64_t) d.x) * d.x +
+          ((int64_t) d.y) * d.y + ((int64_t) d.z) * d.z <=
+          ((int64_t) maxD) * maxD)
+        {
+          overlap = 1;
+          break;
+        }
+      }
+
+      if (!overlap)
+        continue;
+
+      while (k < sensor->bodyCount && sensor->bodies[k] != i)
+        k++;
+
+      if (k < sensor->bodyCount)
+        _ADD(j,i,TPE_SENSOR_EVENT_STAY)
+      else if (k < TPE_SENSOR_MAX_BODIES)
+      {
+        sensor->bodies[k] = i;
+        sensor->bodyCount++;
+        _ADD(j,i,TPE_SENSOR_EVENT_ENTER)
+      }
+      else
+        continue; // no space, ignore the body
+
+      sensor->seen |= ((_TPE_SensorMask) 1) << k;
+    }
+  }
+
+  for (uint16_t i = 0; i < sensorCount; ++i)
+  {
+    TPE_Sensor *sensor = sensors + i;
+    uint8_t n = 0;
+
+    for (uint8_t k = 0; k < sensor->bodyCount; ++k)
+      if (sensor->seen & (((_TPE_SensorMask) 1) << k))
+      {
+        sensor->bodies[n] = sensor->bodies[k];
+        n++;
+      }
+      else
+        _ADD(i,sensor->bodies[k],TPE_SENSOR_EVENT_EXIT)
+
+    sensor->bodyCount = n;
+    sensor->lastPosition = sensor->position;
+    sensor->lastRadius = sensor->radius;
+  }
+
+#undef _ADD
+
+  return count;
+}
+
+void TPE_characterInit(TPE_Character *character, TPE_Body *body)
+{
+  character->body = body;
+  character->velocity = TPE_vec3(0,0,0);
+  character->stepHeight = TPE_JOINT_SIZE(body->joints[0]) / 2;
+  character->slopeLimit = (TPE_F * 181) / 256; // cos(45 deg)
+  character->groundNormal = TPE_vec3(0,TPE_F,0);
+  character->groundBody = -1;
+  character->onGround = 0;
+
+  body->flags |= TPE_BODY_FLAG_KINEMATIC;
+  TPE_bodyStop(body);
+}
+
+/* World of the move in progress, static and kinematic bodies near the
+  character and the body of the deepest contact found by
+  _TPE_characterContact (-1 for the environment). */
+const TPE_World *_TPE_characterWorld;
+uint16_t _TPE_characterObstacles[TPE_CHARACTER_MAX_OBSTACLES];
+uint8_t _TPE_characterObstacleCount;
+int32_t _TPE_characterContactBody;
+
+/* Finds the deepest contact of the character's joints (shifted by offset) with
+  the environment and the obstacle bodies, joints closer than the collision
+  margin count as touching with zero depth. Returns 0 if there's no contact,
+  1 if there is (depth and normal are set) or 2 if a joint center is inside
+  the environment or at an obstacle joint's center. */
+uint8_t _TPE_characterContact(const TPE_Body *body, TPE_Vec3 offset,
+  TPE_ClosestPointFunction env, TPE_Unit *depth, TPE_Vec3 *normal)
+{
+  TPE_Vec3 bestN = TPE_vec3(0,0,0);
+  TPE_Unit bestL = 0; // length of bestN, to only normalize the deepest one
+
+  *depth = -1;
+
+  for (uint16_t i = 0; i < body->jointCount; ++i)
+  {
+    TPE_Vec3 p = TPE_vec3Plus(body->joints[i].position,offset);
+    TPE_Unit size = TPE_JOINT_SIZE(body->joints[i]) +
+      TPE_COLLISION_RESOLUTION_MARGIN;
+
+    TPE_Vec3 n = TPE_vec3Minus(p,env(p,size));
+
+    if (n.x == 0 && n.y == 0 && n.z == 0)
+      return 2;
+
+    TPE_Unit l = TPE_LENGTH(n);
+
+    if (size - l > *depth)
+    {
+      *depth = size - l;
+      bestN = n;
+      bestL = l;
+      _TPE_characterContactBody = -1;
+    }
+
+    for (uint8_t j = 0; j < _TPE_characterObstacleCount; ++j)
+    {
+      const TPE_Body *b =
+        _TPE_characterWorld->bodies + _TPE_characterObstacles[j];
+
+      for (uint16_t k = 0; k < b->jointCount; ++k)
+      {
+        TPE_Unit s = size + TPE_JOINT_SIZE(b->joints[k]);
+
+        n = TPE_vec3Minus(p,b->joints[k].position);
+
+        if (TPE_abs(n.x) >= s || TPE_abs(n.y) >= s || TPE_abs(n.z) >= s)
+          continue;
+
+        if (n.x == 0 && n.y == 0 && n.z == 0)
+          return 2;
+
+        l = TPE_LENGTH(n);
+
+        if (s - l > *depth)
+        {
+          *depth = s - l;
+          bestN = n;
+          bestL = l;
+          _TPE_characterContactBody = _TPE_characterObstacles[j];
+        }
+      }
+    }
+  }
+
+  if (*depth < 0)
+    return 0;
+
+  bestL = TPE_nonZero(bestL);
+
+  normal->x = (bestN.x * TPE_F) / bestL;
+  normal->y = (bestN.y * TPE_F) / bestL;
+  normal->z = (bestN.z * TPE_F) / bestL;
+
+  return 1;
+}
+
+/* Moves the character (virtually, by offset) by move, pushing it out of the
+  environment and sliding along it, returns the new offset. Walkable ground is
+  only pushed out of vertically (so that the character doesn't slide down
+  slopes), steep slopes only horizontally (so that they can't be climbed).
+  Ground is walkable if its normal's y is at least slopeLimit. */
+TPE_Vec3 _TPE_characterSlide(TPE_Character *c, TPE_Vec3 offset,
+  TPE_Vec3 move, TPE_Unit slopeLimit, TPE_ClosestPointFunction env,
+  uint8_t *ground, uint8_t *wall)
+{
+  TPE_Vec3 start = offset;
+
+  offset = TPE_vec3Plus(offset,move);
+
+  for (uint8_t i = 0; i < TPE_CHARACTER_ITERATIONS; ++i)
+  {
+    TPE_Unit depth;
+    TPE_Vec3 n;
+
+    uint8_t r = _TPE_characterContact(c->body,offset,env,&depth,&n);
+
+    if (r == 2)
+      return start; // got inside, don't move at all
+
+    if (r == 0 || depth < 0)
+      break;
+
+    if (n.y >= slopeLimit && n.y > 0)
+    {
+      *ground = 1;
+      c->groundNormal = n;
+      c->groundBody = _TPE_characterContactBody;
+      offset.y += (depth * TPE_F) / n.y;
+
+      if (c->velocity.y < 0)
+        c->velocity.y = 0;
+    }
+    else
+    {
+      if (depth > 0)
+        *wall = 1;
+
+      TPE_Vec3 h = TPE_vec3(n.x,0,n.z);
+      TPE_Unit hDot = 0;
+
+      if (n.y > 0 && (h.x != 0 || h.z != 0))
+      {
+        h = TPE_vec3Normalized(h);
+        hDot = TPE_vec3Dot(h,n);
+      }
+
+      if (hDot > 0) // steep slope
+        offset = TPE_vec3Plus(offset,TPE_vec3Times(h,(depth * TPE_F) / hDot));
+      else
+        offset = TPE_vec3Plus(offset,TPE_vec3Times(n,depth));
+
+      TPE_Unit vn = TPE_vec3Dot(c->velocity,n);
+
+      if (vn < 0)
+        c->velocity = TPE_vec3Minus(c->velocity,TPE_vec3Times(n,vn));
+    }
+
+    if (depth == 0)
+      break;
+  }
+
+  return offset;
+}
+
+/* Collects the static and kinematic bodies (except the character's own)
+  whose AABBs overlap given box into the character obstacles. */
+void _TPE_characterFindObstacles(const TPE_World *world, const TPE_Body *self,
+  TPE_Vec3 aabbMin, TPE_Vec3 aabbMax)
+{
+  _TPE_characterWorld = world;
+  _TPE_characterObstacleCount = 0;
+
+  for (uint16_t i = _TPE_staticLowerBound(world,
+    aabbMin.x - world->staticMaxWidth); i < world->staticCount; ++i)
+  {
+    const TPE_StaticEntry *e = world->statics + i;
+
+    if (e->aabbMin.x > aabbMax.x ||
+      _TPE_characterObstacleCount >= TPE_CHARACTER_MAX_OBSTACLES)
+      break;
+
+    if (TPE_checkOverlapAABB(aabbMin,aabbMax,e->aabbMin,e->aabbMax))
+    {
+      _TPE_characterObstacles[_TPE_characterObstacleCount] = e->body;
+      _TPE_characterObstacleCount++;
+    }
+  }
+
+  for (uint16_t i = 0; i < world->bodyCount &&
+    _TPE_characterObstacleCount < TPE_CHARACTER_MAX_OBSTACLES; ++i)
+  {
+    const TPE_Body *b = world->bodies + i;
+    TPE_Vec3 aabbMin2, aabbMax2;
+
+    if ((b->flags & (TPE_BODY_FLAG_KINEMATIC | TPE_BODY_FLAG_DISABLED)) !=
+      TPE_BODY_FLAG_KINEMATIC || b == self)
+      continue;
+
+    TPE_bodyGetAABB(b,&aabbMin2,&aabbMax2);
+
+    if (TPE_checkOverlapAABB(aabbMin,aabbMax,aabbMin2,aabbMax2))
+    {
+      _TPE_characterObstacles[_TPE_characterObstacleCount] = i;
+      _TPE_characterObstacleCount++;
+    }
+  }
+}
+
+uint8_t TPE_characterMove(TPE_Character *character, TPE_Vec3 move,
+  TPE_Unit gravity, const TPE_World *world)
+{
+  uint8_t ground = 0, wall = 0;
+  TPE_ClosestPointFunction env = world->environmentFunction;
+  TPE_Vec3 aabbMin, aabbMax;
+
+  character->velocity.y -= gravity;
+  character->groundBody = -1;
+
+  move.x += character->velocity.x;
+  move.z += character->velocity.z;
+
+  // obstacles within reach of the whole move (including a step up):
+
+  TPE_Unit reach = TPE_abs(move.x) + TPE_abs(move.y) + TPE_abs(move.z) +
+    TPE_abs(character->velocity.y) + character->stepHeight +
+    TPE_COLLISION_RESOLUTION_MARGIN;
+
+  TPE_bodyGetAABB(character->body,&aabbMin,&aabbMax);
+
+  _TPE_characterFindObstacles(world,character->body,
+    TPE_vec3Minus(aabbMin,TPE_vec3(reach,reach,reach)),
+    TPE_vec3Plus(aabbMax,TPE_vec3(reach,reach,reach)));
+
+  // horizontal part:
+
+  TPE_Vec3 offset = _TPE_characterSlide(character,TPE_vec3(0,0,0),move,
+    character->slopeLimit,env,&ground,&wall);
+
+  if (wall && character->onGround && character->stepHeight > 0)
+  {
+    /* Blocked by a wall while on ground, try stepping up: move up, forward and
+       back down, accept it if that ends on something to stand on further than
+       before. Landing on the step's edge gives a steep normal, so the surface
+       just behind the contact point is checked to be walkable (which it isn't
+       on a steep slope). Bodies are made of spheres, so for them the contact
+       normal itself is checked. */
+
+    TPE_Vec3 velocity = character->velocity,
+      groundNormal = character->groundNormal;
+    int32_t groundBody = character->groundBody;
+    uint8_t ground2 = 0, wall2 = 0;
+
+    TPE_Vec3 o = _TPE_characterSlide(character,TPE_vec3(0,0,0),
+      TPE_vec3(0,character->stepHeight,0),character->slopeLimit,env,
+      &ground2,&wall2);
+
+    o = _TPE_characterSlide(character,o,move,character->slopeLimit,env,
+      &ground2,&wall2);
+
+    ground2 = 0;
+
+    o = _TPE_characterSlide(character,o,TPE_vec3(0,-1 * o.y,0),1,env,
+      &ground2,&wall2);
+
+    if (TPE_LENGTH(TPE_vec3(o.x,0,o.z)) <=
+      TPE_LENGTH(TPE_vec3(offset.x,0,offset.z)))
+      ground2 = 0; // no progress, keep the plain slide
+
+    if (ground2 && character->groundBody >= 0 &&
+      character->groundNormal.y < character->slopeLimit)
+      ground2 = 0; // edge of a body (a sphere) too steep to stand on
+
+    if (ground2 && character->groundBody < 0)
+    {
+      const TPE_Joint *lowest = character->body->joints;
+
+      for (uint16_t i = 1; i < character->body->jointCount; ++i)
+        if (character->body->joints[i].position.y < lowest->position.y)
+          lowest = character->body->joints + i;
+
+      TPE_Vec3 p = TPE_vec3Plus(lowest->position,o),
+        h = TPE_vec3Normalized(TPE_vec3(move.x,0,move.z));
+
+      p = env(p,TPE_JOINT_SIZE(*lowest) + 2 * TPE_COLLISION_RESOLUTION_MARGIN);
+      p.x += (h.x * TPE_COLLISION_RESOLUTION_MARGIN) / TPE_F;
+      p.y += 2 * TPE_COLLISION_RESOLUTION_MARGIN;
+      p.z += (h.z * TPE_COLLISION_RESOLUTION_MARGIN) / TPE_F;
+
+      p = TPE_vec3Minus(p,env(p,4 * TPE_COLLISION_RESOLUTION_MARGIN));
+
+      if (TPE_vec3Normalized(p).y < character->slopeLimit)
+        ground2 = 0;
+    }
+
+    if (ground2)
+    {
+      offset = o;
+      ground = 1;
+    }
+    else
+    {
+      character->velocity = velocity;
+      character->groundNormal = groundNormal;
+      character->groundBody = groundBody;
+    }
+  }
+
+  /* vertical part, skipped when standing on ground found by the horizontal
+     part (which is the usual case): gravity would only push into it. */
+
+  if (ground && character->velocity.y <= 0)
+    character->velocity.y = 0;
+  else
+    offset = _TPE_characterSlide(character,offset,
+      TPE_vec3(0,character->velocity.y,0),character->slopeLimit,env,&ground,
+      &wall);
+
+  character->onGround = ground;
+
+  if (ground && character->groundBody >= 0 &&
+    (world->bodies[character->groundBody].flags & TPE_BODY_FLAG_KINEMATIC))
+  {
+    // moving platform, move with it
+
+    const TPE_Joint *j = world->bodies[character->groundBody].joints;
+
+    offset.x += j->velocity[0];
+    offset.y += j->velocity[1];
+    offset.z += j->velocity[2];
+  }
+  else if (!ground)
+    character->groundBody = -1;
+
+  for (uint16_t i = 0; i < character->body->jointCount; ++i)
+  {
+    character->body->joints[i].velocity[0] = offset.x;
+    character->body->joints[i].velocity[1] = offset.y;
+    character->body->joints[i].velocity[2] = offset.z;
+  }
+
+  return ground;
+}
+
+void TPE_vehicleInit(TPE_Vehicle *vehicle, TPE_Body *body,
+  TPE_Unit wheelRadius, TPE_Unit suspensionLength)
+{
+  vehicle->body = body;
+  vehicle->wheelRadius = wheelRadius;
+  vehicle->suspensionLength = suspensionLength;
+  vehicle->stiffness = TPE_F / 16;
+  vehicle->damping = TPE_F / 2; // 2 * sqrt(stiffness)
+  vehicle->sideFriction = (3 * TPE_F) / 4;
+  vehicle->rollFriction = TPE_F / 64;
+  vehicle->steering = 0;
+  vehicle->throttle = 0;
+  vehicle->steeredWheels = 0x0c;
+  vehicle->drivenWheels = 0x03;
+  vehicle->onGround = 0;
+
+  for (uint8_t i = 0; i < TPE_VEHICLE_MAX_WHEELS; ++i)
+    vehicle->compression[i] = 0;
+
+  body->flags |= TPE_BODY_FLAG_ALWAYS_ACTIVE;
+}
+
+/* Computes the normalized forward, left and up vectors of a vehicle's
+  chassis. */
+void _TPE_vehicleAxes(const TPE_Body *body, TPE_Vec3 *forward,
+  TPE_Vec3 *left, TPE_Vec3 *up)
+{
+  *forward = TPE_vec3Normalized(TPE_vec3Minus(body->joints[2].position,
+    body->joints[0].position));
+
+  *left = TPE_vec3Normalized(TPE_vec3Minus(body->joints[1].position,
+    body->joints[0].position));
+
+  *up = TPE_vec3Normalized(TPE_vec3Cross(*forward,*left));
+}
+
+/* Casts a sphere from position in (normalized) direction by sphere tracing the
+  environment, returns the distance travelled to the hit (0 if the sphere
+  already collides) or -1 if there is no hit within maxDistance. */
+TPE_Unit _TPE_vehicleCast(TPE_Vec3 position, TPE_Vec3 direction,
+  TPE_Unit radius, TPE_Unit maxDistance, TPE_ClosestPointFunction env)
+{
+  TPE_Unit t = 0;
+
+  for (uint8_t i = 0; i < TPE_VEHICLE_CAST_STEPS; ++i)
+  {
+    TPE_Vec3 p = TPE_vec3Plus(position,TPE_vec3Times(direction,t));
+
+    TPE_Unit d = TPE_dist(p,env(p,radius + maxDistance - t)) - radius;
+
+    if (d <= TPE_COLLISION_RESOLUTION_MARGIN)
+      return t;
+
+    t += d;
+
+    if (t > maxDistance)
+      return -1;
+  }
+
+  return t; // not converged (grazing surface), take it as a hit
+}
+
+uint8_t TPE_vehicleUpdate(TPE_Vehicle *vehicle, TPE_ClosestPointFunction env)
+{
+  _TPE_PROFILE_BEGIN("TPE_vehicleUpdate");
+
+  TPE_Body *body = vehicle->body;
+  TPE_Vec3 forward, left, up;
+
+  _TPE_vehicleAxes(body,&forward,&left,&up);
+
+  TPE_Vec3 down = TPE_vec3TimesPlain(up,-1),
+    steeredForward = TPE_vec3Plus(
+      TPE_vec3Times(forward,TPE_cos(vehicle->steering)),
+      TPE_vec3Times(left,TPE_sin(vehicle->steering))),
+    steeredLeft = TPE_vec3Minus(
+      TPE_vec3Times(left,TPE_cos(vehicle->steering)),
+      TPE_vec3Times(forward,TPE_sin(vehicle->steering)));
+
+  vehicle->onGround = 0;
+
+  for (uint8_t i = 0; i < body->jointCount && i < TPE_VEHICLE_MAX_WHEELS; ++i)
+  {
+    TPE_Joint *joint = body->joints + i;
+
+    TPE_Unit t = _TPE_vehicleCast(joint->position,down,vehicle->wheelRadius,
+      vehicle->suspensionLength,env);
+
+    if (t < 0)
+    {
+      vehicle->compression[i] = 0;
+      continue;
+    }
+
+    vehicle->onGround |= 1 << i;
+
+    TPE_Unit compression = vehicle->suspensionLength - t;
+
+    // spring and damper, the suspension can only push:
+
+    TPE_Unit push = (vehicle->stiffness * compression + vehicle->damping *
+      (compression - vehicle->compression[i])) / TPE_F;
+
+    vehicle->compression[i] = compression;
+
+    TPE_Vec3 v = TPE_vec3(joint->velocity[0],joint->velocity[1],
+      joint->velocity[2]);
+
+    if (push > 0)
+      v = TPE_vec3Plus(v,TPE_vec3Times(up,push));
+
+    // tyre friction and drive, in the wheel's direction:
+
+    TPE_Vec3 f = forward, l = left;
+
+    if (vehicle->steeredWheels & (1 << i))
+    {
+      f = steeredForward;
+      l = steeredLeft;
+    }
+
+    v = TPE_vec3Minus(v,TPE_vec3Times(l,
+      (TPE_vec3Dot(v,l) * vehicle->sideFriction) / TPE_F));
+
+    v = TPE_vec3Minus(v,TPE_vec3Times(f,
+      (TPE_vec3Dot(v,f) * vehicle->rollFriction) / TPE_F));
+
+    if (vehicle->drivenWheels & (1 << i))
+      v = TPE_vec3Plus(v,TPE_vec3Times(f,vehicle->throttle));
+
+    joint->velocity[0] = v.x;
+    joint->velocity[1] = v.y;
+    joint->velocity[2] = v.z;
+  }
+
+  _TPE_PROFILE_END("TPE_vehicleUpdate");
+
+  return vehicle->onGround;
+}
+
+TPE_Vec3 TPE_vehicleWheelPosition(const TPE_Vehicle *vehicle, uint8_t wheel)
+{
+  TPE_Vec3 forward, left, up;
+
+  if (wheel >= vehicle->body->jointCount || wheel >= TPE_VEHICLE_MAX_WHEELS)
+    return TPE_vec3(0,0,0);
+
+  _TPE_vehicleAxes(vehicle->body,&forward,&left,&up);
+
+  return TPE_vec3Minus(vehicle->body->joints[wheel].position,
+    TPE_vec3Times(up,vehicle->suspensionLength - vehicle->compression[wheel]));
+}
+
+void TPE_worldDeactivateAll(TPE_World *world)
+{
+  for (uint16_t i = 0; i < world->bodyCount; ++i)
+    TPE_bodyDeactivate(&world->bodies[i]);
+}
+
+void TPE_worldActivateAll(TPE_World *world)
+{
+  for (uint16_t i = 0; i < world->bodyCount; ++i)
+    TPE_bodyActivate(&world->bodies[i]);
+}
 
 TPE_Unit TPE_worldGetNetSpeed(const TPE_World *world)
 {
-  TPE_Unit result = 0;
+  TPE_Unit result = 0;
+
+  for (uint16_t i = 0; i < world->bodyCount; ++i)
+    result += TPE_bodyGetNetSpeed(world->bodies + i);
+
+  return result;
+}
+
+TPE_Vec3 TPE_bodyGetLinearVelocity(const TPE_Body *body)
+{
+  TPE_Vec3 r = TPE_vec3(0,0,0);
+
+  for (uint16_t i = 0; i < body->jointCount; ++i)
+  {
+    TPE_UnitReduced *v = body->joints[i].velocity;
+    r = TPE_vec3Plus(r,TPE_vec3(v[0],v[1],v[2]));
+  }
+
+  r.x /= body->jointCount;
+  r.y /= body->jointCount;
+  r.z /= body->jointCount;
+    
+  return r;
+}
+
+TPE_Unit TPE_abs(TPE_Unit x)
+{
+  return x >= 0 ? x : (-1 * x);
+}
+
+TPE_Unit TPE_max(TPE_Unit a, TPE_Unit b)
+{
+  return (a > b) ? a : b;
+}
+
+TPE_Unit TPE_min(TPE_Unit a, TPE_Unit b)
+{
+  return (a < b) ? a : b;
+}
+
+TPE_Vec3 TPE_envAATriPrism(TPE_Vec3 point, TPE_Vec3 center,
+  const TPE_Unit sides[6], TPE_Unit depth, uint8_t direction)
+{
+  point = TPE_vec3Minus(point,center);
+
+  if (direction == 1)
+  {
+    TPE_Unit tmp = point.z;
+    point.z = point.y;
+    point.y = tmp;
+  }
+  else if (direction == 2)
+  {
+    TPE_Unit tmp = point.z;
+    point.z = point.x;
+    point.x = tmp;
+  }
+
+  depth /= 2;
+
+  if (point.z > depth)
+    point.z = depth;
+  else
+  {
+    depth *= -1;
+
+    if (point.z < depth)
+      point.z = depth;
+  }
+
+  for (uint8_t i = 0; i < 6; i += 2)
+  {
+    uint8_t i2 = i < 4 ? i + 2 : 0;
+
+    TPE_Vec3 p =
+      TPE_envHalfPlane(point,TPE_vec3(sides[i],sides[i + 1],0),
+      TPE_vec3(sides[i2 + 1] - sides[i + 1],sides[i] - sides[i2],0));
+
+    if (p.x != point.x || p.y != point.y)
+    {
+      point = p;
+
+      if ( // dot product to determine which side the point is on 
+        (sides[i2] - sides[i]) * (point.x - sides[i]) +
+        (sides[i2 + 1] - sides[i + 1]) * (point.y - sides[i + 1]) < 0)
+      {
+        point.x = sides[i]; point.y = sides[i + 1];
+      }
+      else if ( // same but for the other vertex
+        (sides[i] - sides[i2]) * (point.x - sides[i2]) +
+        (sides[i + 1] - sides[i2 + 1]) * (point.y - sides[i2 + 1]) < 0)
+      {
+        point.x = sides[i2]; point.y = sides[i2 + 1];
+      }
+
+      break;
+    }
+  }
+
+  if (direction == 1)
+  {
+    TPE_Unit tmp = point.z;
+    point.z = point.y;
+    point.y = tmp;
+  }
+  else if (direction == 2)
+  {
+    TPE_Unit tmp = point.z;
+    point.z = point.x;
+    point.x = tmp;
+  }
+
+  return TPE_vec3Plus(point,center);
+}
+
+TPE_Vec3 TPE_envGround(TPE_Vec3 point, TPE_Unit height)
+{
+  if (point.y > height)
+    point.y = height;
+
+  return point;
+}
+
+uint32_t _TPE_hash(uint32_t n)
+{
+  // parameters found by hash-prospector project
+  n = 250009959 * (n ^ (n >> 17));
+  n = 2626308659 * (n ^ (n >> 15));
+  return n ^ (n >> 16);
+}
+
+uint32_t TPE_jointHash(const TPE_Joint *joint)
+{
+  uint32_t 
+    r = _TPE_hash(joint->position.x);
+    r = _TPE_hash(r ^ joint->position.y);
+    r = _TPE_hash(r ^ joint->position.z);
+    r = _TPE_hash(r ^
+      (((uint32_t) joint->velocity[0]) |
+      (((uint32_t) joint->velocity[1]) << 16)));
+    r = _TPE_hash(r ^ 
+      (((uint32_t) joint->velocity[2]) |
+      ((uint32_t) joint->sizeDivided)));
+  
+  return r;
+}
+
+uint32_t TPE_connectionHash(const TPE_Connection *connection)
+{
+  return _TPE_hash(
+   ((uint32_t) connection->length) |
+   (((uint32_t) connection->joint1) << 16) |
+   (((uint32_t) connection->joint2) << 24));
+}
+
+uint32_t TPE_bodyHash(const TPE_Body *body)
+{
+  uint32_t r = _TPE_hash(
+    ((uint32_t) body->jointMass) |
+    (((uint32_t) body->flags) << 16) |
+    (((uint32_t) body->deactivateCount) << 24)) ^
+      _TPE_hash(
+    ((uint32_t) body->friction) |
+    (((uint32_t) body->elasticity) << 16));
+
+  for (uint8_t i = 0; i < body->jointCount; ++i)
+    r = _TPE_hash(r ^ TPE_jointHash(&body->joints[i]));
+
+  for (uint8_t i = 0; i < body->connectionCount; ++i)
+    r = _TPE_hash(r ^ TPE_connectionHash(&body->connections[i]));
+
+  return r;
+}
+
+uint32_t TPE_worldHash(const TPE_World *world)
+{
+  uint32_t r = 0;
+
+  for (uint16_t i = 0; i < world->bodyCount; ++i)
+    r = _TPE_hash(r ^ TPE_bodyHash(&world->bodies[i]));
+
+  return r;
+}
+
+uint32_t TPE_worldHashTree(const TPE_World *world, uint32_t *tree)
+{
+  uint32_t leafCount = 1; // 32 bit as 65536 leaves don't fit in 16 bits
+
+  while (leafCount < world->bodyCount)
+    leafCount *= 2;
+
+  for (uint32_t i = 0; i < leafCount; ++i)
+    tree[leafCount + i] = i < world->bodyCount ?
+      TPE_bodyHash(world->bodies + i) : 0;
+
+  for (uint32_t i = leafCount - 1; i > 0; --i)
+    tree[i] = _TPE_hash(tree[2 * i] ^ _TPE_hash(tree[2 * i + 1] + 1));
+
+  tree[0] = 0; // unused
+
+  return leafCount;
+}
+
+uint32_t TPE_hashTreeDescend(const uint32_t *tree, uint32_t node,
+  uint32_t remoteLeft, uint32_t remoteRight)
+{
+  if (tree[2 * node] != remoteLeft)
+    return 2 * node;
+
+  if (tree[2 * node + 1] != remoteRight)
+    return 2 * node + 1;
+
+  return 0;
+}
+
+int32_t TPE_hashTreeFirstDifference(const uint32_t *tree1,
+  const uint32_t *tree2, uint32_t leafCount)
+{
+  uint32_t node = 1;
+
+  if (tree1[1] == tree2[1])
+    return -1;
+
+  while (node < leafCount)
+  {
+    node = TPE_hashTreeDescend(tree1,node,tree2[2 * node],tree2[2 * node + 1]);
+
+    if (node == 0)
+      return -1;
+  }
+
+  return node - leafCount;
+}
+
+uint32_t _TPE_bodyStaticHash(const TPE_Body *body)
+{
+  uint32_t r = _TPE_hash(
+    ((uint32_t) body->jointMass) |
+    (((uint32_t) body->jointCount) << 16) |
+    (((uint32_t) body->connectionCount) << 24)) ^
+      _TPE_hash(
+    ((uint32_t) body->friction) |
+    (((uint32_t) body->elasticity) << 16));
+
+  for (uint8_t i = 0; i < body->connectionCount; ++i)
+    r = _TPE_hash(r ^ TPE_connectionHash(&body->connections[i]));
+
+  return r;
+}
+
+void _TPE_worldHashCacheRehash(TPE_WorldHashCache *cache,
+  const TPE_World *world, uint16_t bodyIndex)
+{
+  const TPE_Body *body = world->bodies + bodyIndex;
+  TPE_BodyHashCache *c = cache->bodies + bodyIndex;
+
+  uint32_t r = _TPE_hash(c->staticHash ^
+    (((uint32_t) body->flags) | (((uint32_t) body->deactivateCount) << 8)));
+
+  for (uint8_t i = 0; i < body->jointCount; ++i)
+    r = _TPE_hash(r ^ TPE_jointHash(&body->joints[i]));
+
+  r = _TPE_hash(r + bodyIndex * 2654435769u); // mix in the index
+
+  cache->sum += r - c->hash;
+  c->hash = r;
+  c->flags = body->flags;
+}
+
+void TPE_worldHashCacheInit(TPE_WorldHashCache *cache,
+  TPE_BodyHashCache *bodyCaches, const TPE_World *world)
+{
+  cache->bodies = bodyCaches;
+  cache->bodyCount = world->bodyCount;
+  cache->sum = 0;
+
+  for (uint16_t i = 0; i < world->bodyCount; ++i)
+  {
+    bodyCaches[i].hash = 0;
+    bodyCaches[i].staticHash = _TPE_bodyStaticHash(world->bodies + i);
+    _TPE_worldHashCacheRehash(cache,world,i);
+  }
+
+  cache->hash = _TPE_hash(cache->sum ^ cache->bodyCount);
+}
+
+uint32_t TPE_worldHashCacheUpdate(TPE_WorldHashCache *cache,
+  const TPE_World *world)
+{
+  for (uint16_t i = 0; i < cache->bodyCount; ++i)
+  {
+    uint8_t flags = world->bodies[i].flags;
+
+    if (!(flags & (TPE_BODY_FLAG_DEACTIVATED | TPE_BODY_FLAG_DISABLED |
+      TPE_BODY_FLAG_STATIC)) ||
+      flags != cache->bodies[i].flags)
+      _TPE_worldHashCacheRehash(cache,world,i);
+  }
+
+  cache->hash = _TPE_hash(cache->sum ^ cache->bodyCount);
+
+  return cache->hash;
+}
+
+void TPE_worldHashCacheBodyChanged(TPE_WorldHashCache *cache,
+  const TPE_World *world, uint16_t bodyIndex)
+{
+  _TPE_worldHashCacheRehash(cache,world,bodyIndex);
+  cache->hash = _TPE_hash(cache->sum ^ cache->bodyCount);
+}
+
+uint32_t _TPE_worldJointCount(const TPE_World *world)
+{
+  uint32_t r = 0;
+
+  for (uint16_t i = 0; i < world->bodyCount; ++i)
+    r += world->bodies[i].jointCount;
+
+  return r;
+}
+
+uint32_t TPE_worldSnapshotSize(const TPE_World *world)
+{
+  return TPE_SNAPSHOT_SIZE(_TPE_worldJointCount(world),world->bodyCount);
+}
+
+uint32_t TPE_worldSnapshot(const TPE_World *world, void *buffer)
+{
+  /* Whole joints are copied (even though sizeDivided doesn't change) so that
+     the compiler can turn this into plain memory copies. Body bytes go after
+     the joints so that the joints stay aligned. */
+
+  TPE_Joint *j = (TPE_Joint *) buffer;
+
+  for (uint16_t i = 0; i < world->bodyCount; ++i)
+  {
+    const TPE_Body *body = world->bodies + i;
+
+    for (uint8_t k = 0; k < body->jointCount; ++k)
+      j[k] = body->joints[k];
+
+    j += body->jointCount;
+  }
+
+  uint8_t *b = (uint8_t *) j;
+
+  for (uint16_t i = 0; i < world->bodyCount; ++i)
+  {
+    *b = world->bodies[i].flags;
+    b++;
+    *b = world->bodies[i].deactivateCount;
+    b++;
+  }
+
+  return b - ((uint8_t *) buffer);
+}
+
+uint32_t TPE_worldRestore(TPE_World *world, const void *buffer)
+{
+  const TPE_Joint *j = (const TPE_Joint *) buffer;
+  uint8_t staticsChanged = 0;
+
+  for (uint16_t i = 0; i < world->bodyCount; ++i)
+  {
+    TPE_Body *body = world->bodies + i;
+
+    for (uint8_t k = 0; k < body->jointCount; ++k)
+    {
+      if ((body->flags & TPE_BODY_FLAG_STATIC) &&
+        (body->joints[k].position.x != j[k].position.x ||
+        body->joints[k].position.y != j[k].position.y ||
+        body->joints[k].position.z != j[k].position.z))
+        staticsChanged = 1;
+
+      body->joints[k] = j[k];
+    }
+
+    j += body->jointCount;
+  }
+
+  const uint8_t *b = (const uint8_t *) j;
+
+  for (uint16_t i = 0; i < world->bodyCount; ++i)
+  {
+    if ((world->bodies[i].flags ^ *b) & TPE_BODY_FLAG_STATIC)
+      staticsChanged = 1;
+
+    world->bodies[i].flags = *b;
+    b++;
+    world->bodies[i].deactivateCount = *b;
+    b++;
+  }
+
+  if (staticsChanged)
+    _TPE_worldRebuildStatics(world);
+
+  return b - ((const uint8_t *) buffer);
+}
+
+void _TPE_writeVarint(uint8_t **p, uint32_t v)
+{
+  while (v >= 0x80)
+  {
+    **p = (v & 0x7f) | 0x80;
+    (*p)++;
+    v >>= 7;
+  }
+
+  **p = v;
+  (*p)++;
+}
+
+uint32_t _TPE_readVarint(const uint8_t **p)
+{
+  uint32_t r = 0;
+
+  for (uint8_t shift = 0; shift < 35; shift += 7)
+  {
+    r |= ((uint32_t) (**p & 0x7f)) << shift;
+    (*p)++;
+
+    if (!((*p)[-1] & 0x80))
+      break;
+  }
+
+  return r;
+}
+
+/* Like _TPE_readVarint but doesn't read from end on, returns 0 if the varint
+  doesn't fit before it. */
+uint8_t _TPE_readVarintBounded(const uint8_t **p, const uint8_t *end,
+  uint32_t *value)
+{
+  *value = 0;
+
+  for (uint8_t shift = 0; shift < 35; shift += 7)
+  {
+    if (*p >= end)
+      return 0;
+
+    *value |= ((uint32_t) (**p & 0x7f)) << shift;
+    (*p)++;
+
+    if (!((*p)[-1] & 0x80))
+      break;
+  }
+
+  return 1;
+}
+
+static inline uint32_t _TPE_zigzag(int32_t v)
+{
+  // maps small negative numbers to small positive ones: 0,-1,1,-2,2,...
+  return (((uint32_t) v) << 1) ^ (v < 0 ? 0xffffffff : 0);
+}
+
+static inline int32_t _TPE_unzigzag(uint32_t v)
+{
+  return (int32_t) ((v >> 1) ^ (0 - (v & 1)));
+}
+
+/** Quantizes a position coordinate for the delta encoder, rounding to the
+  nearest value symmetrically around zero (plain division would round towards
+  zero and so bias negative and positive values differently). */
+static inline int32_t _TPE_deltaQuantize(TPE_Unit v)
+{
+#if TPE_DELTA_QUANTIZATION == 0
+  return v;
+#else
+  return (v >= 0 ? v + (1 << (TPE_DELTA_QUANTIZATION - 1)) :
+    v - (1 << (TPE_DELTA_QUANTIZATION - 1))) / (1 << TPE_DELTA_QUANTIZATION);
+#endif
+}
+
+/** Gets the values the delta encoder works with (quantized zigzagged position
+  and zigzagged velocity) for given joint, joint can be 0 (zeros returned). */
+void _TPE_deltaJointValues(const TPE_Joint *joint, uint32_t values[6])
+{
+  if (joint == 0)
+  {
+    for (uint8_t i = 0; i < 6; ++i)
+      values[i] = 0;
+
+    return;
+  }
+
+  values[0] = _TPE_zigzag(_TPE_deltaQuantize(joint->position.x));
+  values[1] = _TPE_zigzag(_TPE_deltaQuantize(joint->position.y));
+  values[2] = _TPE_zigzag(_TPE_deltaQuantize(joint->position.z));
+
+  for (uint8_t i = 0; i < 3; ++i)
+    values[3 + i] = _TPE_zigzag(joint->velocity[i]);
+}
+
+uint32_t TPE_snapshotEncodeDelta(const TPE_World *world, const void *previous,
+  const void *current, uint8_t *out)
+{
+  /* Format: keyframe byte, then for each changed body a varint count of
+     unchanged bodies skipped before it followed by the body's flags,
+     deactivation count and 6 varints per joint, at the end a varint count of
+     the remaining unchanged bodies. */
+
+  uint32_t jointCount = _TPE_worldJointCount(world);
+
+  const TPE_Joint
+    *jCur = (const TPE_Joint *) current,
+    *jPrev = (const TPE_Joint *) previous;
+
+  const uint8_t
+    *bCur = (const uint8_t *) (jCur + jointCount),
+    *bPrev = previous != 0 ? (const uint8_t *) (jPrev + jointCount) : 0;
+
+  uint8_t *o = out;
+  uint32_t vCur[6], vPrev[6];
+  uint16_t skipped = 0;
+
+  *o = previous == 0;
+  o++;
+
+  for (uint16_t i = 0; i < world->bodyCount; ++i)
+  {
+    uint8_t jc = world->bodies[i].jointCount;
+    uint8_t changed = bPrev == 0 ?
+      (bCur[0] != 0 || bCur[1] != 0) :
+      (bCur[0] != bPrev[0] || bCur[1] != bPrev[1]);
+
+    for (uint8_t j = 0; j < jc && !changed; ++j)
+    {
+      _TPE_deltaJointValues(jCur + j,vCur);
+      _TPE_deltaJointValues(jPrev != 0 ? jPrev + j : 0,vPrev);
+
+      for (uint8_t k = 0; k < 6; ++k)
+        if (vCur[k] != vPrev[k])
+        {
+          changed = 1;
+          break;
+        }
+    }
+
+    if (changed)
+    {
+      _TPE_writeVarint(&o,skipped);
+      skipped = 0;
+
+      *o = bCur[0];
+      o++;
+      *o = bCur[1];
+      o++;
+
+      for (uint8_t j = 0; j < jc; ++j)
+      {
+        _TPE_deltaJointValues(jCur + j,vCur);
+        _TPE_deltaJointValues(jPrev != 0 ? jPrev + j : 0,vPrev);
+
+        for (uint8_t k = 0; k < 6; ++k)
+          _TPE_writeVarint(&o,vCur[k] ^ vPrev[k]);
+      }
+    }
+    else
+      skipped++;
+
+    jCur += jc;
+    bCur += 2;
+
+    if (jPrev != 0)
+    {
+      jPrev += jc;
+      bPrev += 2;
+    }
+  }
+
+  _TPE_writeVarint(&o,skipped);
+
+  return o - out;
+}
+
+uint32_t TPE_snapshotDecodeDelta(const TPE_World *world, const void *previous,
+  const uint8_t *data, uint32_t size, void *current)
+{
+  uint32_t jointCount = _TPE_worldJointCount(world);
+  const uint8_t *d = data, *end = data + size;
+
+  if (size == 0)
+    return 0;
+
+  if (*d) // keyframe?
+    previous = 0;
+
+  d++;
+
+  TPE_Joint *jCur = (TPE_Joint *) current;
+  const TPE_Joint *jPrev = (const TPE_Joint *) previous;
+
+  uint8_t *bCur = (uint8_t *) (jCur + jointCount);
+  const uint8_t *bPrev = previous != 0 ?
+    (const uint8_t *) (jPrev + jointCount) : 0;
+
+  uint32_t v[6];
+  uint16_t i = 0;
+
+  while (1)
+  {
+    uint32_t skip;
+
+    if (!_TPE_readVarintBounded(&d,end,&skip) ||
+      skip > ((uint32_t) world->bodyCount) - i)
+      return 0;
+
+    for (uint32_t s = 0; s < skip; ++s)
+    {
+      // unchanged body, copy it
+
+      const TPE_Body *body = world->bodies + i;
+
+      for (uint8_t j = 0; j < body->jointCount; ++j)
+      {
+        if (jPrev != 0)
+          jCur[j] = jPrev[j];
+        else
+        {
+          jCur[j] = TPE_joint(TPE_vec3(0,0,0),0);
+          jCur[j].sizeDivided = body->joints[j].sizeDivided;
+        }
+      }
+
+      bCur[0] = bPrev != 0 ? bPrev[0] : 0;
+      bCur[1] = bPrev != 0 ? bPrev[1] : 0;
+
+      jCur += body->jointCount;
+      bCur += 2;
+
+      if (jPrev != 0)
+      {
+        jPrev += body->jointCount;
+        bPrev += 2;
+      }
+
+      i++;
+    }
+
+    if (i >= world->bodyCount)
+      break;
+
+    const TPE_Body *body = world->bodies + i;
+
+    if (end - d < 2)
+      return 0;
+
+    bCur[0] = *d;
+    d++;
+    bCur[1] = *d;
+    d++;
+
+    for (uint8_t j = 0; j < body->jointCount; ++j)
+    {
+      _TPE_deltaJointValues(jPrev != 0 ? jPrev + j : 0,v);
+
+      for (uint8_t k = 0; k < 6; ++k)
+      {
+        uint32_t x;
+
+        if (!_TPE_readVarintBounded(&d,end,&x))
+          return 0;
+
+        v[k] ^= x;
+      }
+
+      // jCur and jPrev may be the same, only write after reading
+
+      jCur[j].position.x = _TPE_unzigzag(v[0]) * (1 << TPE_DELTA_QUANTIZATION);
+      jCur[j].position.y = _TPE_unzigzag(v[1]) * (1 << TPE_DELTA_QUANTIZATION);
+      jCur[j].position.z = _TPE_unzigzag(v[2]) * (1 << TPE_DELTA_QUANTIZATION);
+
+      for (uint8_t k = 0; k < 3; ++k)
+        jCur[j].velocity[k] = _TPE_unzigzag(v[3 + k]);
+
+      jCur[j].sizeDivided = body->joints[j].sizeDivided;
+    }
+
+    jCur += body->jointCount;
+    bCur += 2;
+
+    if (jPrev != 0)
+    {
+      jPrev += body->jointCount;
+      bPrev += 2;
+    }
+
+    i++;
+  }
+
+  return d - data;
+}
+
+void _TPE_snapshotCopy(const TPE_World *world, const void *from, void *to)
+{
+  uint32_t jointCount = _TPE_worldJointCount(world);
 
-  for (uint16_t i = 0; i < world->bodyCount; ++i)
-    result += TPE_bodyGetNetSpeed(world->bodies + i);
+  for (uint32_t i = 0; i < jointCount; ++i)
+    ((TPE_Joint *) to)[i] = ((const TPE_Joint *) from)[i];
 
-  return result;
+  const uint8_t *b1 = (const uint8_t *) (((const TPE_Joint *) from) + jointCount);
+  uint8_t *b2 = (uint8_t *) (((TPE_Joint *) to) + jointCount);
+
+  for (uint16_t i = 0; i < world->bodyCount * 2; ++i)
+    b2[i] = b1[i];
 }
 
-TPE_Vec3 TPE_bodyGetLinearVelocity(const TPE_Body *body)
+void TPE_deltaStreamInit(TPE_DeltaStream *stream, void *previousBuffer,
+  uint16_t keyframeInterval)
 {
-  TPE_Vec3 r = TPE_vec3(0,0,0);
+  stream->previous = previousBuffer;
+  stream->keyframeInterval = keyframeInterval;
+  stream->frame = 0;
+}
 
-  for (uint16_t i = 0; i < body->jointCount; ++i)
-  {
-    TPE_UnitReduced *v = body->joints[i].velocity;
-    r = TPE_vec3Plus(r,TPE_vec3(v[0],v[1],v[2]));
-  }
+uint32_t TPE_deltaStreamEncode(TPE_DeltaStream *stream, const TPE_World *world,
+  const void *current, uint8_t *out)
+{
+  uint8_t keyframe = stream->frame == 0 || (stream->keyframeInterval != 0 &&
+    stream->frame % stream->keyframeInterval == 0);
+
+  uint32_t r = TPE_snapshotEncodeDelta(world,keyframe ? 0 : stream->previous,
+    current,out);
+
+  /* The previous state must be what the decoder will see, i.e. with quantized
+     positions. */
+#if TPE_DELTA_QUANTIZATION == 0
+  _TPE_snapshotCopy(world,current,stream->previous);
+#else
+  TPE_snapshotDecodeDelta(world,stream->previous,out,r,stream->previous);
+#endif
+
+  stream->frame++;
 
-  r.x /= body->jointCount;
-  r.y /= body->jointCount;
-  r.z /= body->jointCount;
-    
   return r;
 }
 
-TPE_Unit TPE_abs(TPE_Unit x)
+uint32_t TPE_deltaStreamDecode(TPE_DeltaStream *stream, const TPE_World *world,
+  const uint8_t *data, uint32_t size, void *current)
 {
-  return x >= 0 ? x : (-1 * x);
+  uint32_t r =
+    TPE_snapshotDecodeDelta(world,stream->previous,data,size,current);
+
+  if (r == 0)
+    return 0;
+
+  _TPE_snapshotCopy(world,current,stream->previous);
+
+  stream->frame++;
+
+  return r;
 }
 
-TPE_Unit TPE_max(TPE_Unit a, TPE_Unit b)
+void TPE_inputLogInit(TPE_InputLog *inputLog, uint8_t *buffer,
+  uint32_t capacity, uint16_t checkpointInterval)
 {
-  return (a > b) ? a : b;
+  inputLog->data = buffer;
+  inputLog->size = 0;
+  inputLog->capacity = capacity;
+  inputLog->tick = 0;
+  inputLog->checkpointInterval = checkpointInterval;
+  inputLog->parameterFunction = 0;
 }
 
-TPE_Unit TPE_min(TPE_Unit a, TPE_Unit b)
+/** Starts writing a log entry, returns the write pointer or 0 if the log is
+  full. */
+uint8_t *_TPE_inputLogEntry(TPE_InputLog *inputLog, uint8_t type, uint16_t body)
 {
-  return (a < b) ? a : b;
+  if (inputLog->size + TPE_INPUT_LOG_MAX_ENTRY > inputLog->capacity)
+    return 0;
+
+  uint8_t *p = inputLog->data + inputLog->size;
+
+  *p = type;
+  p++;
+
+  if (type != TPE_INPUT_STEP && type != TPE_INPUT_CHECKPOINT)
+    _TPE_writeVarint(&p,body);
+
+  return p;
 }
 
-TPE_Vec3 TPE_envAATriPrism(TPE_Vec3 point, TPE_Vec3 center,
-  const TPE_Unit sides[6], TPE_Unit depth, uint8_t direction)
+void _TPE_inputLogWriteVec3(uint8_t **p, TPE_Vec3 v)
 {
-  point = TPE_vec3Minus(point,center);
+  _TPE_writeVarint(p,_TPE_zigzag(v.x));
+  _TPE_writeVarint(p,_TPE_zigzag(v.y));
+  _TPE_writeVarint(p,_TPE_zigzag(v.z));
+}
 
-  if (direction == 1)
-  {
-    TPE_Unit tmp = point.z;
-    point.z = point.y;
-    point.y = tmp;
-  }
-  else if (direction == 2)
-  {
-    TPE_Unit tmp = point.z;
-    point.z = point.x;
-    point.x = tmp;
-  }
+TPE_Vec3 _TPE_inputLogReadVec3(const uint8_t **p)
+{
+  TPE_Vec3 r;
 
-  depth /= 2;
+  r.x = _TPE_unzigzag(_TPE_readVarint(p));
+  r.y = _TPE_unzigzag(_TPE_readVarint(p));
+  r.z = _TPE_unzigzag(_TPE_readVarint(p));
 
-  if (point.z > depth)
-    point.z = depth;
-  else
-  {
-    depth *= -1;
+  return r;
+}
 
-    if (point.z < depth)
-      point.z = depth;
-  }
+void _TPE_jointSetVelocity(TPE_Joint *joint, TPE_Vec3 velocity)
+{
+  joint->velocity[0] = velocity.x;
+  joint->velocity[1] = velocity.y;
+  joint->velocity[2] = velocity.z;
+}
 
-  for (uint8_t i = 0; i < 6; i += 2)
+/** Applies a single input log entry (other than step and checkpoint) to the
+  world, returns pointer after the entry. */
+const uint8_t *_TPE_inputLogApply(const uint8_t *p, TPE_World *world,
+  void (*parameterFunction)(uint8_t, int32_t))
+{
+  uint8_t type = *p;
+  p++;
+
+  uint32_t index = _TPE_readVarint(&p);
+  TPE_Body *body = 0;
+
+  if (type != TPE_INPUT_PARAMETER)
+    body = world->bodies + index;
+
+  switch (type)
   {
-    uint8_t i2 = i < 4 ? i + 2 : 0;
+    case TPE_INPUT_ACCELERATE:
+      TPE_bodyAccelerate(body,_TPE_inputLogReadVec3(&p));
+      break;
 
-    TPE_Vec3 p =
-      TPE_envHalfPlane(point,TPE_vec3(sides[i],sides[i + 1],0),
-      TPE_vec3(sides[i2 + 1] - sides[i + 1],sides[i] - sides[i2],0));
+    case TPE_INPUT_SPIN:
+      TPE_bodySpin(body,_TPE_inputLogReadVec3(&p));
+      break;
 
-    if (p.x != point.x || p.y != point.y)
+    case TPE_INPUT_GRAVITY:
+      TPE_bodyApplyGravity(body,_TPE_unzigzag(_TPE_readVarint(&p)));
+      break;
+
+    case TPE_INPUT_JOINT_PIN:
+    case TPE_INPUT_JOINT_VELOCITY:
     {
-      point = p;
+      TPE_Joint *joint = body->joints + *p;
+      p++;
 
-      if ( // dot product to determine which side the point is on 
-        (sides[i2] - sides[i]) * (point.x - sides[i]) +
-        (sides[i2 + 1] - sides[i + 1]) * (point.y - sides[i + 1]) < 0)
-      {
-        point.x = sides[i]; point.y = sides[i + 1];
-      }
-      else if ( // same but for the other vertex
-        (sides[i] - sides[i2]) * (point.x - sides[i2]) +
-        (sides[i + 1] - sides[i2 + 1]) * (point.y - sides[i2 + 1]) < 0)
-      {
-        point.x = sides[i2]; point.y = sides[i2 + 1];
-      }
+      if (type == TPE_INPUT_JOINT_PIN)
+        TPE_jointPin(joint,_TPE_inputLogReadVec3(&p));
+      else
+        _TPE_jointSetVelocity(joint,_TPE_inputLogReadVec3(&p));
 
       break;
     }
-  }
 
-  if (direction == 1)
-  {
-    TPE_Unit tmp = point.z;
-    point.z = point.y;
-    point.y = tmp;
+    case TPE_INPUT_PARAMETER:
+    {
+      int32_t value = _TPE_unzigzag(_TPE_readVarint(&p));
+
+      if (parameterFunction != 0)
+        parameterFunction(index,value);
+
+      break;
+    }
+
+    default: break;
   }
-  else if (direction == 2)
+
+  return p;
+}
+
+/** Writes a prepared entry and applies it (so that recording and replaying
+  are guaranteed to do the same). */
+uint8_t _TPE_inputLogCommit(TPE_InputLog *inputLog, TPE_World *world,
+  uint8_t *end)
+{
+  if (end == 0)
+    return 0;
+
+  _TPE_inputLogApply(inputLog->data + inputLog->size,world,
+    inputLog->parameterFunction);
+  inputLog->size = end - inputLog->data;
+
+  return 1;
+}
+
+uint8_t TPE_inputLogAccelerate(TPE_InputLog *inputLog, TPE_World *world,
+  uint16_t body, TPE_Vec3 velocity)
+{
+  uint8_t *p = _TPE_inputLogEntry(inputLog,TPE_INPUT_ACCELERATE,body);
+
+  if (p)
+    _TPE_inputLogWriteVec3(&p,velocity);
+
+  return _TPE_inputLogCommit(inputLog,world,p);
+}
+
+uint8_t TPE_inputLogSpin(TPE_InputLog *inputLog, TPE_World *world,
+  uint16_t body, TPE_Vec3 rotation)
+{
+  uint8_t *p = _TPE_inputLogEntry(inputLog,TPE_INPUT_SPIN,body);
+
+  if (p)
+    _TPE_inputLogWriteVec3(&p,rotation);
+
+  return _TPE_inputLogCommit(inputLog,world,p);
+}
+
+uint8_t TPE_inputLogApplyGravity(TPE_InputLog *inputLog, TPE_World *world,
+  uint16_t body, TPE_Unit downwardsAccel)
+{
+  uint8_t *p = _TPE_inputLogEntry(inputLog,TPE_INPUT_GRAVITY,body);
+
+  if (p)
+    _TPE_writeVarint(&p,_TPE_zigzag(downwardsAccel));
+
+  return _TPE_inputLogCommit(inputLog,world,p);
+}
+
+uint8_t TPE_inputLogJointPin(TPE_InputLog *inputLog, TPE_World *world,
+  uint16_t body, uint8_t joint, TPE_Vec3 position)
+{
+  uint8_t *p = _TPE_inputLogEntry(inputLog,TPE_INPUT_JOINT_PIN,body);
+
+  if (p)
   {
-    TPE_Unit tmp = point.z;
-    point.z = point.x;
-    point.x = tmp;
+    *p = joint;
+    p++;
+    _TPE_inputLogWriteVec3(&p,position);
   }
 
-  return TPE_vec3Plus(point,center);
+  return _TPE_inputLogCommit(inputLog,world,p);
 }
 
-TPE_Vec3 TPE_envGround(TPE_Vec3 point, TPE_Unit height)
+uint8_t TPE_inputLogJointVelocity(TPE_InputLog *inputLog, TPE_World *world,
+  uint16_t body, uint8_t joint, TPE_Vec3 velocity)
 {
-  if (point.y > height)
-    point.y = height;
+  uint8_t *p = _TPE_inputLogEntry(inputLog,TPE_INPUT_JOINT_VELOCITY,body);
 
-  return point;
+  if (p)
+  {
+    *p = joint;
+    p++;
+    _TPE_inputLogWriteVec3(&p,velocity);
+  }
+
+  return _TPE_inputLogCommit(inputLog,world,p);
 }
 
-uint32_t _TPE_hash(uint32_t n)
+uint8_t TPE_inputLogParameter(TPE_InputLog *inputLog, uint8_t index,
+  int32_t value)
 {
-  // parameters found by hash-prospector project
-  n = 250009959 * (n ^ (n >> 17));
-  n = 2626308659 * (n ^ (n >> 15));
-  return n ^ (n >> 16);
+  uint8_t *p = _TPE_inputLogEntry(inputLog,TPE_INPUT_PARAMETER,index);
+
+  if (p)
+    _TPE_writeVarint(&p,_TPE_zigzag(value));
+
+  return _TPE_inputLogCommit(inputLog,0,p);
 }
 
-uint32_t TPE_jointHash(const TPE_Joint *joint)
+uint8_t TPE_inputLogStep(TPE_InputLog *inputLog, TPE_World *world)
 {
-  uint32_t 
-    r = _TPE_hash(joint->position.x);
-    r = _TPE_hash(r ^ joint->position.y);
-    r = _TPE_hash(r ^ joint->position.z);
-    r = _TPE_hash(r ^
-      (((uint32_t) joint->velocity[0]) |
-      (((uint32_t) joint->velocity[1]) << 16)));
-    r = _TPE_hash(r ^ 
-      (((uint32_t) joint->velocity[2]) |
-      ((uint32_t) joint->sizeDivided)));
-  
-  return r;
+  uint8_t *p = _TPE_inputLogEntry(inputLog,TPE_INPUT_STEP,0);
+
+  if (p == 0)
+    return 0;
+
+  TPE_worldStep(world);
+  inputLog->tick++;
+
+  if (inputLog->checkpointInterval != 0 &&
+    inputLog->tick % inputLog->checkpointInterval == 0)
+  {
+    uint32_t hash = TPE_worldHash(world);
+
+    *p = TPE_INPUT_CHECKPOINT;
+    p++;
+
+    for (uint8_t i = 0; i < 4; ++i)
+    {
+      *p = hash >> (i * 8);
+      p++;
+    }
+  }
+
+  inputLog->size = p - inputLog->data;
+
+  return 1;
 }
 
-uint32_t TPE_connectionHash(const TPE_Connection *connection)
+/** Returns pointer after given log entry. */
+const uint8_t *_TPE_inputLogSkip(const uint8_t *p)
 {
-  return _TPE_hash(
-   ((uint32_t) connection->length) |
-   (((uint32_t) connection->joint1) << 16) |
-   (((uint32_t) connection->joint2) << 24));
+  uint8_t type = *p;
+  p++;
+
+  switch (type)
+  {
+    case TPE_INPUT_STEP: return p; break;
+    case TPE_INPUT_CHECKPOINT: return p + 4; break;
+
+    default:
+    {
+      uint8_t values = type == TPE_INPUT_GRAVITY ||
+        type == TPE_INPUT_PARAMETER ? 2 : 4;
+
+      if (type == TPE_INPUT_JOINT_PIN || type == TPE_INPUT_JOINT_VELOCITY)
+      {
+        _TPE_readVarint(&p);
+        p++; // joint index
+        values = 3;
+      }
+
+      for (uint8_t i = 0; i < values; ++i)
+        _TPE_readVarint(&p);
+
+      return p;
+      break;
+    }
+  }
 }
 
-uint32_t TPE_bodyHash(const TPE_Body *body)
+uint32_t TPE_inputLogTickOffset(const TPE_InputLog *inputLog, uint32_t tick)
 {
-  uint32_t r = _TPE_hash(
-    ((uint32_t) body->jointMass) |
-    (((uint32_t) body->flags) << 16) |
-    (((uint32_t) body->deactivateCount) << 24)) ^
-      _TPE_hash(
-    ((uint32_t) body->friction) |
-    (((uint32_t) body->elasticity) << 16));
+  const uint8_t *p = inputLog->data, *end = inputLog->data + inputLog->size;
 
-  for (uint8_t i = 0; i < body->jointCount; ++i)
-    r = _TPE_hash(r ^ TPE_jointHash(&body->joints[i]));
+  while (tick > 0 && p < end)
+  {
+    if (*p == TPE_INPUT_STEP)
+      tick--;
 
-  for (uint8_t i = 0; i < body->connectionCount; ++i)
-    r = _TPE_hash(r ^ TPE_connectionHash(&body->connections[i]));
+    p = _TPE_inputLogSkip(p);
+  }
 
-  return r;
+  // checkpoint belongs to the previous tick:
+
+  if (p < end && *p == TPE_INPUT_CHECKPOINT)
+    p = _TPE_inputLogSkip(p);
+
+  return p - inputLog->data;
 }
 
-uint32_t TPE_worldHash(const TPE_World *world)
+int32_t TPE_inputLogReplay(const TPE_InputLog *inputLog, TPE_World *world,
+  uint32_t fromTick, uint32_t toTick)
 {
-  uint32_t r = 0;
+  const uint8_t *p = inputLog->data + TPE_inputLogTickOffset(inputLog,fromTick),
+    *end = inputLog->data + inputLog->size;
 
-  for (uint8_t i = 0; i < world->bodyCount; ++i)
-    r = _TPE_hash(r ^ TPE_bodyHash(&world->bodies[i]));
+  while (p < end)
+  {
+    if (*p == TPE_INPUT_CHECKPOINT)
+    {
+      // verified also right after the last replayed step
 
-  return r;
+      uint32_t hash = 0;
+
+      for (uint8_t i = 0; i < 4; ++i)
+        hash |= ((uint32_t) p[1 + i]) << (i * 8);
+
+      if (hash != TPE_worldHash(world))
+        return fromTick;
+
+      p += 5;
+    }
+    else if (fromTick >= toTick)
+      break;
+    else if (*p == TPE_INPUT_STEP)
+    {
+      TPE_worldStep(world);
+      fromTick++;
+      p++;
+    }
+    else
+      p = _TPE_inputLogApply(p,world,inputLog->parameterFunction);
+  }
+
+  return -1;
 }
 
 void TPE_bodyMoveTo(TPE_Body *body, TPE_Vec3 position)